@@ -0,0 +1,132 @@
+#include "archive_reader.hpp"
+#include "utility.hpp"
+
+#include <algorithm>
+#include <cctype>
+#include <new>
+
+#ifdef PCOLL_LIBARCHIVE
+#include <archive.h>
+#include <archive_entry.h>
+#endif
+
+using std::string;
+
+#ifdef PCOLL_LIBARCHIVE
+/** Extensions of the archives that are read */
+static const char* ARCHIVE_EXTENSIONS[] = {".zip", ".tar", ".tgz", ".tar.gz", ".tbz2", ".tar.bz2", ".txz", ".tar.xz", ".7z"};
+
+/** Bytes asked from libarchive at once while opening an archive */
+static const unsigned long int ARCHIVE_BLOCK_SIZE = 64 * 1024;
+
+static string get_error(struct archive* archive){
+	const char* error = archive_error_string(archive);
+	return error ? error : "unknown error";
+}
+#endif
+
+bool Archive_Reader::is_archive(const string& path){
+#ifdef PCOLL_LIBARCHIVE
+	// Compare the end of the name without case
+	string name = path;
+	std::transform(name.begin(), name.end(), name.begin(), [](unsigned char c){ return std::tolower(c); });
+	for(auto& extension : ARCHIVE_EXTENSIONS){
+		string suffix(extension);
+		if(name.size() > suffix.size() && name.compare(name.size() - suffix.size(), suffix.size(), suffix) == 0) return true;
+	}
+#else
+	(void)path;
+#endif
+	return false;
+}
+
+unsigned int Archive_Reader::read_members(const string& path, const std::function<bool(const string&)>& accept, unsigned long int max_size, const std::function<void(const File_Buffer&)>& function){
+#ifdef PCOLL_LIBARCHIVE
+	struct archive* archive = archive_read_new();
+	archive_read_support_filter_all(archive);
+	archive_read_support_format_all(archive);
+	if(archive_read_open_filename(archive, path.c_str(), ARCHIVE_BLOCK_SIZE) != ARCHIVE_OK){
+		string error = get_error(archive);
+		archive_read_free(archive);
+		throw Pexception("Cannot open archive '" + path + "': " + error);
+	}
+
+	unsigned int count = 0;
+	struct archive_entry* entry;
+	int result;
+	while((result = archive_read_next_header(archive, &entry)) == ARCHIVE_OK || result == ARCHIVE_WARN){
+		if(archive_entry_filetype(entry) != AE_IFREG) continue;
+
+		File_Buffer buffer;
+		buffer.path = path + SEPARATOR + archive_entry_pathname(entry);
+		buffer.modified = archive_entry_mtime(entry) * 1000000000LL + archive_entry_mtime_nsec(entry);
+
+		// Members that are not wanted are never decompressed into memory
+		bool wanted;
+		try{ wanted = accept(buffer.path);
+		}catch(...){
+			archive_read_free(archive);
+			throw;
+		}
+		if(!wanted){
+			archive_read_data_skip(archive);
+			continue;
+		}
+
+		// Read the member, growing the buffer when the archive doesn't record its size
+		// The recorded size comes from the header as it is, so it is bounded before anything is allocated
+		bool sized = archive_entry_size_is_set(entry) && archive_entry_size(entry) >= 0;
+		unsigned long int capacity = sized ? archive_entry_size(entry) : std::min(ARCHIVE_BLOCK_SIZE, max_size);
+		try{
+			if(capacity > max_size) throw Pexception("Member '" + buffer.path + "' is larger than " + std::to_string(max_size) + " bytes, skipped");
+			buffer.data.reset(new char[std::max(capacity, 1UL)]);
+			while(true){
+				if(buffer.size == capacity){
+					if(sized) break;
+					if(capacity >= max_size) throw Pexception("Member '" + buffer.path + "' is larger than " + std::to_string(max_size) + " bytes, skipped");
+					unsigned long int larger_capacity = std::min(capacity * 2, max_size);
+					std::unique_ptr<char[]> larger(new char[larger_capacity]);
+					std::copy(buffer.data.get(), buffer.data.get() + buffer.size, larger.get());
+					buffer.data = std::move(larger);
+					capacity = larger_capacity;
+				}
+				la_ssize_t length = archive_read_data(archive, buffer.data.get() + buffer.size, capacity - buffer.size);
+				if(length < 0) throw Pexception("Failed to read '" + buffer.path + "': " + get_error(archive));
+				if(length == 0) break;
+				buffer.size += length;
+			}
+		}catch(Pexception& pe){
+			buffer.error = pe.what();
+		}catch(std::bad_alloc& e){
+			buffer.error = "Cannot hold member '" + buffer.path + "' in memory, skipped";
+		}
+		if(!buffer.error.empty()){
+			buffer.data.reset();
+			buffer.size = 0;
+			archive_read_data_skip(archive);
+		}
+
+		try{ function(buffer);
+		}catch(...){
+			archive_read_free(archive);
+			throw;
+		}
+		count++;
+	}
+
+	// Stopped by damage rather than by the end of the archive
+	if(result != ARCHIVE_EOF){
+		string error = get_error(archive);
+		archive_read_free(archive);
+		throw Pexception("Damaged archive '" + path + "': " + error);
+	}
+
+	archive_read_free(archive);
+	return count;
+#else
+	(void)accept;
+	(void)max_size;
+	(void)function;
+	throw Pexception("Cannot read archive '" + path + "': pcoll was built without libarchive");
+#endif
+}
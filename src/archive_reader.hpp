@@ -0,0 +1,36 @@
+#ifndef __PCOLL_ARCHIVE_READER__
+#define __PCOLL_ARCHIVE_READER__
+
+#include <string>
+#include <functional>
+
+#include "file_reader.hpp"
+
+/** Reads the files inside zip and tar archives without extracting them
+ *	Every member is read into memory and named by a virtual path, the path of the archive followed
+ *	by "!/" and the name of the member. Needs libarchive, without it no file is an archive.
+ */
+class Archive_Reader {
+public:
+	/** Separates the path of an archive from the name of a member in virtual paths */
+	static constexpr const char* SEPARATOR = "!/";
+
+	/** Checks by its extension if a file is an archive that can be read
+	 *	@param path path of the file
+	 *	@return true if the members of the file can be read
+	 */
+	static bool is_archive(const std::string& path);
+
+	/** Reads every regular file in an archive, one at a time
+	 *	Throws Pexception if the archive can't be opened or is damaged. A member that is too large or
+	 *	can't be held in memory is handed over with an error instead of its contents.
+	 *	@param path path of the archive
+	 *	@param accept called with the virtual path of every member before it is read, members it rejects are skipped
+	 *	@param max_size largest member read into memory, in bytes
+	 *	@param function called with every accepted member, the buffer is only valid during the call
+	 *	@return number of members handed over
+	 */
+	static unsigned int read_members(const std::string& path, const std::function<bool(const std::string&)>& accept, unsigned long int max_size, const std::function<void(const File_Buffer&)>& function);
+};
+
+#endif //__PCOLL_ARCHIVE_READER__
@@ -0,0 +1,68 @@
+#include "blocking_key.hpp"
+
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <tuple>
+
+using std::string;
+
+/** Width of an aspect ratio bucket on a log2 scale, about a fifth wider or taller */
+static const double ASPECT_BUCKET_WIDTH = 0.25;
+
+/** Days in a capture date window */
+static const int32_t DATE_WINDOW_DAYS = 30;
+
+Blocking_Key::Blocking_Key() : aspect(UNKNOWN), orientation(UNKNOWN), date(UNKNOWN), model(0) {}
+
+Blocking_Key::Blocking_Key(const OIIO::ImageSpec& spec) : Blocking_Key() {
+	if(spec.width > 0 && spec.height > 0)
+		aspect = (int32_t)std::floor(std::log2((double)spec.width / spec.height) / ASPECT_BUCKET_WIDTH);
+
+	// EXIF orientations 5 to 8 turn the picture by a quarter
+	int exif_orientation = spec.get_int_attribute("Orientation", 0);
+	if(exif_orientation >= 1 && exif_orientation <= 8) orientation = exif_orientation <= 4 ? 1 : 2;
+
+	// The moment the shutter was pressed survives edits that rewrite the other dates
+	string taken = spec.get_string_attribute("Exif:DateTimeOriginal");
+	if(taken.empty()) taken = spec.get_string_attribute("DateTime");
+	int32_t days = parse_date(taken);
+	if(days != UNKNOWN) date = days >= 0 ? days / DATE_WINDOW_DAYS : (days - DATE_WINDOW_DAYS + 1) / DATE_WINDOW_DAYS;
+
+	string camera = spec.get_string_attribute("Make") + '\n' + spec.get_string_attribute("Model");
+	if(camera.size() > 1) model = std::hash<string>()(camera);
+}
+
+int32_t Blocking_Key::parse_date(const string& date){
+	// EXIF writes "YYYY:MM:DD HH:MM:SS", some writers use dashes
+	int year, month, day;
+	if(std::sscanf(date.c_str(), "%4d%*1[:-]%2d%*1[:-]%2d", &year, &month, &day) != 3) return UNKNOWN;
+	if(year <= 0 || month < 1 || month > 12 || day < 1 || day > 31) return UNKNOWN;
+
+	// Days from the civil date, counting years from March so the leap day comes last
+	year -= month <= 2;
+	int era = (year >= 0 ? year : year - 399) / 400;
+	int year_of_era = year - era * 400;
+	int day_of_year = (153 * (month + (month > 2 ? -3 : 9)) + 2) / 5 + day - 1;
+	int day_of_era = year_of_era * 365 + year_of_era / 4 - year_of_era / 100 + day_of_year;
+	return era * 146097 + day_of_era - 719468;
+}
+
+bool Blocking_Key::is_near(const Blocking_Key& other) const{
+	auto adjacent = [](int32_t one, int32_t two) -> bool {
+		return one == UNKNOWN || two == UNKNOWN || std::abs((long int)one - two) <= 1;
+	};
+	auto same = [](int32_t one, int32_t two) -> bool {
+		return one == UNKNOWN || two == UNKNOWN || one == two;
+	};
+	return adjacent(aspect, other.aspect) && same(orientation, other.orientation) && adjacent(date, other.date)
+		&& (model == 0 || other.model == 0 || model == other.model);
+}
+
+bool Blocking_Key::operator==(const Blocking_Key& other) const{
+	return aspect == other.aspect && orientation == other.orientation && date == other.date && model == other.model;
+}
+
+bool Blocking_Key::operator<(const Blocking_Key& other) const{
+	return std::tie(aspect, orientation, date, model) < std::tie(other.aspect, other.orientation, other.date, other.model);
+}
@@ -0,0 +1,38 @@
+#ifndef __PCOLL_BLOCKING_KEY__
+#define __PCOLL_BLOCKING_KEY__
+
+#include <string>
+#include <cstdint>
+#include <OpenImageIO/imageio.h>
+
+/** Cheap facts from the header of an image that tell images apart that could never be duplicates
+ *	The aspect ratio is put in buckets and the capture date in windows, images are compared only
+ *	within the same or the next bucket and window. The orientation and camera have to match. A fact
+ *	missing from either header matches anything, so images without metadata are compared to all others.
+ */
+struct Blocking_Key {
+	static const int32_t UNKNOWN = INT32_MIN;
+
+	Blocking_Key();
+
+	/** Reads the key from a header, the pixels are not decoded
+	 *	@param spec header of the image at its full resolution
+	 */
+	Blocking_Key(const OIIO::ImageSpec& spec);
+
+	/** @return true if the images of both keys may be duplicates */
+	bool is_near(const Blocking_Key& other) const;
+
+	bool operator==(const Blocking_Key& other) const;
+	bool operator<(const Blocking_Key& other) const;
+
+	int32_t aspect; // bucket of the logarithm of width over height
+	int32_t orientation; // 1 if the picture is stored as displayed or mirrored, 2 if it is stored on its side
+	int32_t date; // window of days the picture was taken in
+	std::size_t model; // hash of the camera maker and model, zero if unknown
+
+	/** @return days since 1970-01-01 of an EXIF date, UNKNOWN if it cannot be read */
+	static int32_t parse_date(const std::string& date);
+};
+
+#endif //__PCOLL_BLOCKING_KEY__
@@ -0,0 +1,173 @@
+#include "checkpoint.hpp"
+#include "utility.hpp"
+
+#include <fstream>
+#include <cstring>
+#include <cerrno>
+#include <cstdio>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+using std::string;
+
+static const char* FILES_HEADER = "pcoll-files 1";
+static const char* ALIASES_HEADER = "pcoll-aliases 1";
+
+/** Entries are written out at least this often */
+static const std::chrono::seconds FLUSH_INTERVAL(10);
+
+/** Entries are written out early once they take this many bytes */
+static const unsigned long int FLUSH_SIZE = 1024 * 1024;
+
+Checkpoint::Checkpoint(const string& path, const string& signature) :
+	_path(path),
+	_files_path(path + ".files"),
+	_aliases_path(path + ".aliases"),
+	_signature(signature),
+	_fd(-1),
+	_buffer(),
+	_last_flush(std::chrono::steady_clock::now()),
+	_buffer_mutex(),
+	_files(),
+	_files_mutex(),
+	_files_saved(false)
+{}
+
+Checkpoint::~Checkpoint(){
+	if(_fd >= 0){
+		try{ flush();
+		}catch(Pexception& pe){
+			Utility::sout.printerrln(pe.what());
+		}
+		close(_fd);
+	}
+}
+
+bool Checkpoint::open(bool resume, const string& header){
+	bool kept = false;
+	if(resume){
+		_fd = ::open(_path.c_str(), O_RDWR | O_CLOEXEC);
+		if(_fd >= 0){
+
+			// Drop the last entry if it was cut off while being written
+			struct stat info;
+			if(fstat(_fd, &info) != 0) throw Pexception("Cannot read checkpoint '" + _path + "': " + std::strerror(errno));
+			off_t end = info.st_size;
+			char c = 0;
+			while(end > 0 && pread(_fd, &c, 1, end - 1) == 1 && c != '\n') end--;
+			if(end != info.st_size && ftruncate(_fd, end) != 0) throw Pexception("Cannot repair checkpoint '" + _path + "': " + std::strerror(errno));
+			lseek(_fd, 0, SEEK_END);
+			kept = end != 0;
+		}
+	}
+
+	// Start over
+	if(!kept){
+		if(_fd >= 0) close(_fd);
+		_fd = ::open(_path.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+		if(_fd < 0) throw Pexception("Cannot open checkpoint '" + _path + "' for writing: " + std::strerror(errno));
+		std::remove(_files_path.c_str());
+		std::remove(_aliases_path.c_str());
+		_buffer = header + "\n";
+		write_buffer();
+	}
+	return kept;
+}
+
+const string& Checkpoint::get_log_path() const{
+	return _path;
+}
+
+void Checkpoint::record(const string& entry){
+	std::unique_lock<std::mutex> lock(_buffer_mutex);
+	_buffer += entry;
+	_buffer += '\n';
+	if(_buffer.size() >= FLUSH_SIZE || std::chrono::steady_clock::now() - _last_flush >= FLUSH_INTERVAL) write_buffer();
+}
+
+void Checkpoint::flush(){
+	std::unique_lock<std::mutex> lock(_buffer_mutex);
+	write_buffer();
+}
+
+void Checkpoint::write_buffer(){
+	_last_flush = std::chrono::steady_clock::now();
+	unsigned long int offset = 0;
+	while(offset < _buffer.size()){
+		ssize_t result = write(_fd, _buffer.data() + offset, _buffer.size() - offset);
+		if(result < 0 && errno == EINTR) continue;
+		if(result <= 0) throw Pexception("Failed to write checkpoint '" + _path + "': " + std::strerror(errno));
+		offset += result;
+	}
+	_buffer.clear();
+
+	// Entries only count once they are on disk
+	fdatasync(_fd);
+}
+
+void Checkpoint::add_file(const string& path){
+	std::unique_lock<std::mutex> lock(_files_mutex);
+	_files.push_back(path);
+}
+
+void Checkpoint::save_files(const std::list<std::pair<string, string>>& aliases){
+	if(_files_saved.exchange(true)) return;
+
+	// The aliases go first, the list of files is what marks the walk as saved
+	string temporary_path = _aliases_path + ".tmp";
+	std::ofstream aliases_output(temporary_path, std::ios::trunc);
+	if(!aliases_output.is_open()) throw Pexception("Cannot open '" + temporary_path + "' for writing!");
+	aliases_output << ALIASES_HEADER << " " << _signature << "\n";
+	for(auto& alias : aliases) aliases_output << alias.first << "\n" << alias.second << "\n";
+	aliases_output.close();
+	if(aliases_output.fail() || std::rename(temporary_path.c_str(), _aliases_path.c_str()) != 0)
+		throw Pexception("Failed to write '" + _aliases_path + "'!");
+
+	// Write to a temporary file first so a cut off list is never read
+	temporary_path = _files_path + ".tmp";
+	std::ofstream output(temporary_path, std::ios::trunc);
+	if(!output.is_open()) throw Pexception("Cannot open '" + temporary_path + "' for writing!");
+	output << FILES_HEADER << " " << _signature << "\n";
+	{
+		std::unique_lock<std::mutex> lock(_files_mutex);
+		for(auto& path : _files) output << path << "\n";
+		_files.clear();
+	}
+	output.close();
+	if(output.fail() || std::rename(temporary_path.c_str(), _files_path.c_str()) != 0)
+		throw Pexception("Failed to write '" + _files_path + "'!");
+}
+
+bool Checkpoint::load_files(std::list<string>& files, std::list<std::pair<string, string>>& aliases){
+	std::ifstream input(_files_path);
+	std::ifstream aliases_input(_aliases_path);
+	if(!input.is_open() || !aliases_input.is_open()) return false;
+
+	// Only the walk of the same scan can be reused
+	string line, original;
+	if(!std::getline(input, line) || line != string(FILES_HEADER) + " " + _signature) return false;
+	if(!std::getline(aliases_input, original) || original != string(ALIASES_HEADER) + " " + _signature) return false;
+	while(std::getline(input, line)){
+		if(!line.empty()) files.push_back(line);
+	}
+
+	// Two lines per alias, the alias then the first path to its file
+	while(std::getline(aliases_input, line) && std::getline(aliases_input, original))
+		aliases.push_back(std::make_pair(line, original));
+
+	// Already saved, no need to collect the files again
+	_files_saved = true;
+	return true;
+}
+
+void Checkpoint::remove(){
+	if(_fd >= 0){
+		close(_fd);
+		_fd = -1;
+	}
+	_buffer.clear();
+	std::remove(_path.c_str());
+	std::remove(_files_path.c_str());
+	std::remove(_aliases_path.c_str());
+}
@@ -0,0 +1,80 @@
+#ifndef __PCOLL_CHECKPOINT__
+#define __PCOLL_CHECKPOINT__
+
+#include <string>
+#include <list>
+#include <utility>
+#include <mutex>
+#include <atomic>
+#include <chrono>
+
+/** Lets an interrupted scan continue where it stopped
+ *	Finished inserts are appended to a log that is itself an index, written out every few seconds.
+ *	Once the walk is done the files it found are saved too, with the other paths it reached them by, so a
+ *	resumed scan neither walks again nor reads a file the log already holds.
+ */
+class Checkpoint {
+public:
+	/** @param path path of the log, the files found are saved next to it
+	 *	@param signature identifies the scan, a saved walk of another scan is not used
+	 */
+	Checkpoint(const std::string& path, const std::string& signature);
+	~Checkpoint();
+	Checkpoint(const Checkpoint& other) = delete;
+	Checkpoint& operator=(const Checkpoint& other) = delete;
+
+	/** Opens the log
+	 *	@param resume if true, an earlier log is kept and appended to, otherwise it is started over
+	 *	@param header first line of a new log
+	 *	@return true if an earlier log was kept
+	 */
+	bool open(bool resume, const std::string& header);
+
+	/** @return path of the log */
+	const std::string& get_log_path() const;
+
+	/** Adds an entry to the log, written out with the next flush
+	 *	@param entry one line, without its line break
+	 */
+	void record(const std::string& entry);
+
+	/** Writes the entries that were not written out yet */
+	void flush();
+
+	/** Adds a file found by the walk
+	 *	@param path path of the file
+	 */
+	void add_file(const std::string& path);
+
+	/** Saves the files found once the walk is done, only the first call writes them
+	 *	@param aliases every other path a file was reached by, with the first path to that file
+	 */
+	void save_files(const std::list<std::pair<std::string, std::string>>& aliases);
+
+	/** Reads the files found by an earlier walk of the same scan
+	 *	@param files where the files are put
+	 *	@param aliases where the other paths to the files are put, with the first path to each file
+	 *	@return true if they were saved
+	 */
+	bool load_files(std::list<std::string>& files, std::list<std::pair<std::string, std::string>>& aliases);
+
+	/** Deletes the checkpoint after the scan finished */
+	void remove();
+
+private:
+	void write_buffer();
+
+	std::string _path;
+	std::string _files_path;
+	std::string _aliases_path;
+	std::string _signature;
+	int _fd;
+	std::string _buffer;
+	std::chrono::steady_clock::time_point _last_flush;
+	std::mutex _buffer_mutex;
+	std::list<std::string> _files;
+	std::mutex _files_mutex;
+	std::atomic<bool> _files_saved;
+};
+
+#endif //__PCOLL_CHECKPOINT__
@@ -0,0 +1,132 @@
+#include "concurrency_controller.hpp"
+#include "utility.hpp"
+
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <algorithm>
+
+using std::string;
+using std::chrono::steady_clock;
+using std::chrono::duration;
+
+/** Change in throughput that is taken as noise */
+static const double THROUGHPUT_TOLERANCE = 0.05;
+
+/** Share of resident memory in the limit past which workers are taken away */
+static const double MEMORY_HEADROOM = 0.9;
+
+/** Share of core time waiting on disks past which a further rise takes workers away */
+static const double IOWAIT_LIMIT = 0.3;
+
+/** Rise of that share between two samples that counts */
+static const double IOWAIT_RISE = 0.05;
+
+Concurrency_Controller::Concurrency_Controller(const Progress_Counters& counters, unsigned int initial, unsigned int maximum, unsigned long int memory_limit, std::chrono::milliseconds interval) :
+	_counters(counters),
+	_maximum(maximum == 0 ? 1 : maximum),
+	_memory_limit(memory_limit),
+	_interval(interval),
+	_active(std::max(1u, std::min(initial, _maximum))),
+	_stopping(false),
+	_mutex(),
+	_condition(),
+	_thread()
+{
+	_thread = std::make_unique<std::thread>(&Concurrency_Controller::thread_function, this);
+}
+
+Concurrency_Controller::~Concurrency_Controller(){
+	{
+		std::unique_lock<std::mutex> lock(_mutex);
+		_stopping = true;
+	}
+	_condition.notify_all();
+	_thread->join();
+}
+
+bool Concurrency_Controller::is_active(unsigned int worker) const{
+	return worker < _active;
+}
+
+unsigned int Concurrency_Controller::get_active() const{
+	return _active;
+}
+
+bool Concurrency_Controller::read_cpu_times(unsigned long long int& iowait, unsigned long long int& total){
+	// The first line adds up every core: user nice system idle iowait irq softirq steal
+	std::ifstream input("/proc/stat");
+	string line;
+	if(!std::getline(input, line) || line.compare(0, 4, "cpu ") != 0) return false;
+	std::istringstream fields(line.substr(4));
+	unsigned long long int value = 0;
+	total = 0;
+	for(unsigned int field = 0; field < 8 && fields >> value; field++){
+		if(field == 4) iowait = value;
+		total += value;
+	}
+	return total != 0;
+}
+
+void Concurrency_Controller::thread_function(){
+	unsigned long int last_files = _counters.files_done, last_bytes = _counters.bytes_hashed;
+	double last_file_rate = 0, last_byte_rate = 0, last_iowait_share = 0;
+	unsigned long long int last_iowait = 0, last_total = 0;
+	bool cpu_times = read_cpu_times(last_iowait, last_total);
+	auto last_time = steady_clock::now();
+	int direction = 1;
+
+	while(true){
+		{
+			std::unique_lock<std::mutex> lock(_mutex);
+			if(_condition.wait_for(lock, _interval, [&](){ return _stopping; })) return;
+		}
+
+		// Throughput at the current number of workers
+		unsigned long int files = _counters.files_done;
+		unsigned long int bytes = _counters.bytes_hashed;
+		auto now = steady_clock::now();
+		double seconds = duration<double>(now - last_time).count();
+		if(seconds <= 0) continue;
+		double file_rate = (files - last_files) / seconds;
+		double byte_rate = (bytes - last_bytes) / seconds;
+		last_files = files;
+		last_bytes = bytes;
+		last_time = now;
+
+		// Share of core time spent waiting on disks
+		double iowait_share = last_iowait_share;
+		unsigned long long int iowait = 0, total = 0;
+		if(cpu_times && read_cpu_times(iowait, total) && total > last_total){
+			iowait_share = (double)(iowait - last_iowait) / (total - last_total);
+			last_iowait = iowait;
+			last_total = total;
+		}
+		bool iowait_rising = iowait_share > IOWAIT_LIMIT && iowait_share > last_iowait_share + IOWAIT_RISE;
+		last_iowait_share = iowait_share;
+
+		// Back off while memory runs short or the disks fall behind, otherwise climb towards more throughput
+		bool move = true;
+		if(Utility::get_resident_bytes() > _memory_limit * MEMORY_HEADROOM || iowait_rising){
+			direction = -1;
+		}else if(last_file_rate > 0 || last_byte_rate > 0){
+			double change = 0;
+			unsigned int rates = 0;
+			if(last_file_rate > 0){ change += file_rate / last_file_rate; rates++; }
+			if(last_byte_rate > 0){ change += byte_rate / last_byte_rate; rates++; }
+			change /= rates;
+			if(change < 1 - THROUGHPUT_TOLERANCE) direction = -direction;
+			else if(change <= 1 + THROUGHPUT_TOLERANCE) move = false;
+		}
+		last_file_rate = file_rate;
+		last_byte_rate = byte_rate;
+
+		// One worker at a time
+		unsigned int active = _active;
+		if(move){
+			if(direction > 0 && active < _maximum) active++;
+			else if(direction < 0 && active > 1) active--;
+			_active = active;
+		}
+	}
+}
@@ -0,0 +1,59 @@
+#ifndef __PCOLL_CONCURRENCY_CONTROLLER__
+#define __PCOLL_CONCURRENCY_CONTROLLER__
+
+#include <atomic>
+#include <chrono>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <memory>
+
+#include "progress_reporter.hpp"
+
+/** Decides how many of the scan workers are active from a thread of its own
+ *	Every interval the throughput of files and bytes is sampled and the number of active workers is
+ *	moved by one, on in the same direction while throughput improves and back once it drops. Workers
+ *	are taken away while resident memory nears the limit or while the disks make the cores wait longer.
+ */
+class Concurrency_Controller {
+public:
+	/** Starts the controller thread
+	 *	@param counters counters to sample, must outlive the controller
+	 *	@param initial number of workers active at first
+	 *	@param maximum number of workers started
+	 *	@param memory_limit bytes of resident memory to stay below
+	 *	@param interval time between two adjustments
+	 */
+	Concurrency_Controller(const Progress_Counters& counters, unsigned int initial, unsigned int maximum, unsigned long int memory_limit, std::chrono::milliseconds interval);
+
+	/** Stops the controller thread */
+	~Concurrency_Controller();
+	Concurrency_Controller(const Concurrency_Controller& other) = delete;
+	Concurrency_Controller& operator=(const Concurrency_Controller& other) = delete;
+
+	/** @param worker number of the worker, from zero
+	 *	@return true if the worker should take work, otherwise it waits
+	 */
+	bool is_active(unsigned int worker) const;
+
+	/** @return number of active workers */
+	unsigned int get_active() const;
+
+private:
+	void thread_function();
+
+	/** Reads the time every core spent waiting on disks and in total from /proc/stat */
+	static bool read_cpu_times(unsigned long long int& iowait, unsigned long long int& total);
+
+	const Progress_Counters& _counters;
+	unsigned int _maximum;
+	unsigned long int _memory_limit;
+	std::chrono::milliseconds _interval;
+	std::atomic<unsigned int> _active;
+	bool _stopping;
+	std::mutex _mutex;
+	std::condition_variable _condition;
+	std::unique_ptr<std::thread> _thread;
+};
+
+#endif //__PCOLL_CONCURRENCY_CONTROLLER__
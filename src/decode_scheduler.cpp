@@ -0,0 +1,160 @@
+#include "decode_scheduler.hpp"
+#include "utility.hpp"
+
+#include <algorithm>
+#include <cstring>
+#include <unistd.h>
+#include <OpenImageIO/imagecache.h>
+
+using std::string;
+
+/** Share of the budget given to the shared OpenImageIO cache, and the most it gets */
+static const unsigned long int CACHE_BUDGET_DIVISOR = 8;
+static const unsigned long int MAX_CACHE_BYTES = 256UL * 1024 * 1024;
+
+/** Offset of the interlace method in a PNG, the last byte of the header chunk */
+static const unsigned long int PNG_INTERLACE_OFFSET = 28;
+
+/** JPEG markers of progressive frames, their coefficients are buffered for the whole image */
+static const unsigned char MARKER_SOF0 = 0xC0;
+static const unsigned char MARKER_SOF15 = 0xCF;
+static const unsigned char MARKER_DHT = 0xC4; // huffman tables, in the range of frame markers
+static const unsigned char MARKER_JPG = 0xC8;
+static const unsigned char MARKER_DAC = 0xCC;
+static const unsigned char MARKER_SOS = 0xDA;
+static const unsigned char PROGRESSIVE_MARKERS[] = {0xC2, 0xC6, 0xCA, 0xCE};
+
+Decode_Scheduler::Decode_Scheduler() : _budget(0), _used(0), _exclusive_waiting(0), _mutex(), _condition() {}
+
+void Decode_Scheduler::set_memory_budget(unsigned long int budget){
+	if(budget == 0){
+		std::unique_lock<std::mutex> lock(_mutex);
+		_budget = 0;
+		return;
+	}
+
+	// Images read by path through ImageBuf go through the shared cache, bound it and keep it out of the decode budget
+	unsigned long int cache_bytes = std::min(budget / CACHE_BUDGET_DIVISOR, MAX_CACHE_BYTES);
+	OIIO::ImageCache::create(true)->attribute("max_memory_MB", (float)(cache_bytes / (1024.0 * 1024.0)));
+
+	{
+		std::unique_lock<std::mutex> lock(_mutex);
+		_budget = budget - cache_bytes;
+	}
+	_condition.notify_all();
+}
+
+unsigned long int Decode_Scheduler::estimate_memory(const ImageSpec& spec){
+	return Difference_Hash::get_stream_buffer_size(spec);
+}
+
+unsigned long int Decode_Scheduler::estimate_reader_memory(const string& format, const ImageSpec& spec, const string& path, const char* data, unsigned long int size){
+	bool png = format == "png", jpeg = format == "jpeg";
+	if(!png && !jpeg) return 0;
+
+	// Read the header from the contents in memory or from the file
+	int fd = -1;
+	if(data == nullptr && (fd = Utility::open_file(path)) < 0) return 0;
+	auto read_at = [&](unsigned long int offset, unsigned char* buffer, unsigned long int length) -> bool {
+		if(data == nullptr) return pread(fd, buffer, length, offset) == (ssize_t)length;
+		if(offset + length > size) return false;
+		std::memcpy(buffer, data + offset, length);
+		return true;
+	};
+
+	unsigned long int memory = 0;
+	unsigned char bytes[4];
+	if(png){
+
+		// An interlaced PNG is read whole on the first scanline
+		if(read_at(PNG_INTERLACE_OFFSET, bytes, 1) && bytes[0] != 0) memory = spec.image_bytes(true);
+	}else{
+
+		// Walk the segments up to the frame header, a progressive frame keeps two bytes of coefficients per sample
+		unsigned long int offset = 2;
+		while(read_at(offset, bytes, 4) && bytes[0] == 0xFF && bytes[1] != MARKER_SOS){
+			unsigned char marker = bytes[1];
+			if(marker == 0xFF){ // fill byte
+				offset++;
+				continue;
+			}
+			if(marker >= MARKER_SOF0 && marker <= MARKER_SOF15 && marker != MARKER_DHT && marker != MARKER_JPG && marker != MARKER_DAC){
+				if(std::find(std::begin(PROGRESSIVE_MARKERS), std::end(PROGRESSIVE_MARKERS), marker) != std::end(PROGRESSIVE_MARKERS)) memory = 2 * spec.image_bytes(true);
+				break;
+			}
+			offset += 2 + ((bytes[2] << 8) | bytes[3]);
+		}
+	}
+
+	if(fd >= 0) close(fd);
+	return memory;
+}
+
+Difference_Hash* Decode_Scheduler::compute_hash(const string& path, const char* data, unsigned long int size, Blocking_Key* key, float* thumbnail){
+
+	// Read the header only, contents in memory are not probed beforehand so failing to open them means they are no image
+	int memory_fd;
+	ImageInput* image = nullptr;
+	try{ image = Utility::open_image(path, data, size, memory_fd);
+	}catch(Pexception& pe){
+		if(data != nullptr) return nullptr;
+		throw;
+	}
+
+	// The copy of the contents in memory is held while decoding, and so is the whole frame if the reader cannot stream it
+	unsigned long int contents = data != nullptr ? size : 0;
+	unsigned long int estimate = contents + estimate_reader_memory(image->format_name(), image->spec(), path, data, size) + estimate_memory(image->spec());
+	if(key != nullptr) *key = Blocking_Key(image->spec());
+
+	// Too big to fit on its own, look for a smaller MIP level that does
+	if(_budget != 0 && estimate > _budget){
+		ImageSpec level_spec;
+		for(int level = 1; image->seek_subimage(0, level, level_spec); level++){
+			if(contents + estimate_memory(level_spec) <= _budget){
+				estimate = contents + estimate_memory(level_spec);
+				break;
+			}
+		}
+
+		// None fits, go back to the full image and decode it alone
+		if(estimate > _budget) image->seek_subimage(0, 0, level_spec);
+	}
+
+	unsigned long int charged = acquire(estimate);
+	Difference_Hash* dhash = nullptr;
+	try{
+		dhash = new Difference_Hash(image, path, thumbnail);
+	}catch(Pexception& pe){
+		release(charged);
+		Utility::close_image(image, memory_fd);
+		throw;
+	}
+	release(charged);
+	Utility::close_image(image, memory_fd);
+
+	return dhash;
+}
+
+unsigned long int Decode_Scheduler::acquire(unsigned long int estimate){
+	std::unique_lock<std::mutex> lock(_mutex);
+	if(_budget == 0) return 0;
+
+	// A decode bigger than the budget takes all of it and waits for everything else to finish
+	unsigned long int charge = std::min(estimate, _budget);
+	bool exclusive = charge == _budget;
+	if(exclusive) _exclusive_waiting++;
+	_condition.wait(lock, [&](){ return _used + charge <= _budget && (exclusive || _exclusive_waiting == 0); });
+	if(exclusive) _exclusive_waiting--;
+	_used += charge;
+
+	return charge;
+}
+
+void Decode_Scheduler::release(unsigned long int charged){
+	if(charged == 0) return;
+	{
+		std::unique_lock<std::mutex> lock(_mutex);
+		_used -= charged;
+	}
+	_condition.notify_all();
+}
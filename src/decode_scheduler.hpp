@@ -0,0 +1,70 @@
+#ifndef __PCOLL_DECODE_SCHEDULER__
+#define __PCOLL_DECODE_SCHEDULER__
+
+#include <string>
+#include <mutex>
+#include <condition_variable>
+
+#include "diffhash.hpp"
+#include "blocking_key.hpp"
+
+/** Keeps the memory taken by image decodes under a budget
+ *	The header of every image is read first to estimate how much memory decoding it takes, and the
+ *	decode waits until that much of the budget is free. An image that does not fit in the budget on
+ *	its own is read from its largest MIP level that fits, or alone with nothing else decoding.
+ *	Interlaced PNGs and progressive JPEGs are charged for the whole frame their readers buffer,
+ *	other buffering done inside the OpenImageIO readers is not part of the estimate.
+ */
+class Decode_Scheduler {
+public:
+	Decode_Scheduler();
+	Decode_Scheduler(const Decode_Scheduler& other) = delete;
+	Decode_Scheduler& operator=(const Decode_Scheduler& other) = delete;
+
+	/** Sets the budget and bounds the shared OpenImageIO cache to a share of it
+	 *	@param budget bytes that decodes may take at once, zero for no limit
+	 */
+	void set_memory_budget(unsigned long int budget);
+
+	/** Decodes an image within the budget and computes its difference hash
+	 *	@param path path of the image, also used to pick the image format
+	 *	@param data file contents, or nullptr to read the file at path
+	 *	@param size size of the file contents
+	 *	@param key receives the blocking key read from the header, or nullptr
+	 *	@param thumbnail receives the luminance thumbnail of the image, or nullptr
+	 *	@return the difference hash, nullptr if the contents in memory are not an image
+	 */
+	Difference_Hash* compute_hash(const std::string& path, const char* data, unsigned long int size, Blocking_Key* key, float* thumbnail);
+
+	/** Estimates the memory needed to decode an image
+	 *	@param spec header of the image
+	 *	@return bytes of pixels held at once while streaming the image
+	 */
+	static unsigned long int estimate_memory(const ImageSpec& spec);
+
+	/** Estimates the memory a reader holds beyond the streamed band
+	 *	@param format name of the image format
+	 *	@param spec header of the image
+	 *	@param path path of the image, read if there are no contents in memory
+	 *	@param data file contents, or nullptr
+	 *	@param size size of the file contents
+	 *	@return bytes of the whole frame if the reader cannot stream the image, else zero
+	 */
+	static unsigned long int estimate_reader_memory(const std::string& format, const ImageSpec& spec, const std::string& path, const char* data, unsigned long int size);
+
+private:
+	/** Waits until the decode fits in the budget and takes its share
+	 *	@param estimate bytes the decode needs
+	 *	@return bytes taken from the budget, give them back with release()
+	 */
+	unsigned long int acquire(unsigned long int estimate);
+	void release(unsigned long int charged);
+
+	unsigned long int _budget; // zero for no limit
+	unsigned long int _used;
+	unsigned int _exclusive_waiting; // decodes waiting to run alone, nothing new starts meanwhile
+	std::mutex _mutex;
+	std::condition_variable _condition;
+};
+
+#endif //__PCOLL_DECODE_SCHEDULER__
@@ -0,0 +1,365 @@
+#include "dedupe_engine.hpp"
+#include "task_queue.hpp"
+#include "utility.hpp"
+
+#include <algorithm>
+#include <sstream>
+#include <thread>
+#include <chrono>
+#include <memory>
+#include <unordered_map>
+#include <cstring>
+#include <cerrno>
+#include <cstdio>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <linux/fs.h>
+
+using std::string;
+using std::this_thread::sleep_for;
+using std::chrono::milliseconds;
+
+static const char* JOURNAL_HEADER = "pcoll-journal 1";
+
+/** Added to the name of a duplicate while its replacement is built */
+static const char* TEMPORARY_SUFFIX = ".pcoll-dedupe";
+
+/** Bytes copied at once when a replacement is rolled back */
+static const unsigned long int COPY_BUFFER_SIZE = 1024 * 1024;
+
+static const char* get_method_name(Dedupe_Method method){
+	return method == Dedupe_Method::REFLINK ? "reflink" : "hardlink";
+}
+
+static string get_error(const string& message){
+	return message + ": " + std::strerror(errno);
+}
+
+static long long int to_nanoseconds(const struct timespec& time){
+	return time.tv_sec * 1000000000LL + time.tv_nsec;
+}
+
+static struct timespec from_nanoseconds(long long int time){
+	struct timespec result;
+	result.tv_sec = time / 1000000000LL;
+	result.tv_nsec = time % 1000000000LL;
+	return result;
+}
+
+/** Gives a file the owner, permissions and times of the file it replaces
+ *	The owner goes first since changing it clears the set-user-ID and set-group-ID bits.
+ */
+static void copy_metadata(int fd, const string& path, uid_t uid, gid_t gid, mode_t mode, const struct timespec times[2]){
+	if(fchown(fd, uid, gid) != 0 || fchmod(fd, mode & 07777) != 0 || futimens(fd, times) != 0)
+		throw Pexception(get_error("Cannot copy metadata to '" + path + "'"));
+}
+
+/** @return true if the file is still the one that was compared */
+static bool unchanged(const string& path, const struct stat& info){
+	struct stat current;
+	return stat(path.c_str(), &current) == 0 && current.st_dev == info.st_dev && current.st_ino == info.st_ino &&
+		current.st_size == info.st_size && to_nanoseconds(current.st_mtim) == to_nanoseconds(info.st_mtim);
+}
+
+/** Copies the contents of a file into an open file, without sharing storage */
+static void copy_contents(const string& source_path, int destination, const string& destination_path){
+	int source = Utility::open_file(source_path);
+	if(source < 0) throw Pexception("Cannot open file '" + source_path + "'!");
+
+	std::unique_ptr<char[]> buffer(new char[COPY_BUFFER_SIZE]);
+	while(true){
+		ssize_t length = read(source, buffer.get(), COPY_BUFFER_SIZE);
+		if(length < 0 && errno == EINTR) continue;
+		if(length < 0){
+			string error = get_error("Failed to read '" + source_path + "'");
+			close(source);
+			throw Pexception(error);
+		}
+		if(length == 0) break;
+		for(ssize_t offset = 0; offset < length;){
+			ssize_t written = write(destination, buffer.get() + offset, length - offset);
+			if(written < 0 && errno == EINTR) continue;
+			if(written <= 0){
+				string error = get_error("Failed to write '" + destination_path + "'");
+				close(source);
+				throw Pexception(error);
+			}
+			offset += written;
+		}
+	}
+	close(source);
+}
+
+Dedupe_Engine::Dedupe_Engine(Dedupe_Method method, bool dry_run, const string& journal_path) :
+	_method(method),
+	_dry_run(dry_run),
+	_journal_path(journal_path),
+	_journal(),
+	_journal_mutex(),
+	_files(0),
+	_bytes(0),
+	_failures(0)
+{}
+
+bool Dedupe_Engine::parse_method(const string& name, Dedupe_Method& method){
+	if(name == "reflink") method = Dedupe_Method::REFLINK;
+	else if(name == "hardlink") method = Dedupe_Method::HARDLINK;
+	else return false;
+	return true;
+}
+
+Dedupe_Summary Dedupe_Engine::run(const std::list<std::vector<const string*>>& groups, bool quiet, unsigned int num_threads){
+
+	// Ensure that number of threads is not zero
+	if(num_threads == 0) num_threads = 1;
+
+	// Append to the journal, starting it if it is new
+	if(!_dry_run && !_journal_path.empty()){
+		struct stat info;
+		bool is_new = stat(_journal_path.c_str(), &info) != 0 || info.st_size == 0;
+		_journal.open(_journal_path, std::ios::app);
+		if(!_journal.is_open()) throw Pexception("Cannot open journal '" + _journal_path + "' for writing!");
+		if(is_new) _journal << JOURNAL_HEADER << "\n" << std::flush;
+	}
+
+	// Every group is a task
+	std::vector<const std::vector<const string*>*> tasks;
+	for(auto& group : groups) tasks.push_back(&group);
+	Task_Queue<std::size_t> group_queue;
+	for(std::size_t i = 0; i < tasks.size(); i++) group_queue.insert(i);
+
+	// Build the thread function
+	auto dedupe_function = [&](){
+
+		// Finish all tasks
+		while(group_queue.task_count() != 0){
+			try{
+				dedupe_group(*tasks[group_queue.poll()], quiet);
+
+				// Decrement task count
+				group_queue.decrement_task_count();
+
+			}catch(Pexception &e){
+				sleep_for(milliseconds(10)); // Relax for a bit
+			}
+		}
+	};
+
+	// Create threads
+	std::list<std::unique_ptr<std::thread>> threads;
+	for(unsigned int i = 0; i < num_threads-1; i++){
+		std::unique_ptr<std::thread> thread = std::make_unique<std::thread>(dedupe_function);
+		threads.push_back(std::move(thread));
+	}
+
+	// Run on main thread
+	dedupe_function();
+
+	// Join all threads if theres any
+	for(auto& thread : threads)
+		thread->join();
+
+	if(_journal.is_open()) _journal.close();
+
+	Dedupe_Summary summary;
+	summary.files = _files;
+	summary.bytes = _bytes;
+	summary.failures = _failures;
+	return summary;
+}
+
+void Dedupe_Engine::dedupe_group(std::vector<const string*> group, bool quiet){
+
+	// Keep the same file on every run
+	std::sort(group.begin(), group.end(), [](const string* one, const string* two) -> bool { return *one < *two; });
+
+	// Only regular files can be replaced, members of archives are not
+	std::vector<std::pair<const string*, struct stat>> files;
+	for(auto& path : group){
+		struct stat info;
+		if(lstat(path->c_str(), &info) == 0 && S_ISREG(info.st_mode)) files.push_back(std::make_pair(path, info));
+	}
+	if(files.size() < 2) return;
+
+	// Files only share storage within a device, the first file on every device is kept
+	std::unordered_map<dev_t, const std::pair<const string*, struct stat>*> keepers;
+	for(auto file = files.begin(); file != files.end(); file++){
+		auto kept = keepers.emplace(file->second.st_dev, &*file);
+		if(kept.second) continue;
+		const string& keeper = *kept.first->second->first;
+		const struct stat& keeper_info = kept.first->second->second;
+		const string& target = *file->first;
+		const struct stat& target_info = file->second;
+
+		// Already the same file, or nothing to reclaim
+		if(target_info.st_dev == keeper_info.st_dev && target_info.st_ino == keeper_info.st_ino) continue;
+		if(target_info.st_size == 0) continue;
+
+		try{
+			if(!Utility::files_identical(keeper, target))
+				throw Pexception("'" + target + "' differs from '" + keeper + "', left alone");
+
+			// A hardlink shares the owner and permissions of the kept file, so they have to match already
+			if(_method == Dedupe_Method::HARDLINK && (target_info.st_uid != keeper_info.st_uid || target_info.st_gid != keeper_info.st_gid || target_info.st_mode != keeper_info.st_mode))
+				throw Pexception("'" + target + "' has another owner or permissions than '" + keeper + "', not hardlinked");
+
+			if(_dry_run){
+				if(!quiet) Utility::sout.println(string("Would ") + get_method_name(_method) + " " + Utility::try_to_normalize_path(target) + " to " + Utility::try_to_normalize_path(keeper));
+			}else{
+				replace(keeper, keeper_info, target, target_info);
+				if(!quiet) Utility::sout.println(string(_method == Dedupe_Method::REFLINK ? "Reflinked " : "Hardlinked ") + Utility::try_to_normalize_path(target) + " to " + Utility::try_to_normalize_path(keeper));
+			}
+
+			// Another name of the duplicate still holds its storage
+			_files++;
+			if(target_info.st_nlink == 1) _bytes += target_info.st_size;
+
+		}catch(Pexception& pe){
+			Utility::sout.printerrln(pe.what());
+			_failures++;
+		}
+	}
+}
+
+void Dedupe_Engine::replace(const string& keeper, const struct stat& keeper_info, const string& target, const struct stat& target_info){
+	string temporary = target + TEMPORARY_SUFFIX;
+
+	// Build the replacement next to the duplicate
+	if(_method == Dedupe_Method::HARDLINK){
+		if(link(keeper.c_str(), temporary.c_str()) != 0)
+			throw Pexception(get_error("Cannot hardlink '" + target + "' to '" + keeper + "'"));
+	}else{
+#ifdef FICLONE
+		int source = Utility::open_file(keeper);
+		if(source < 0) throw Pexception("Cannot open file '" + keeper + "'!");
+		int destination = open(temporary.c_str(), O_WRONLY | O_CREAT | O_EXCL | O_CLOEXEC, 0600);
+		if(destination < 0){
+			string error = get_error("Cannot create '" + temporary + "'");
+			close(source);
+			throw Pexception(error);
+		}
+
+		string error;
+		struct timespec times[2] = {target_info.st_atim, target_info.st_mtim};
+		if(ioctl(destination, FICLONE, source) != 0) error = get_error("Cannot reflink '" + target + "' to '" + keeper + "'");
+		else{
+			try{ copy_metadata(destination, temporary, target_info.st_uid, target_info.st_gid, target_info.st_mode, times);
+			}catch(Pexception& pe){ error = pe.what(); }
+		}
+		close(source);
+		close(destination);
+		if(!error.empty()){
+			unlink(temporary.c_str());
+			throw Pexception(error);
+		}
+#else
+		throw Pexception("Cannot reflink '" + target + "': reflinks are not supported on this system");
+#endif
+	}
+
+	// Only replace the duplicate if neither file changed since they were compared
+	if(!unchanged(keeper, keeper_info) || !unchanged(target, target_info)){
+		unlink(temporary.c_str());
+		throw Pexception("'" + target + "' or '" + keeper + "' changed while deduplicating, left alone");
+	}
+
+	// Record it before making it, so an interrupted run can still be rolled back
+	try{ write_journal(keeper, target, target_info);
+	}catch(...){
+		unlink(temporary.c_str());
+		throw;
+	}
+
+	if(rename(temporary.c_str(), target.c_str()) != 0){
+		string error = get_error("Cannot replace '" + target + "'");
+		unlink(temporary.c_str());
+		throw Pexception(error);
+	}
+}
+
+void Dedupe_Engine::write_journal(const string& keeper, const string& target, const struct stat& target_info){
+	if(!_journal.is_open()) return;
+
+	// Two lines per replacement: <method> <mode> <uid> <gid> <accessed> <modified> <path>, then the kept file
+	std::unique_lock<std::mutex> lock(_journal_mutex);
+	_journal << get_method_name(_method) << '\t' << std::oct << (target_info.st_mode & 07777) << std::dec << '\t' << target_info.st_uid << '\t' << target_info.st_gid << '\t'
+		<< to_nanoseconds(target_info.st_atim) << '\t' << to_nanoseconds(target_info.st_mtim) << '\t' << target << '\n' << keeper << '\n' << std::flush;
+	if(_journal.fail()) throw Pexception("Failed to write journal '" + _journal_path + "'!");
+}
+
+unsigned int Dedupe_Engine::rollback(const string& journal_path, bool quiet){
+	std::ifstream input(journal_path);
+	if(!input.is_open()) throw Pexception("Cannot open journal '" + journal_path + "'!");
+
+	// Check the header
+	string line;
+	if(!std::getline(input, line) || line != JOURNAL_HEADER) throw Pexception("'" + journal_path + "' is not a pcoll journal!");
+
+	struct Entry {
+		Entry() : method(Dedupe_Method::REFLINK), mode(0), uid(0), gid(0), times(), target(), keeper() {}
+		Dedupe_Method method;
+		mode_t mode;
+		uid_t uid;
+		gid_t gid;
+		struct timespec times[2];
+		string target;
+		string keeper;
+	};
+
+	// Read every replacement, a torn last entry was never made
+	std::vector<Entry> entries;
+	string keeper;
+	while(std::getline(input, line) && std::getline(input, keeper)){
+		std::istringstream fields(line);
+		Entry entry;
+		string method;
+		long long int accessed, modified;
+		if(!std::getline(fields, method, '\t') || !parse_method(method, entry.method) || !(fields >> std::oct >> entry.mode >> std::dec >> entry.uid >> entry.gid >> accessed >> modified) || fields.get() != '\t' || !std::getline(fields, entry.target))
+			throw Pexception("Damaged journal '" + journal_path + "'!");
+		entry.times[0] = from_nanoseconds(accessed);
+		entry.times[1] = from_nanoseconds(modified);
+		entry.keeper = keeper;
+		entries.push_back(entry);
+	}
+
+	// Undo the last replacement first, in case a file was replaced more than once
+	unsigned int count = 0;
+	for(auto entry = entries.rbegin(); entry != entries.rend(); entry++){
+		try{
+			// A hardlink that is no longer one was never made or already rolled back
+			struct stat target_info, keeper_info;
+			if(stat(entry->target.c_str(), &target_info) != 0) throw Pexception(get_error("Cannot restore '" + entry->target + "'"));
+			if(stat(entry->keeper.c_str(), &keeper_info) != 0) throw Pexception(get_error("Cannot restore '" + entry->target + "' from '" + entry->keeper + "'"));
+			if(entry->method == Dedupe_Method::HARDLINK && (target_info.st_dev != keeper_info.st_dev || target_info.st_ino != keeper_info.st_ino)) continue;
+			if(entry->method == Dedupe_Method::REFLINK && !Utility::files_identical(entry->keeper, entry->target))
+				throw Pexception("'" + entry->target + "' changed since it was reflinked, left alone");
+
+			// Copy the contents into a file of its own with the metadata it had
+			string temporary = entry->target + TEMPORARY_SUFFIX;
+			int destination = open(temporary.c_str(), O_WRONLY | O_CREAT | O_EXCL | O_CLOEXEC, 0600);
+			if(destination < 0) throw Pexception(get_error("Cannot create '" + temporary + "'"));
+			try{
+				copy_contents(entry->keeper, destination, temporary);
+				copy_metadata(destination, temporary, entry->uid, entry->gid, entry->mode, entry->times);
+			}catch(...){
+				close(destination);
+				unlink(temporary.c_str());
+				throw;
+			}
+			close(destination);
+			if(rename(temporary.c_str(), entry->target.c_str()) != 0){
+				string error = get_error("Cannot restore '" + entry->target + "'");
+				unlink(temporary.c_str());
+				throw Pexception(error);
+			}
+
+			if(!quiet) Utility::sout.println("Restored " + Utility::try_to_normalize_path(entry->target));
+			count++;
+		}catch(Pexception& pe){
+			Utility::sout.printerrln(pe.what());
+		}
+	}
+
+	return count;
+}
@@ -0,0 +1,75 @@
+#ifndef __PCOLL_DEDUPE_ENGINE__
+#define __PCOLL_DEDUPE_ENGINE__
+
+#include <string>
+#include <vector>
+#include <list>
+#include <mutex>
+#include <fstream>
+#include <atomic>
+
+#include <sys/stat.h>
+
+/** How a duplicate is made to share the storage of the file it duplicates */
+enum class Dedupe_Method {
+	REFLINK, // clone the extents of the kept file, on file systems such as btrfs and XFS
+	HARDLINK // replace the duplicate with another name of the kept file
+};
+
+/** Outcome of a dedupe run */
+struct Dedupe_Summary {
+	Dedupe_Summary() : files(0), bytes(0), failures(0) {}
+	unsigned int files; // duplicates replaced, or that would be in a dry run
+	unsigned long int bytes; // bytes reclaimed
+	unsigned int failures; // duplicates that were left alone after an error
+};
+
+/** Replaces exact duplicates with reflinks or hardlinks of one file of their group
+ *	Every duplicate is compared byte for byte with the kept file first. The replacement is built next
+ *	to the duplicate and renamed over it, so a failure leaves the duplicate as it was. Every
+ *	replacement is written to a journal before it is made so it can be rolled back.
+ */
+class Dedupe_Engine {
+public:
+	/** @param method how duplicates are replaced
+	 *	@param dry_run if true, only report what would be replaced
+	 *	@param journal_path where replacements are recorded, empty for none
+	 */
+	Dedupe_Engine(Dedupe_Method method, bool dry_run, const std::string& journal_path);
+	Dedupe_Engine(const Dedupe_Engine& other) = delete;
+	Dedupe_Engine& operator=(const Dedupe_Engine& other) = delete;
+
+	/** Replaces the duplicates of every group
+	 *	@param groups paths of files with the same checksum, the first path in name order is kept
+	 *	@param quiet no output except errors
+	 *	@param num_threads number of threads comparing and replacing groups
+	 *	@return what was replaced
+	 */
+	Dedupe_Summary run(const std::list<std::vector<const std::string*>>& groups, bool quiet, unsigned int num_threads);
+
+	/** Turns the replacements of a journal back into files of their own, last first
+	 *	@param journal_path path of the journal
+	 *	@param quiet no output except errors
+	 *	@return number of files restored
+	 */
+	static unsigned int rollback(const std::string& journal_path, bool quiet);
+
+	/** @return true if the name is a dedupe method, which is stored in method */
+	static bool parse_method(const std::string& name, Dedupe_Method& method);
+
+private:
+	void dedupe_group(std::vector<const std::string*> group, bool quiet);
+	void replace(const std::string& keeper, const struct stat& keeper_info, const std::string& target, const struct stat& target_info);
+	void write_journal(const std::string& keeper, const std::string& target, const struct stat& target_info);
+
+	Dedupe_Method _method;
+	bool _dry_run;
+	std::string _journal_path;
+	std::ofstream _journal;
+	std::mutex _journal_mutex;
+	std::atomic<unsigned int> _files;
+	std::atomic<unsigned long int> _bytes;
+	std::atomic<unsigned int> _failures;
+};
+
+#endif //__PCOLL_DEDUPE_ENGINE__
@@ -0,0 +1,152 @@
+#include "device_queues.hpp"
+#include "utility.hpp"
+
+#include <fstream>
+#include <algorithm>
+#include <sys/stat.h>
+#include <sys/vfs.h>
+#include <sys/sysmacros.h>
+
+using std::string;
+
+/** Spinning disks seek between every file read at once */
+static const Device_Policy ROTATIONAL_POLICY = {4, 8};
+
+/** Network mounts hide their latency behind many requests */
+static const Device_Policy NETWORK_POLICY = {16, 4};
+
+/** Solid state disks take whatever they are given */
+static const Device_Policy SOLID_STATE_POLICY = {0, 0};
+
+/** File system magic numbers of network mounts */
+static const long int NETWORK_FILE_SYSTEMS[] = {
+	0x6969, // NFS
+	0x517B, // SMB
+	(long int)0xFF534D42, // CIFS
+	(long int)0xFE534D42, // SMB2
+	0x65735546, // FUSE, such as sshfs
+	0x00C36400, // Ceph
+	0x47504653 // GPFS
+};
+
+Device_Queues::Device_Queues() :
+	_rotational(false),
+	_devices(),
+	_order(),
+	_next(0),
+	_taken(),
+	_task_count(0),
+	_mutex()
+{}
+
+void Device_Queues::set_rotational(bool rotational){
+	std::unique_lock<std::mutex> lock(_mutex);
+	_rotational = rotational;
+	for(auto& device : _devices) device.second.policy = ROTATIONAL_POLICY;
+}
+
+Device_Policy Device_Queues::get_policy(const string& path, dev_t device, bool rotational){
+	if(rotational) return ROTATIONAL_POLICY;
+
+	// Network mounts are told apart by their file system
+	struct statfs info;
+	if(statfs(path.c_str(), &info) == 0){
+		for(auto& type : NETWORK_FILE_SYSTEMS){
+			if((long int)info.f_type == type) return NETWORK_POLICY;
+		}
+	}
+
+	// A partition has no queue of its own, its disk has
+	string block = "/sys/dev/block/" + std::to_string(major(device)) + ":" + std::to_string(minor(device));
+	for(auto& queue : {block + "/queue/rotational", block + "/../queue/rotational"}){
+		std::ifstream input(queue);
+		int value = 0;
+		if(input >> value) return value != 0 ? ROTATIONAL_POLICY : SOLID_STATE_POLICY;
+	}
+	return SOLID_STATE_POLICY;
+}
+
+Device_Queues::Device& Device_Queues::get_device(const string& path, dev_t device){
+	auto search = _devices.find(device);
+	if(search != _devices.end()) return search->second;
+
+	// Seen for the first time, serve it after the others
+	Device& created = _devices[device];
+	created.policy = get_policy(path, device, _rotational);
+	_order.push_back(device);
+	return created;
+}
+
+void Device_Queues::insert(const string& path, dev_t device){
+	std::unique_lock<std::mutex> lock(_mutex);
+	get_device(path, device).files.push_back(path);
+	_task_count++;
+}
+
+void Device_Queues::insert(const string& path){
+	struct stat info;
+	insert(path, stat(path.c_str(), &info) == 0 ? info.st_dev : 0);
+}
+
+string Device_Queues::poll(){
+	string path;
+	std::vector<string> prefetch;
+	{
+		std::unique_lock<std::mutex> lock(_mutex);
+
+		// Serve the devices in turn, skipping those with nothing queued or no room for another read
+		Device* device = nullptr;
+		dev_t id = 0;
+		for(std::size_t i = 0; i < _order.size() && device == nullptr; i++){
+			id = _order[(_next + i) % _order.size()];
+			Device& candidate = _devices.at(id);
+			if(!candidate.files.empty() && (candidate.policy.max_reads == 0 || candidate.reads < candidate.policy.max_reads)){
+				device = &candidate;
+				_next = (_next + i + 1) % _order.size();
+			}
+		}
+		if(device == nullptr) throw Pexception("No device can take another read!");
+
+		path = device->files.front();
+		device->files.pop_front();
+		device->reads++;
+		_taken[path] = id;
+
+		// Ask for the files that follow on the same device
+		if(device->prefetched > 0) device->prefetched--;
+		while(device->prefetched < std::min((std::size_t)device->policy.readahead, device->files.size()))
+			prefetch.push_back(device->files[device->prefetched++]);
+	}
+
+	for(auto& file : prefetch) Utility::prefetch_file(file);
+	return path;
+}
+
+void Device_Queues::finish(const string& path){
+	std::unique_lock<std::mutex> lock(_mutex);
+	auto search = _taken.find(path);
+	if(search != _taken.end()){
+		_devices.at(search->second).reads--;
+		_taken.erase(search);
+	}
+}
+
+void Device_Queues::decrement_task_count(){
+	std::unique_lock<std::mutex> lock(_mutex);
+	_task_count--;
+}
+
+unsigned int Device_Queues::task_count(){
+	std::unique_lock<std::mutex> lock(_mutex);
+	return _task_count;
+}
+
+void Device_Queues::reorder(const std::function<void(std::vector<string>&)>& function){
+	std::unique_lock<std::mutex> lock(_mutex);
+	for(auto& device : _devices){
+		std::vector<string> files(device.second.files.begin(), device.second.files.end());
+		function(files);
+		device.second.files.assign(files.begin(), files.end());
+		device.second.prefetched = 0;
+	}
+}
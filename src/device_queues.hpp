@@ -0,0 +1,88 @@
+#ifndef __PCOLL_DEVICE_QUEUES__
+#define __PCOLL_DEVICE_QUEUES__
+
+#include <string>
+#include <deque>
+#include <vector>
+#include <unordered_map>
+#include <functional>
+#include <mutex>
+#include <sys/types.h>
+
+/** How the files of one device are read */
+struct Device_Policy {
+	unsigned int max_reads; // files of the device read at once, zero for no limit
+	unsigned int readahead; // files after the one being read that the kernel is asked to prefetch
+};
+
+/** Queues the files to read by the device they are on
+ *	Files are handed out round robin over the devices that are below their limit of reads at once, so a
+ *	slow device only ever holds a few readers and the others keep going. The limit and readahead of a
+ *	device depend on whether it is a spinning disk, a solid state disk or a network mount.
+ */
+class Device_Queues {
+public:
+	Device_Queues();
+	Device_Queues(const Device_Queues& other) = delete;
+	Device_Queues& operator=(const Device_Queues& other) = delete;
+
+	/** @param rotational if true, every device is read like a spinning disk */
+	void set_rotational(bool rotational);
+
+	/** Queues a file
+	 *	@param path path of the file
+	 *	@param device device the file is on
+	 */
+	void insert(const std::string& path, dev_t device);
+
+	/** Queues a file, looking up the device it is on */
+	void insert(const std::string& path);
+
+	/** Takes the next file of the next device with room for another read, throws Pexception if there is none
+	 *	@return path of the file, must be given back with finish()
+	 */
+	std::string poll();
+
+	/** Records that a file taken with poll() was read, making room for another read of its device
+	 *	@param path path of the file
+	 */
+	void finish(const std::string& path);
+
+	/** Records that a file taken with poll() is done with */
+	void decrement_task_count();
+
+	/** @return files queued or not done with yet */
+	unsigned int task_count();
+
+	/** Lets a function reorder the queued files of every device, only while no file is taken
+	 *	@param function called with the files of each device in queue order
+	 */
+	void reorder(const std::function<void(std::vector<std::string>&)>& function);
+
+	/** @param path path of a file on the device, tells network mounts apart
+	 *	@param rotational if true, the device is read like a spinning disk
+	 *	@return how the files of a device are read
+	 */
+	static Device_Policy get_policy(const std::string& path, dev_t device, bool rotational);
+
+private:
+	struct Device {
+		Device() : files(), policy(), reads(0), prefetched(0) {}
+		std::deque<std::string> files;
+		Device_Policy policy;
+		unsigned int reads; // files taken and not finished
+		unsigned int prefetched; // files at the front that were prefetched already
+	};
+
+	Device& get_device(const std::string& path, dev_t device);
+
+	bool _rotational;
+	std::unordered_map<dev_t, Device> _devices;
+	std::vector<dev_t> _order; // devices in the order they are served
+	std::size_t _next; // position in the order of the next device served
+	std::unordered_map<std::string, dev_t> _taken; // <path, device> of the files being read
+	unsigned int _task_count;
+	std::mutex _mutex;
+};
+
+#endif //__PCOLL_DEVICE_QUEUES__
@@ -1,15 +1,78 @@
 #include "diffhash.hpp"
 #include "utility.hpp"
-#include <OpenImageIO/imagebufalgo.h>
+
+#include <vector>
+#include <algorithm>
+#include <memory>
+
+/** Scanlines read at once when streaming an untiled image */
+static const unsigned int STREAM_BAND_HEIGHT = 16;
+
+/** Gets the luminance of every pixel in a row */
+static void get_row_luminance(const float* pixel, unsigned long int width, int nchannels, std::vector<float>& row_luminance){
+	for(unsigned long int x = 0; x < width; x++, pixel += nchannels){
+		if(nchannels < 3) row_luminance[x] = pixel[0];
+		else row_luminance[x] = (0.2126 * pixel[0]) + (0.7152 * pixel[1]) + (0.0722 * pixel[2]); // https://en.wikipedia.org/wiki/Grayscale#Converting_color_to_grayscale
+	}
+}
+
+/** Sums the luminance of the pixels in every cell of a square grid, cells repeat pixels when the image is smaller than the grid */
+class Luminance_Grid {
+public:
+	Luminance_Grid(unsigned int size, unsigned long int width, unsigned long int height) :
+		_size(size), _column_begin(size), _column_end(size), _row_begin(size), _row_end(size), _sums(size * size, 0.0)
+	{
+		for(unsigned int i = 0; i < size; i++){
+			_column_begin[i] = i * width / size;
+			_column_end[i] = std::max(_column_begin[i] + 1, (i + 1) * width / size);
+			_row_begin[i] = i * height / size;
+			_row_end[i] = std::max(_row_begin[i] + 1, (i + 1) * height / size);
+		}
+	}
+
+	/** Adds a row of luminance values to every cell that covers it */
+	void add_row(unsigned long int y, const std::vector<float>& row_luminance){
+		for(unsigned int cell_y = 0; cell_y < _size; cell_y++){
+			if(y < _row_begin[cell_y] || y >= _row_end[cell_y]) continue;
+			for(unsigned int cell_x = 0; cell_x < _size; cell_x++){
+				double sum = 0;
+				for(unsigned long int x = _column_begin[cell_x]; x < _column_end[cell_x]; x++) sum += row_luminance[x];
+				_sums[cell_y * _size + cell_x] += sum;
+			}
+		}
+	}
+
+	/** Averages every cell, row by row */
+	void average(float* luminance) const{
+		for(unsigned int cell_y = 0; cell_y < _size; cell_y++){
+			for(unsigned int cell_x = 0; cell_x < _size; cell_x++){
+				unsigned long int count = (_column_end[cell_x] - _column_begin[cell_x]) * (_row_end[cell_y] - _row_begin[cell_y]);
+				luminance[cell_y * _size + cell_x] = _sums[cell_y * _size + cell_x] / count;
+			}
+		}
+	}
+
+private:
+	unsigned int _size;
+	std::vector<unsigned long int> _column_begin, _column_end, _row_begin, _row_end;
+	std::vector<double> _sums;
+};
 
 Difference_Hash::Difference_Hash(const string& path) : _hash(nullptr) {
-	ImageBuf* img = Utility::get_image_buffer(path);
-	_hash = compute_hash(*img);
-	delete img;
+	int memory_fd;
+	ImageInput* image = Utility::open_image(path, nullptr, 0, memory_fd);
+	try{ _hash = compute_hash(image, path, nullptr);
+	}catch(Pexception& pe){
+		Utility::close_image(image, memory_fd);
+		throw;
+	}
+	Utility::close_image(image, memory_fd);
 }
 
 Difference_Hash::Difference_Hash(const ImageBuf& image) : _hash(compute_hash(image)) {}
 
+Difference_Hash::Difference_Hash(ImageInput* image, const string& path, float* thumbnail) : _hash(compute_hash(image, path, thumbnail)) {}
+
 Difference_Hash::Difference_Hash(const bitset<64>& difference_hash) : _hash(new bitset<64>(difference_hash)) {}
 
 Difference_Hash::~Difference_Hash(){
@@ -49,27 +112,89 @@ float Difference_Hash::compare(const Difference_Hash& other) const{
 }
 
 bitset<64>* Difference_Hash::compute_hash(const ImageBuf& image){
+	const ImageSpec& spec = image.spec();
+	if(spec.width <= 0 || spec.height <= 0 || spec.nchannels <= 0) throw Pexception("Image has no pixels: " + image.name());
+
+	// Average the pixels into the 8x8 grid a row at a time, the same as a streamed image
+	unsigned long int width = spec.width, height = spec.height;
+	Luminance_Grid grid(8, width, height);
+	std::vector<float> pixels(width * spec.nchannels);
+	std::vector<float> row_luminance(width);
+	for(unsigned long int y = 0; y < height; y++){
+		ROI row(spec.x, spec.x + spec.width, spec.y + y, spec.y + y + 1, spec.z, spec.z + 1, 0, spec.nchannels);
+		if(!image.get_pixels(row, TypeDesc::FLOAT, pixels.data())) throw Pexception("Failed to read image: " + image.name());
+		get_row_luminance(pixels.data(), width, spec.nchannels, row_luminance);
+		grid.add_row(y, row_luminance);
+	}
+
+	float luminance[64];
+	grid.average(luminance);
+	return compute_hash(luminance);
+}
+
+unsigned int Difference_Hash::get_band_height(const ImageSpec& spec){
+	return spec.tile_width > 0 ? spec.tile_height : STREAM_BAND_HEIGHT;
+}
 
-	// step 1: shrink image to 8x8 so there are 64 pixels
-	ImageBuf resized;
-	ROI roi(0, 8, 0, 8, 0, 1, 0, image.nchannels()); // define 8x8 image
-	ImageBufAlgo::resample(resized, image, NULL, roi); // resize
+unsigned long int Difference_Hash::get_stream_buffer_size(const ImageSpec& spec){
+	return (unsigned long int)get_band_height(spec) * spec.width * spec.nchannels * sizeof(float);
+}
+
+bitset<64>* Difference_Hash::compute_hash(ImageInput* image, const string& path, float* thumbnail){
+	const ImageSpec& spec = image->spec();
+	if(spec.width <= 0 || spec.height <= 0 || spec.nchannels <= 0) throw Pexception("Image has no pixels: " + path);
+
+	// Source pixels averaged into every cell of the hash grid and of the thumbnail
+	unsigned long int width = spec.width, height = spec.height;
+	Luminance_Grid grid(8, width, height);
+	std::unique_ptr<Luminance_Grid> thumbnail_grid;
+	if(thumbnail != nullptr) thumbnail_grid = std::make_unique<Luminance_Grid>(THUMBNAIL_SIZE, width, height);
+
+	unsigned int band = get_band_height(spec);
+	std::vector<float> pixels((unsigned long int)band * width * spec.nchannels);
+	std::vector<float> row_luminance(width);
+
+	for(unsigned long int y = 0; y < height; y += band){
+		unsigned long int rows = std::min((unsigned long int)band, height - y);
+
+		// Read one band, tiles must be read a whole row of tiles at a time
+		bool result;
+		if(spec.tile_width > 0) result = image->read_tiles(spec.x, spec.x + spec.width, spec.y + y, spec.y + y + rows, spec.z, spec.z + 1, TypeDesc::FLOAT, pixels.data());
+		else result = image->read_scanlines(spec.y + y, spec.y + y + rows, spec.z, TypeDesc::FLOAT, pixels.data());
+		if(!result) throw Pexception("Failed to read image: " + path);
+
+		for(unsigned long int r = 0; r < rows; r++){
+
+			// Get luminance value of every pixel in the row
+			get_row_luminance(pixels.data() + r * width * spec.nchannels, width, spec.nchannels, row_luminance);
+
+			// Add it to every cell that covers the row
+			grid.add_row(y + r, row_luminance);
+			if(thumbnail_grid) thumbnail_grid->add_row(y + r, row_luminance);
+		}
+	}
+
+	// Average every cell
+	float luminance[64];
+	grid.average(luminance);
+	if(thumbnail_grid) thumbnail_grid->average(thumbnail);
+
+	return compute_hash(luminance);
+}
+
+bitset<64>* Difference_Hash::compute_hash(const float* luminance){
 
 	// step 3: compute difference
 	bitset<64>* hash = new bitset<64>();
 
 	// Select the last pixel in the image as previous pixel because we will start with first pixel in the image
-	float previous_pixel;
-	resized.getpixel(7, 7, 0, &previous_pixel);
+	float previous_pixel = luminance[63];
 
 	// Go over every pixel
-	for(ImageBuf::ConstIterator<float> it (resized); !it.done(); ++it){
-
-		// Get luminance value of that pixel
-		float pixel = (0.2126 * it[0]) + (0.7152 * it[1]) + (0.0722 * it[2]); // https://en.wikipedia.org/wiki/Grayscale#Converting_color_to_grayscale
+	for(unsigned int i = 0; i < 64; i++){
 
 		// set the value in the bit hash
-		hash->set(0, (previous_pixel < pixel ? false : true));
+		hash->set(0, (previous_pixel < luminance[i] ? false : true));
 
 		// Shift hash
 		*hash <<= 1;
@@ -81,12 +206,16 @@ bitset<64>* Difference_Hash::compute_hash(const ImageBuf& image){
 float Difference_Hash::compare(const Difference_Hash& hash_one, const Difference_Hash& hash_two){
 
 	// Get the hamming distance
-	unsigned int hamming_distance = bitset<64>(*(hash_one._hash) ^ *(hash_two._hash)).count();
+	unsigned int hamming_distance = distance(hash_one, hash_two);
 
 	// Determine the percentage based on hamming distance, longer distance will reduce the score
 	return 1.0 - (hamming_distance / 64.0f);
 }
 
+unsigned int Difference_Hash::distance(const Difference_Hash& hash_one, const Difference_Hash& hash_two){
+	return bitset<64>(*(hash_one._hash) ^ *(hash_two._hash)).count();
+}
+
 std::ostream& operator<<(std::ostream& os, const Difference_Hash &dh){
     return os << "Difference Hash: " << *(dh._hash);
 }
@@ -94,3 +223,7 @@ std::ostream& operator<<(std::ostream& os, const Difference_Hash &dh){
 std::size_t Difference_Hash::hash() const{
 	return std::hash<bitset<64>>()(*_hash);
 }
+
+const bitset<64>& Difference_Hash::get_bitset() const{
+	return *_hash;
+}
@@ -3,6 +3,7 @@
 
 #include <string>
 #include <bitset>
+#include <OpenImageIO/imageio.h>
 #include <OpenImageIO/imagebuf.h>
 
 using std::string;
@@ -14,6 +15,13 @@ class Difference_Hash {
 public:
 	Difference_Hash(const string& path);
 	Difference_Hash(const ImageBuf& image);
+
+	/** Computes the hash and a thumbnail in one pass over the current subimage of an open image
+	 *	@param image the open image
+	 *	@param path path of the image, used in error messages
+	 *	@param thumbnail receives THUMBNAIL_SIZE rows of THUMBNAIL_SIZE luminance values, or nullptr
+	 */
+	Difference_Hash(ImageInput* image, const string& path, float* thumbnail);
 	Difference_Hash(const bitset<64>& difference_hash);
 	~Difference_Hash();
 	Difference_Hash(const Difference_Hash& other);
@@ -24,13 +32,33 @@ public:
 	float compare(const Difference_Hash& other) const;
 	friend std::ostream& operator<<(std::ostream& os, const Difference_Hash &dh);
 	std::size_t hash() const;
+	const bitset<64>& get_bitset() const;
+
+	/** Cells on a side of the luminance thumbnail */
+	static constexpr unsigned int THUMBNAIL_SIZE = 32;
 
 	// Static data members
 	static float compare(const Difference_Hash& hash_one, const Difference_Hash& hash_two);
 
+	/** @return number of bits that differ between two hashes */
+	static unsigned int distance(const Difference_Hash& hash_one, const Difference_Hash& hash_two);
+
+	/** @return bytes of pixels held at once while streaming an image */
+	static unsigned long int get_stream_buffer_size(const ImageSpec& spec);
+
 private:
 	bitset<64>* _hash;
 	static bitset<64>* compute_hash(const ImageBuf& image);
+
+	/** Reads the image a band of scanlines or a row of tiles at a time and averages every pixel into
+	 *	its cell of the 8x8 grid, and of the thumbnail if there is one, so only one band is ever in memory
+	 */
+	static bitset<64>* compute_hash(ImageInput* image, const string& path, float* thumbnail);
+
+	/** Builds the hash from the luminance of the 8x8 grid, row by row */
+	static bitset<64>* compute_hash(const float* luminance);
+
+	static unsigned int get_band_height(const ImageSpec& spec);
 };
 
 #endif //__PCOLL_DIFFHASH__
@@ -0,0 +1,43 @@
+#include "disk_order.hpp"
+#include "utility.hpp"
+
+#include <algorithm>
+#include <thread>
+#include <memory>
+#include <list>
+#include <utility>
+#include <vector>
+#include <atomic>
+
+using std::string;
+
+void Disk_Order::sort(Device_Queues& file_queue, unsigned int num_threads){
+
+	// Ensure that number of threads is not zero
+	if(num_threads == 0) num_threads = 1;
+
+	file_queue.reorder([&](std::vector<string>& paths){
+
+		// Look up the positions, FIEMAP can block on metadata reads so spread it over the threads
+		std::vector<std::pair<Disk_Position, string>> files;
+		files.reserve(paths.size());
+		for(auto& path : paths) files.push_back(std::make_pair(Disk_Position(), path));
+		std::atomic<std::size_t> next(0);
+		auto lookup_function = [&](){
+			for(std::size_t i = next++; i < files.size(); i = next++)
+				files[i].first = Utility::get_disk_position(files[i].second);
+		};
+		std::list<std::unique_ptr<std::thread>> threads;
+		for(unsigned int i = 0; i < num_threads-1; i++)
+			threads.push_back(std::make_unique<std::thread>(lookup_function));
+		lookup_function();
+		for(auto& thread : threads)
+			thread->join();
+
+		// Sort and put them back in order
+		std::sort(files.begin(), files.end(), [](const std::pair<Disk_Position, string>& one, const std::pair<Disk_Position, string>& two) -> bool {
+			return one.first < two.first;
+		});
+		for(std::size_t i = 0; i < files.size(); i++) paths[i] = std::move(files[i].second);
+	});
+}
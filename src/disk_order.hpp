@@ -0,0 +1,19 @@
+#ifndef __PCOLL_DISK_ORDER__
+#define __PCOLL_DISK_ORDER__
+
+#include "device_queues.hpp"
+
+/** Orders files by their position on disk
+ *	Meant for spinning disks, where reading in walk order makes the heads seek constantly.
+ *	Positions only compare within a device, so the files of every device are ordered on their own.
+ */
+class Disk_Order {
+public:
+	/** Puts the queued files of every device back sorted by their position on disk
+	 *	@param file_queue queue holding every file that will be read
+	 *	@param num_threads number of threads looking up positions
+	 */
+	static void sort(Device_Queues& file_queue, unsigned int num_threads);
+};
+
+#endif //__PCOLL_DISK_ORDER__
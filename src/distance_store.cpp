@@ -0,0 +1,193 @@
+#include "distance_store.hpp"
+#include "filechecksum.hpp"
+#include "utility.hpp"
+
+#include <fstream>
+#include <sstream>
+#include <algorithm>
+#include <cstdio>
+#include <atomic>
+#include <thread>
+#include <list>
+#include <memory>
+
+using std::string;
+
+static const char* STORE_HEADER = "pcoll-distances 1";
+
+/** Groups a thread takes at once while sorting neighbors */
+static const uint32_t SORT_CHUNK = 1024;
+
+Distance_Graph::Distance_Graph() : _offsets(1, 0), _ends(), _neighbors() {}
+
+void Distance_Graph::build(std::vector<std::vector<Distance_Edge>>& buffers, uint32_t group_count, bool both_ways, unsigned int max_neighbors, unsigned int num_threads){
+
+	// Count the neighbors of every group to find where each group starts
+	_offsets.assign(group_count + 1, 0);
+	for(auto& buffer : buffers){
+		for(auto& edge : buffer){
+			_offsets[edge.one + 1]++;
+			if(both_ways) _offsets[edge.two + 1]++;
+		}
+	}
+	for(uint32_t group = 0; group < group_count; group++) _offsets[group + 1] += _offsets[group];
+
+	// Scatter the edges into place, freeing every buffer once it is copied
+	_neighbors.resize(_offsets.back());
+	_ends.assign(_offsets.begin(), _offsets.end() - 1);
+	for(auto& buffer : buffers){
+		for(auto& edge : buffer){
+			_neighbors[_ends[edge.one]++] = Distance_Neighbor{edge.two, edge.distance};
+			if(both_ways) _neighbors[_ends[edge.two]++] = Distance_Neighbor{edge.one, edge.distance};
+		}
+		buffer = std::vector<Distance_Edge>();
+	}
+
+	// Sort the neighbors of every group, threads take chunks of groups
+	std::atomic<uint32_t> next_group(0);
+	auto sort_function = [&](){
+		uint32_t first;
+		while((first = next_group.fetch_add(SORT_CHUNK)) < group_count){
+			uint32_t last = std::min(group_count, first + SORT_CHUNK);
+			for(uint32_t group = first; group < last; group++){
+				Distance_Neighbor* begin = _neighbors.data() + _offsets[group];
+				Distance_Neighbor* end = _neighbors.data() + _ends[group];
+				std::sort(begin, end, [](const Distance_Neighbor& one, const Distance_Neighbor& two) -> bool {
+					return one.distance != two.distance ? one.distance < two.distance : one.group < two.group;
+				});
+
+				// The same group always has the same distance, so repeats are next to each other
+				end = std::unique(begin, end, [](const Distance_Neighbor& one, const Distance_Neighbor& two) -> bool {
+					return one.group == two.group;
+				});
+				if(max_neighbors != 0 && (std::size_t)(end - begin) > max_neighbors) end = begin + max_neighbors;
+				_ends[group] = end - _neighbors.data();
+			}
+		}
+	};
+
+	// Create threads
+	std::list<std::unique_ptr<std::thread>> threads;
+	for(unsigned int i = 1; i < num_threads; i++)
+		threads.push_back(std::make_unique<std::thread>(sort_function));
+
+	// Run on main thread
+	sort_function();
+
+	// Join all threads if theres any
+	for(auto& thread : threads)
+		thread->join();
+}
+
+const Distance_Neighbor* Distance_Graph::begin(uint32_t group) const{
+	return _neighbors.data() + _offsets[group];
+}
+
+const Distance_Neighbor* Distance_Graph::end(uint32_t group) const{
+	return _neighbors.data() + _ends[group];
+}
+
+Distance_Store::Distance_Store() : _groups(), _edges(), _edges_mutex(), _max_distance(0) {}
+
+uint32_t Distance_Store::add_group(const string& checksum){
+	_groups.push_back(checksum);
+	return _groups.size() - 1;
+}
+
+void Distance_Store::add_edges(const std::vector<Distance_Edge>& edges){
+	std::unique_lock<std::mutex> lock(_edges_mutex);
+	_edges.insert(_edges.end(), edges.begin(), edges.end());
+}
+
+void Distance_Store::sort(){
+	std::sort(_edges.begin(), _edges.end(), [](const Distance_Edge& one, const Distance_Edge& two) -> bool {
+		return one.distance < two.distance;
+	});
+}
+
+void Distance_Store::save(const string& path) const{
+
+	// Write to a temporary file first so an existing store survives a failed write
+	string temporary_path = path + ".tmp";
+	std::ofstream output(temporary_path, std::ios::trunc | std::ios::binary);
+	if(!output) throw Pexception("Cannot write distance store '" + path + "'!");
+
+	// Header, then one checksum per line, then the packed edges
+	output << STORE_HEADER << " " << File_Checksum::get_algorithm_name() << " " << _max_distance << " " << _groups.size() << " " << _edges.size() << "\n";
+	for(auto& group : _groups) output << group << "\n";
+	for(auto& edge : _edges){
+		output.write(reinterpret_cast<const char*>(&edge.one), sizeof(edge.one));
+		output.write(reinterpret_cast<const char*>(&edge.two), sizeof(edge.two));
+		output.write(reinterpret_cast<const char*>(&edge.distance), sizeof(edge.distance));
+	}
+
+	output.close();
+	if(!output || std::rename(temporary_path.c_str(), path.c_str()) != 0){
+		std::remove(temporary_path.c_str());
+		throw Pexception("Failed to write distance store '" + path + "'!");
+	}
+}
+
+void Distance_Store::load(const string& path){
+	std::ifstream input(path, std::ios::binary);
+	if(!input) throw Pexception("Cannot open distance store '" + path + "'!");
+
+	// Check the header
+	string line;
+	string header = STORE_HEADER;
+	if(!std::getline(input, line) || line.compare(0, header.size() + 1, header + " ") != 0) throw Pexception("'" + path + "' is not a pcoll distance store!");
+	std::istringstream fields(line.substr(header.size() + 1));
+	string algorithm;
+	std::size_t group_count, edge_count;
+	if(!(fields >> algorithm >> _max_distance >> group_count >> edge_count)) throw Pexception("'" + path + "' is not a pcoll distance store!");
+	if(algorithm != File_Checksum::get_algorithm_name())
+		throw Pexception("'" + path + "' uses " + algorithm + " checksums, select that digest to use it!");
+
+	// Groups
+	_groups.clear();
+	_groups.reserve(group_count);
+	for(std::size_t i = 0; i < group_count; i++){
+		if(!std::getline(input, line)) throw Pexception("Distance store '" + path + "' is truncated!");
+		_groups.push_back(line);
+	}
+
+	// Edges
+	_edges.clear();
+	_edges.resize(edge_count);
+	for(auto& edge : _edges){
+		input.read(reinterpret_cast<char*>(&edge.one), sizeof(edge.one));
+		input.read(reinterpret_cast<char*>(&edge.two), sizeof(edge.two));
+		input.read(reinterpret_cast<char*>(&edge.distance), sizeof(edge.distance));
+		if(!input || edge.one >= group_count || edge.two >= group_count) throw Pexception("Distance store '" + path + "' is truncated!");
+	}
+}
+
+const std::vector<string>& Distance_Store::get_groups() const{
+	return _groups;
+}
+
+unsigned int Distance_Store::get_max_distance() const{
+	return _max_distance;
+}
+
+void Distance_Store::set_max_distance(unsigned int max_distance){
+	_max_distance = max_distance;
+}
+
+void Distance_Store::for_each_edge(unsigned int max_distance, const std::function<void(const Distance_Edge&)>& function) const{
+	for(auto& edge : _edges){
+		if(edge.distance > max_distance) break;
+		function(edge);
+	}
+}
+
+unsigned int Distance_Store::get_max_distance(float percentage){
+	unsigned int distance = 0;
+	while(distance < 64 && get_similarity(distance + 1) >= percentage) distance++;
+	return distance;
+}
+
+float Distance_Store::get_similarity(unsigned int distance){
+	// Same as Difference_Hash::compare
+	return 1.0 - (distance / 64.0f);
+}
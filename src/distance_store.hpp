@@ -0,0 +1,114 @@
+#ifndef __PCOLL_DISTANCE_STORE__
+#define __PCOLL_DISTANCE_STORE__
+
+#include <string>
+#include <vector>
+#include <mutex>
+#include <cstdint>
+#include <functional>
+
+/** A pair of checksum groups whose difference hashes are close */
+struct Distance_Edge {
+	uint32_t one; // number of the first group
+	uint32_t two; // number of the second group
+	uint8_t distance; // Hamming distance between the difference hashes
+};
+
+/** A group next to another one in a Distance_Graph */
+struct Distance_Neighbor {
+	uint32_t group; // number of the neighboring group
+	uint8_t distance; // Hamming distance to it
+};
+
+/** Neighbors of every group, laid out one group after another
+ *	Built once from the edges every comparison thread collected on its own, so comparing takes no lock.
+ */
+class Distance_Graph {
+public:
+	Distance_Graph();
+
+	/** Replaces the neighbors with edges
+	 *	The neighbors of every group are sorted closest first and a group repeated by several edges is
+	 *	kept once.
+	 *	@param buffers edges collected by every thread, emptied to save memory
+	 *	@param group_count number of groups
+	 *	@param both_ways if true, an edge makes each of its groups a neighbor of the other, otherwise only the second of the first
+	 *	@param max_neighbors most neighbors kept per group, zero for every neighbor
+	 *	@param num_threads number of threads sorting the neighbors
+	 */
+	void build(std::vector<std::vector<Distance_Edge>>& buffers, uint32_t group_count, bool both_ways, unsigned int max_neighbors, unsigned int num_threads);
+
+	/** @return first neighbor of a group */
+	const Distance_Neighbor* begin(uint32_t group) const;
+
+	/** @return one past the last neighbor of a group */
+	const Distance_Neighbor* end(uint32_t group) const;
+
+private:
+	std::vector<std::size_t> _offsets; // first neighbor of every group
+	std::vector<std::size_t> _ends; // one past the last neighbor of every group
+	std::vector<Distance_Neighbor> _neighbors;
+};
+
+/** Distances of every pair of groups compared at a threshold
+ *	Kept sorted by distance, so the pairs within any stricter threshold are read in one pass instead
+ *	of comparing again. Groups are named by their checksum so the store can be reused with an index.
+ */
+class Distance_Store {
+public:
+	Distance_Store();
+	Distance_Store(const Distance_Store& other) = delete;
+	Distance_Store& operator=(const Distance_Store& other) = delete;
+
+	/** Adds a group
+	 *	@param checksum checksum of the group
+	 *	@return number of the group in edges
+	 */
+	uint32_t add_group(const std::string& checksum);
+
+	/** Adds edges, can be called from several threads
+	 *	@param edges the edges
+	 */
+	void add_edges(const std::vector<Distance_Edge>& edges);
+
+	/** Sorts the edges by distance, closest first */
+	void sort();
+
+	/** Writes the store to a file
+	 *	@param path path of the file
+	 */
+	void save(const std::string& path) const;
+
+	/** Replaces the store with the contents of a file
+	 *	Throws Pexception if the file is not a store or uses another checksum digest.
+	 *	@param path path of the file
+	 */
+	void load(const std::string& path);
+
+	/** @return checksum of every group, by group number */
+	const std::vector<std::string>& get_groups() const;
+
+	/** @return largest distance the store holds every pair for */
+	unsigned int get_max_distance() const;
+	void set_max_distance(unsigned int max_distance);
+
+	/** Calls a function with every edge up to a distance, closest first
+	 *	@param max_distance largest distance
+	 *	@param function called with every edge
+	 */
+	void for_each_edge(unsigned int max_distance, const std::function<void(const Distance_Edge&)>& function) const;
+
+	/** @return largest Hamming distance that still meets a similarity percentage */
+	static unsigned int get_max_distance(float percentage);
+
+	/** @return similarity percentage of a Hamming distance */
+	static float get_similarity(unsigned int distance);
+
+private:
+	std::vector<std::string> _groups;
+	std::vector<Distance_Edge> _edges;
+	std::mutex _edges_mutex;
+	unsigned int _max_distance;
+};
+
+#endif //__PCOLL_DISTANCE_STORE__
@@ -0,0 +1,309 @@
+#include "file_filter.hpp"
+#include "utility.hpp"
+#include "archive_reader.hpp"
+
+#include <algorithm>
+#include <cctype>
+#include <cstring>
+#include <unordered_set>
+#include <unistd.h>
+
+using std::string;
+
+/** Extensions of the image formats the image reader knows */
+static const std::unordered_set<string> IMAGE_EXTENSIONS = {
+	"jpg", "jpeg", "jpe", "jfif", "png", "gif", "bmp", "dib", "tif", "tiff", "tx", "webp", "heic", "heif", "avif", "exr", "hdr",
+	"rgbe", "psd", "pdd", "ppm", "pgm", "pbm", "pnm", "pfm", "tga", "tpic", "dpx", "cin", "jp2", "j2k", "j2c", "ico", "dds",
+	"sgi", "rgb", "rgba", "bw", "int", "inta", "iff", "z", "pic", "fits", "rla", "sm", "dng", "cr2", "cr3", "crw", "nef",
+	"nrw", "arw", "srf", "sr2", "orf", "rw2", "raf", "pef", "srw", "x3f", "erf", "kdc", "mrw", "3fr", "mef", "mos", "raw"
+};
+
+/** Extensions of common formats that are never images */
+static const std::unordered_set<string> OTHER_EXTENSIONS = {
+	"mp4", "m4v", "mov", "avi", "mkv", "webm", "wmv", "flv", "mpg", "mpeg", "mts", "m2ts", "3gp", "mp3", "wav", "flac", "aac",
+	"ogg", "oga", "m4a", "wma", "xmp", "aae", "thm", "txt", "json", "xml", "html", "htm", "css", "js", "pdf", "doc", "docx",
+	"xls", "xlsx", "ppt", "pptx", "odt", "rtf", "md", "csv", "log", "ini", "cfg", "db", "sqlite", "zip", "gz", "tgz", "bz2",
+	"xz", "tar", "7z", "rar", "iso", "dmg", "exe", "dll", "so", "o", "a", "py", "c", "cpp", "h", "hpp", "sh", "lrprev"
+};
+
+/** File names of operating system clutter */
+static const std::unordered_set<string> OTHER_NAMES = {".ds_store", "thumbs.db", "desktop.ini", ".picasa.ini", ".nomedia"};
+
+/** Brands of ISO media files that hold still images */
+static const std::unordered_set<string> IMAGE_BRANDS = {"heic", "heix", "hevc", "heim", "heis", "hevm", "hevs", "mif1", "msf1", "avif", "avis", "crx "};
+
+/** Brands of ISO media files that hold video or audio */
+static const std::unordered_set<string> OTHER_BRANDS = {"isom", "iso2", "iso4", "iso5", "iso6", "mp41", "mp42", "M4V ", "M4A ", "M4P ", "qt  ", "3gp4", "3gp5", "3gp6", "3g2a", "dash", "avc1", "f4v "};
+
+/** Splits a path into its parts, dropping empty and '.' parts, an absolute path starts with an empty part */
+static std::vector<string> split_path(const string& path){
+	std::vector<string> parts;
+	if(!path.empty() && path[0] == '/') parts.push_back("");
+	std::size_t begin = 0;
+	while(begin <= path.size()){
+		std::size_t end = path.find('/', begin);
+		if(end == string::npos) end = path.size();
+		string part = path.substr(begin, end - begin);
+		if(!part.empty() && part != ".") parts.push_back(part);
+		begin = end + 1;
+	}
+	return parts;
+}
+
+/** Joins the parts of a path from a position on */
+static string join_path(const std::vector<string>& parts, std::size_t from){
+	string path;
+	for(std::size_t i = from; i < parts.size(); i++){
+		if(i != from) path += '/';
+		path += parts[i];
+	}
+	return path;
+}
+
+static bool starts_with(const unsigned char* data, unsigned long int size, const char* magic, unsigned long int length){
+	return size >= length && std::memcmp(data, magic, length) == 0;
+}
+
+File_Filter::File_Filter() : _root(), _has_includes(false), _images_only(false), _archives(false) {}
+
+void File_Filter::exclude_directory(const string& path){
+	Node* node = &_root;
+	for(auto& part : split_path(path)){
+		auto& child = node->children[part];
+		if(!child) child.reset(new Node());
+		node = child.get();
+	}
+	node->excluded = true;
+}
+
+void File_Filter::add_include(const string& glob){
+	Glob rest;
+	add_node(glob, rest)->includes.push_back(rest);
+	_has_includes = true;
+}
+
+void File_Filter::add_exclude(const string& glob){
+	Glob rest;
+	add_node(glob, rest)->excludes.push_back(rest);
+}
+
+void File_Filter::set_images_only(bool images_only){
+	_images_only = images_only;
+}
+
+void File_Filter::set_archives(bool archives){
+	_archives = archives;
+}
+
+File_Filter::Node* File_Filter::add_node(const string& glob, Glob& rest){
+	rest.name_only = glob.find('/') == string::npos;
+	rest.pattern = glob;
+	if(rest.name_only) return &_root;
+
+	// Directories without wildcards become trie nodes, the last part always stays in the pattern
+	std::vector<string> parts = split_path(glob);
+	Node* node = &_root;
+	std::size_t literal = 0;
+	while(literal + 1 < parts.size() && parts[literal].find_first_of("*?[") == string::npos){
+		auto& child = node->children[parts[literal]];
+		if(!child) child.reset(new Node());
+		node = child.get();
+		literal++;
+	}
+	rest.pattern = join_path(parts, literal);
+	return node;
+}
+
+bool File_Filter::matches(const string& path, bool includes) const{
+	std::vector<string> parts = split_path(path);
+	if(parts.empty()) return false;
+	const string& name = parts.back();
+
+	// Meet the globs of every directory the path is in
+	const Node* node = &_root;
+	for(std::size_t depth = 0; node != nullptr && depth < parts.size(); depth++){
+		string rest = join_path(parts, depth);
+		for(auto& glob : includes ? node->includes : node->excludes){
+			if(match(glob.pattern.c_str(), glob.name_only ? name.c_str() : rest.c_str())) return true;
+		}
+		auto child = node->children.find(parts[depth]);
+		node = child == node->children.end() ? nullptr : child->second.get();
+	}
+	return false;
+}
+
+bool File_Filter::is_excluded(const string& path) const{
+
+	// Inside an excluded directory
+	const Node* node = &_root;
+	for(auto& part : split_path(path)){
+		auto child = node->children.find(part);
+		if(child == node->children.end()) break;
+		node = child->second.get();
+		if(node->excluded) return true;
+	}
+
+	return matches(path, false);
+}
+
+bool File_Filter::is_candidate(const string& path) const{
+
+	// Archives are read whatever their name, their members are filtered instead
+	if(is_archive(path)) return true;
+	return is_candidate(path, nullptr, 0);
+}
+
+bool File_Filter::is_candidate(const string& path, const char* data, unsigned long int size) const{
+	if(_has_includes && !matches(path, true)) return false;
+	if(_images_only && classify(path, data, size) == File_Kind::NOT_IMAGE) return false;
+	return true;
+}
+
+bool File_Filter::is_candidate_name(const string& path) const{
+	if(_has_includes && !matches(path, true)) return false;
+	if(_images_only && classify_name(path) == File_Kind::NOT_IMAGE) return false;
+	return true;
+}
+
+bool File_Filter::is_archive(const string& path) const{
+	return _archives && Archive_Reader::is_archive(path);
+}
+
+File_Kind File_Filter::classify_name(const string& path){
+
+	// Compare the name without case
+	std::size_t slash = path.find_last_of('/');
+	string name = slash == string::npos ? path : path.substr(slash + 1);
+	std::transform(name.begin(), name.end(), name.begin(), [](unsigned char c){ return std::tolower(c); });
+
+	// Resource forks left by macOS on other file systems
+	if(OTHER_NAMES.count(name) != 0 || name.compare(0, 2, "._") == 0) return File_Kind::NOT_IMAGE;
+
+	std::size_t dot = name.find_last_of('.');
+	if(dot == string::npos || dot == 0) return File_Kind::UNKNOWN;
+	string extension = name.substr(dot + 1);
+	if(IMAGE_EXTENSIONS.count(extension) != 0) return File_Kind::IMAGE;
+	if(OTHER_EXTENSIONS.count(extension) != 0) return File_Kind::NOT_IMAGE;
+	return File_Kind::UNKNOWN;
+}
+
+File_Kind File_Filter::classify_magic(const unsigned char* data, unsigned long int size){
+	size = std::min(size, SNIFF_SIZE);
+	if(size == 0) return File_Kind::NOT_IMAGE;
+
+	// Image formats
+	if(starts_with(data, size, "\xFF\xD8\xFF", 3) || starts_with(data, size, "\x89PNG\r\n\x1A\n", 8) || starts_with(data, size, "GIF8", 4) ||
+		starts_with(data, size, "II*\0", 4) || starts_with(data, size, "MM\0*", 4) || starts_with(data, size, "BM", 2) ||
+		starts_with(data, size, "\x76\x2F\x31\x01", 4) || starts_with(data, size, "8BPS", 4) || starts_with(data, size, "#?RADIANCE", 10) ||
+		starts_with(data, size, "#?RGBE", 6) || starts_with(data, size, "\0\0\0\x0CjP  ", 8) || starts_with(data, size, "\xFF\x4F\xFF\x51", 4) ||
+		starts_with(data, size, "SDPX", 4) || starts_with(data, size, "XPDS", 4) || starts_with(data, size, "DDS ", 4) ||
+		starts_with(data, size, "\x01\xDA", 2) || starts_with(data, size, "SIMPLE  =", 9) || starts_with(data, size, "\x80\x2A\x5F\xD7", 4) ||
+		starts_with(data, size, "FUJIFILMCCD-RAW", 15) || starts_with(data, size, "IIRO", 4) || starts_with(data, size, "IIU\0", 4))
+		return File_Kind::IMAGE;
+	if(size >= 3 && data[0] == 'P' && data[1] >= '1' && data[1] <= '7' && std::isspace(data[2])) return File_Kind::IMAGE;
+	if(size >= 12 && starts_with(data, size, "RIFF", 4) && std::memcmp(data + 8, "WEBP", 4) == 0) return File_Kind::IMAGE;
+
+	// ISO media files hold either still images or video
+	if(size >= 12 && std::memcmp(data + 4, "ftyp", 4) == 0){
+		string brand(reinterpret_cast<const char*>(data) + 8, 4);
+		if(IMAGE_BRANDS.count(brand) != 0) return File_Kind::IMAGE;
+		if(OTHER_BRANDS.count(brand) != 0) return File_Kind::NOT_IMAGE;
+		return File_Kind::UNKNOWN;
+	}
+
+	// Other formats
+	if(starts_with(data, size, "PK\x03\x04", 4) || starts_with(data, size, "%PDF", 4) || starts_with(data, size, "\x1A\x45\xDF\xA3", 4) ||
+		starts_with(data, size, "RIFF", 4) || starts_with(data, size, "ID3", 3) || starts_with(data, size, "fLaC", 4) ||
+		starts_with(data, size, "OggS", 4) || starts_with(data, size, "\x1F\x8B", 2) || starts_with(data, size, "7z\xBC\xAF\x27\x1C", 6) ||
+		starts_with(data, size, "Rar!", 4) || starts_with(data, size, "SQLite format 3", 15) || starts_with(data, size, "\0\0\0\x01" "Bud1", 8) ||
+		starts_with(data, size, "\x7F" "ELF", 4) || starts_with(data, size, "BZh", 3) || starts_with(data, size, "\xFD" "7zXZ", 5))
+		return File_Kind::NOT_IMAGE;
+
+	// Plain text, the text image formats are recognized above
+	bool text = true;
+	for(unsigned long int i = 0; i < size && text; i++) text = std::isprint(data[i]) || std::isspace(data[i]);
+	return text ? File_Kind::NOT_IMAGE : File_Kind::UNKNOWN;
+}
+
+File_Kind File_Filter::classify(const string& path, const char* data, unsigned long int size){
+	File_Kind kind = classify_name(path);
+	if(kind != File_Kind::UNKNOWN) return kind;
+	if(data != nullptr) return classify_magic(reinterpret_cast<const unsigned char*>(data), size);
+
+	// Read only the first bytes
+	int fd = Utility::open_file(path);
+	if(fd < 0) return File_Kind::UNKNOWN;
+	unsigned char magic[SNIFF_SIZE];
+	ssize_t length = pread(fd, magic, SNIFF_SIZE, 0);
+	close(fd);
+	return length < 0 ? File_Kind::UNKNOWN : classify_magic(magic, length);
+}
+
+bool File_Filter::match(const char* pattern, const char* text){
+	while(*pattern){
+		switch(*pattern){
+			case '*':
+				if(pattern[1] == '*'){
+
+					// Any number of directories, "**/" also matches none
+					pattern += 2;
+					bool directories = *pattern == '/';
+					if(directories) pattern++;
+					for(const char* position = text; ; position++){
+						if((!directories || position == text || position[-1] == '/') && match(pattern, position)) return true;
+						if(!*position) return false;
+					}
+				}
+
+				// Anything within one part
+				pattern++;
+				for(const char* position = text; ; position++){
+					if(match(pattern, position)) return true;
+					if(!*position || *position == '/') return false;
+				}
+
+			case '?':
+				if(!*text || *text == '/') return false;
+				pattern++;
+				text++;
+				break;
+
+			case '[':{
+				if(!*text || *text == '/') return false;
+				const char* position = pattern + 1;
+				bool negate = *position == '!' || *position == '^';
+				if(negate) position++;
+				bool found = false;
+				bool first = true;
+				while(*position && (first || *position != ']')){
+					if(position[1] == '-' && position[2] && position[2] != ']'){
+						if((unsigned char)*text >= (unsigned char)position[0] && (unsigned char)*text <= (unsigned char)position[2]) found = true;
+						position += 3;
+					}else{
+						if(*position == *text) found = true;
+						position++;
+					}
+					first = false;
+				}
+
+				// No closing bracket, match it as it is
+				if(!*position){
+					if(*text != '[') return false;
+					pattern++;
+					text++;
+					break;
+				}
+				if(found == negate) return false;
+				pattern = position + 1;
+				text++;
+				break;
+			}
+
+			default:
+				if(*pattern != *text) return false;
+				pattern++;
+				text++;
+		}
+	}
+	return !*text;
+}
@@ -0,0 +1,110 @@
+#ifndef __PCOLL_FILE_FILTER__
+#define __PCOLL_FILE_FILTER__
+
+#include <string>
+#include <vector>
+#include <memory>
+#include <unordered_map>
+
+/** What a file holds, as far as its name and first bytes tell */
+enum class File_Kind {
+	IMAGE, // a known image format
+	NOT_IMAGE, // a known format that is not an image, such as video, sidecars and archives
+	UNKNOWN // only the image reader can tell
+};
+
+/** Decides which paths of a walk are read before anything is opened
+ *	Excluded directories and globs hang off a trie of the directories they start with, so a path
+ *	only meets the globs of the directories it is in. Globs without a '/' match the file name, others
+ *	match the path as walked and may use '*', '?', '[...]' and '**' for any number of directories.
+ */
+class File_Filter {
+public:
+	File_Filter();
+	File_Filter(const File_Filter& other) = delete;
+	File_Filter& operator=(const File_Filter& other) = delete;
+
+	/** Skips a directory and everything in it
+	 *	@param path path of the directory
+	 */
+	void exclude_directory(const std::string& path);
+
+	/** Only reads files that match at least one include glob
+	 *	@param glob the glob
+	 */
+	void add_include(const std::string& glob);
+
+	/** Skips files and directories that match the glob
+	 *	@param glob the glob
+	 */
+	void add_exclude(const std::string& glob);
+
+	/** @param images_only if true, files known not to be images are skipped */
+	void set_images_only(bool images_only);
+
+	/** @param archives if true, archives are read and their members filtered instead of them */
+	void set_archives(bool archives);
+
+	/** @return true if a file or directory is skipped with everything in it */
+	bool is_excluded(const std::string& path) const;
+
+	/** @return true if a regular file should be read, may read its first bytes */
+	bool is_candidate(const std::string& path) const;
+
+	/** Decides by its path and contents if a file should be inserted, used for members of archives
+	 *	@param path path of the file
+	 *	@param data contents of the file, nullptr to read the first bytes from the path
+	 *	@param size size of the contents
+	 */
+	bool is_candidate(const std::string& path, const char* data, unsigned long int size) const;
+
+	/** Decides by its path alone if a file may be inserted, without reading anything
+	 *	@return false if the file is skipped whatever its contents
+	 */
+	bool is_candidate_name(const std::string& path) const;
+
+	/** @return true if the file is an archive whose members are read */
+	bool is_archive(const std::string& path) const;
+
+	/** @return kind of a file by its name */
+	static File_Kind classify_name(const std::string& path);
+
+	/** @return kind of a file by its first bytes, at most SNIFF_SIZE of them are looked at */
+	static File_Kind classify_magic(const unsigned char* data, unsigned long int size);
+
+	/** Classifies a file by its name, then by its first bytes
+	 *	@param path path of the file
+	 *	@param data contents of the file, nullptr to read the first bytes from the path
+	 *	@param size size of the contents
+	 */
+	static File_Kind classify(const std::string& path, const char* data, unsigned long int size);
+
+	/** Bytes looked at to recognize a format */
+	static constexpr unsigned long int SNIFF_SIZE = 16;
+
+private:
+	struct Glob {
+		Glob() : pattern(), name_only(false) {}
+		std::string pattern; // rest of the glob after the directories of its trie node
+		bool name_only; // matches the file name instead of the path
+	};
+
+	struct Node {
+		Node() : children(), excluded(false), includes(), excludes() {}
+		std::unordered_map<std::string, std::unique_ptr<Node>> children;
+		bool excluded; // directory skipped with everything in it
+		std::vector<Glob> includes;
+		std::vector<Glob> excludes;
+	};
+
+	Node* add_node(const std::string& glob, Glob& rest);
+	bool matches(const std::string& path, bool includes) const;
+	static bool match(const char* pattern, const char* text);
+
+	Node _root;
+	bool _has_includes;
+	bool _images_only;
+	bool _archives;
+};
+
+#endif //__PCOLL_FILE_FILTER__
@@ -0,0 +1,299 @@
+#include "file_reader.hpp"
+#include "utility.hpp"
+
+#include <cstring>
+#include <cerrno>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+
+using std::string;
+
+File_Reader::File_Reader(unsigned int queue_depth, unsigned long int max_buffered_bytes) :
+	_queue_depth(queue_depth == 0 ? 1 : queue_depth),
+	_max_buffered_bytes(max_buffered_bytes),
+	_buffered_bytes(0),
+	_stopping(false),
+	_pending(),
+	_pending_mutex(),
+	_pending_condition(),
+	_completed(),
+	_completed_mutex(),
+	_threads()
+#ifdef PCOLL_IO_URING
+	,
+	_uring(false),
+	_ring(),
+	_slab(),
+	_chunks()
+#endif
+{
+#ifdef PCOLL_IO_URING
+	// Set up the ring and register one buffer per slot so reads skip the per-request page pinning
+	if(io_uring_queue_init(_queue_depth, &_ring, 0) == 0){
+		_slab.reset(new char[_queue_depth * CHUNK_SIZE]);
+		std::vector<struct iovec> iovecs(_queue_depth);
+		for(unsigned int i = 0; i < _queue_depth; i++){
+			iovecs[i].iov_base = _slab.get() + i * CHUNK_SIZE;
+			iovecs[i].iov_len = CHUNK_SIZE;
+		}
+		if(io_uring_register_buffers(&_ring, iovecs.data(), _queue_depth) == 0){
+			_chunks.resize(_queue_depth);
+			_uring = true;
+			_threads.push_back(std::make_unique<std::thread>(&File_Reader::uring_function, this));
+			return;
+		}
+		io_uring_queue_exit(&_ring);
+		_slab.reset();
+	}
+#endif
+
+	// Fall back to blocking reads, one thread per read in flight
+	for(unsigned int i = 0; i < _queue_depth; i++)
+		_threads.push_back(std::make_unique<std::thread>(&File_Reader::thread_pool_function, this));
+}
+
+File_Reader::~File_Reader(){
+
+	// Stop the threads
+	{
+		std::unique_lock<std::mutex> lock(_pending_mutex);
+		_stopping = true;
+	}
+	_pending_condition.notify_all();
+	for(auto& thread : _threads)
+		thread->join();
+
+#ifdef PCOLL_IO_URING
+	if(_uring){
+		io_uring_unregister_buffers(&_ring);
+		io_uring_queue_exit(&_ring);
+	}
+#endif
+
+	// Free anything that was never taken
+	while(!_completed.empty()){
+		delete _completed.front();
+		_completed.pop();
+	}
+}
+
+void File_Reader::submit(const string& path){
+	{
+		std::unique_lock<std::mutex> lock(_pending_mutex);
+		_pending.push(path);
+	}
+	_pending_condition.notify_one();
+}
+
+File_Buffer* File_Reader::poll(){
+	std::unique_lock<std::mutex> lock(_completed_mutex);
+	if(_completed.empty()) throw Pexception("No file has been read yet!");
+	File_Buffer* buffer = _completed.front();
+	_completed.pop();
+	return buffer;
+}
+
+void File_Reader::release(File_Buffer* buffer){
+	unsigned long int size = buffer->size;
+	delete buffer;
+
+	// There may be room for another file now, lowered under the lock so a reader about to wait sees it
+	{
+		std::unique_lock<std::mutex> lock(_pending_mutex);
+		_buffered_bytes -= size;
+	}
+	_pending_condition.notify_all();
+}
+
+bool File_Reader::is_asynchronous() const{
+#ifdef PCOLL_IO_URING
+	return _uring;
+#else
+	return false;
+#endif
+}
+
+File_Buffer* File_Reader::open_next(int& fd, bool wait){
+
+	// Get the next path once there is room for it
+	string path;
+	{
+		std::unique_lock<std::mutex> lock(_pending_mutex);
+		auto ready = [&](){ return _stopping || (!_pending.empty() && _buffered_bytes < _max_buffered_bytes); };
+		if(wait) _pending_condition.wait(lock, ready);
+		if(_stopping || !ready()) return nullptr;
+		path = _pending.front();
+		_pending.pop();
+	}
+
+	File_Buffer* buffer = new File_Buffer();
+	buffer->path = path;
+
+	// Open the file and allocate room for all of it
+	fd = Utility::open_file(path);
+	struct stat file_stat;
+	if(fd < 0 || fstat(fd, &file_stat) != 0){
+		buffer->error = "Cannot open file '" + path + "': " + std::strerror(errno);
+		if(fd >= 0) close(fd);
+		fd = -1;
+		return buffer;
+	}
+	buffer->size = file_stat.st_size;
+	buffer->modified = file_stat.st_mtim.tv_sec * 1000000000LL + file_stat.st_mtim.tv_nsec;
+	buffer->data.reset(new char[buffer->size]);
+	_buffered_bytes += buffer->size;
+
+	return buffer;
+}
+
+void File_Reader::complete(File_Buffer* buffer){
+	std::unique_lock<std::mutex> lock(_completed_mutex);
+	_completed.push(buffer);
+}
+
+void File_Reader::thread_pool_function(){
+	while(true){
+		int fd = -1;
+		File_Buffer* buffer = open_next(fd, true);
+		if(buffer == nullptr) return;
+
+		// Read the whole file
+		unsigned long int offset = 0;
+		while(fd >= 0 && offset < buffer->size){
+			ssize_t result = pread(fd, buffer->data.get() + offset, buffer->size - offset, offset);
+			if(result < 0 && errno == EINTR) continue;
+			if(result <= 0){
+				buffer->error = "Failed to read file '" + buffer->path + "': " + (result < 0 ? std::strerror(errno) : "unexpected end of file");
+				break;
+			}
+			offset += result;
+		}
+		if(fd >= 0) close(fd);
+
+		complete(buffer);
+	}
+}
+
+#ifdef PCOLL_IO_URING
+bool File_Reader::submit_chunk(Read_Request* request, unsigned int slot){
+	struct io_uring_sqe* sqe = io_uring_get_sqe(&_ring);
+	if(sqe == nullptr) return false;
+
+	Chunk& chunk = _chunks[slot];
+	io_uring_prep_read_fixed(sqe, request->fd, _slab.get() + slot * CHUNK_SIZE, chunk.length, chunk.offset, slot);
+	io_uring_sqe_set_data(sqe, &chunk);
+	request->inflight++;
+	return true;
+}
+
+void File_Reader::uring_function(){
+
+	// Slots of the registered buffers that are not in use
+	std::vector<unsigned int> free_slots;
+	for(unsigned int i = 0; i < _queue_depth; i++) free_slots.push_back(_queue_depth - 1 - i);
+
+	// Files that still have bytes to submit
+	std::list<Read_Request*> active;
+	unsigned int inflight = 0;
+
+	// Closes the file and hands it over once nothing is in flight for it anymore
+	auto finish = [&](Read_Request* request){
+		close(request->fd);
+		complete(request->buffer);
+		delete request;
+	};
+
+	while(true){
+
+		// Fill every free slot, opening new files as needed
+		while(!free_slots.empty()){
+			if(active.empty()){
+				int fd = -1;
+				File_Buffer* buffer = open_next(fd, inflight == 0);
+				if(buffer == nullptr) break;
+				if(fd < 0 || buffer->size == 0){
+					if(fd >= 0) close(fd);
+					complete(buffer);
+					continue;
+				}
+				active.push_back(new Read_Request{buffer, fd, 0, 0, 0});
+			}
+
+			// Submit the next chunk of the oldest file
+			Read_Request* request = active.front();
+			unsigned int slot = free_slots.back();
+			Chunk& chunk = _chunks[slot];
+			chunk.request = request;
+			chunk.offset = request->submitted;
+			chunk.length = std::min(CHUNK_SIZE, request->buffer->size - request->submitted);
+			if(!submit_chunk(request, slot)) break;
+			free_slots.pop_back();
+			inflight++;
+			request->submitted += chunk.length;
+			if(request->submitted == request->buffer->size) active.pop_front();
+		}
+
+		// Nothing in flight and nothing more to open means the reader is stopping
+		if(inflight == 0){
+			std::unique_lock<std::mutex> lock(_pending_mutex);
+			if(_stopping) break;
+			continue;
+		}
+
+		// Send the new reads to the kernel and wait for at least one of them
+		io_uring_submit(&_ring);
+		struct io_uring_cqe* cqe;
+		if(io_uring_wait_cqe(&_ring, &cqe) != 0) continue;
+
+		// Drain every completion that is ready
+		do{
+			Chunk* chunk = static_cast<Chunk*>(io_uring_cqe_get_data(cqe));
+			unsigned int slot = chunk - _chunks.data();
+			int result = cqe->res;
+			io_uring_cqe_seen(&_ring, cqe);
+
+			Read_Request* request = chunk->request;
+			request->inflight--;
+			inflight--;
+
+			if(result <= 0){
+				// Stop reading this file
+				if(request->buffer->error.empty())
+					request->buffer->error = "Failed to read file '" + request->buffer->path + "': " + (result < 0 ? std::strerror(-result) : "unexpected end of file");
+				active.remove(request);
+			}else{
+				// Move the data out of the registered buffer
+				std::memcpy(request->buffer->data.get() + chunk->offset, _slab.get() + slot * CHUNK_SIZE, result);
+				request->completed += result;
+
+				// Short read, ask for the rest with the same slot
+				if((unsigned long int)result < chunk->length){
+					chunk->offset += result;
+					chunk->length -= result;
+					if(submit_chunk(request, slot)){
+						inflight++;
+						continue;
+					}
+					request->buffer->error = "Failed to read file '" + request->buffer->path + "': submission queue is full";
+					active.remove(request);
+				}
+			}
+			free_slots.push_back(slot);
+
+			// Hand over the file once all of it is in or it failed
+			if(request->inflight == 0 && (!request->buffer->error.empty() || request->completed == request->buffer->size))
+				finish(request);
+
+		}while(io_uring_peek_cqe(&_ring, &cqe) == 0);
+	}
+
+	// Anything left over was abandoned by stopping
+	for(auto& request : active){
+		close(request->fd);
+		delete request->buffer;
+		delete request;
+	}
+}
+#endif
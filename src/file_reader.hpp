@@ -0,0 +1,117 @@
+#ifndef __PCOLL_FILE_READER__
+#define __PCOLL_FILE_READER__
+
+#include <string>
+#include <memory>
+#include <queue>
+#include <list>
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+
+#ifdef PCOLL_IO_URING
+#include <liburing.h>
+#endif
+
+/** A whole file read into memory */
+struct File_Buffer {
+	File_Buffer() : path(), data(), size(0), modified(0), error() {}
+	std::string path;
+	std::unique_ptr<char[]> data;
+	unsigned long int size; // size in bytes
+	long long int modified; // modification time in nanoseconds
+	std::string error; // non-empty if the file could not be read
+};
+
+/** Reads whole files asynchronously
+ *	Uses io_uring with registered buffers when it is available, so a single thread can keep many
+ *	reads in flight. Otherwise falls back to a pool of threads doing blocking reads.
+ *	Files are handed back in the order they complete, not the order they were submitted.
+ */
+class File_Reader {
+public:
+	/** Construct the reader and start its threads
+	 *	@param queue_depth number of reads kept in flight
+	 *	@param max_buffered_bytes stop opening new files while this many bytes are read but not released
+	 */
+	File_Reader(unsigned int queue_depth, unsigned long int max_buffered_bytes);
+	~File_Reader();
+	File_Reader(const File_Reader& other) = delete;
+	File_Reader& operator=(const File_Reader& other) = delete;
+
+	/** Queues a file for reading
+	 *	@param path path of the file
+	 */
+	void submit(const std::string& path);
+
+	/** Takes a completed file, throws Pexception if none is ready yet
+	 *	@return the file, must be given back with release()
+	 */
+	File_Buffer* poll();
+
+	/** Frees a file returned by poll()
+	 *	@param buffer the file
+	 */
+	void release(File_Buffer* buffer);
+
+	/** @return true if reads go through io_uring */
+	bool is_asynchronous() const;
+
+private:
+	static constexpr unsigned long int CHUNK_SIZE = 256 * 1024;
+
+	/** Opens the next file and allocates its buffer
+	 *	@param fd set to the open file descriptor, or -1 if the file could not be opened
+	 *	@param wait block until a file can be opened
+	 *	@return the file, or nullptr if there is nothing to open or the reader is stopping
+	 */
+	File_Buffer* open_next(int& fd, bool wait);
+	void complete(File_Buffer* buffer);
+	void thread_pool_function();
+
+	unsigned int _queue_depth;
+	unsigned long int _max_buffered_bytes;
+	std::atomic<unsigned long int> _buffered_bytes;
+	bool _stopping;
+
+	/** paths waiting to be read */
+	std::queue<std::string> _pending;
+	std::mutex _pending_mutex;
+	std::condition_variable _pending_condition;
+
+	/** files read completely */
+	std::queue<File_Buffer*> _completed;
+	std::mutex _completed_mutex;
+
+	std::list<std::unique_ptr<std::thread>> _threads;
+
+#ifdef PCOLL_IO_URING
+	/** A file with reads in flight */
+	struct Read_Request {
+		File_Buffer* buffer;
+		int fd;
+		unsigned long int submitted; // bytes handed to the ring
+		unsigned long int completed; // bytes copied into the buffer
+		unsigned int inflight; // reads in flight
+	};
+
+	/** A read into one of the registered buffers */
+	struct Chunk {
+		Read_Request* request;
+		unsigned long int offset;
+		unsigned long int length;
+	};
+
+	void uring_function();
+	bool submit_chunk(Read_Request* request, unsigned int slot);
+
+	bool _uring;
+	struct io_uring _ring;
+	std::unique_ptr<char[]> _slab; // registered buffers, one per slot
+	std::vector<Chunk> _chunks;
+#endif
+};
+
+#endif //__PCOLL_FILE_READER__
@@ -1,17 +1,132 @@
 #include "filechecksum.hpp"
+#include "sha256_multi_buffer.hpp"
 #include "utility.hpp"
 
-#include <openssl/sha.h>
+#include <openssl/evp.h>
 #include <sstream>
 #include <ios>
 #include <iomanip>
-#include <fstream>
+#include <cerrno>
+#include <unistd.h>
+
+#ifdef PCOLL_XXHASH
+#include <xxhash.h>
+#endif
+
+#ifdef PCOLL_BLAKE3
+#include <blake3.h>
+#endif
 
 using std::setfill;
 using std::stringstream;
 using std::setw;
 using std::hex;
 
+/** Incremental digest with the selected algorithm */
+class Digest_Context {
+public:
+	Digest_Context(Checksum_Algorithm algorithm);
+	~Digest_Context();
+	Digest_Context(const Digest_Context& other) = delete;
+	Digest_Context& operator=(const Digest_Context& other) = delete;
+	void update(const void* data, unsigned long int size);
+
+	/** Finishes the digest
+	 *	@param digest receives the digest, must fit EVP_MAX_MD_SIZE bytes
+	 *	@return length of the digest
+	 */
+	unsigned int final(unsigned char* digest);
+
+private:
+	Checksum_Algorithm _algorithm;
+	EVP_MD_CTX* _evp;
+#ifdef PCOLL_XXHASH
+	XXH3_state_t* _xxh3;
+#endif
+#ifdef PCOLL_BLAKE3
+	blake3_hasher _blake3;
+#endif
+};
+
+Digest_Context::Digest_Context(Checksum_Algorithm algorithm) :
+	_algorithm(algorithm),
+	_evp(nullptr)
+#ifdef PCOLL_XXHASH
+	,
+	_xxh3(nullptr)
+#endif
+#ifdef PCOLL_BLAKE3
+	,
+	_blake3()
+#endif
+{
+	switch(_algorithm){
+#ifdef PCOLL_XXHASH
+		case Checksum_Algorithm::XXH3:
+			_xxh3 = XXH3_createState();
+			XXH3_128bits_reset(_xxh3);
+			break;
+#endif
+#ifdef PCOLL_BLAKE3
+		case Checksum_Algorithm::BLAKE3:
+			blake3_hasher_init(&_blake3);
+			break;
+#endif
+		default:
+			_evp = EVP_MD_CTX_new();
+			EVP_DigestInit_ex(_evp, EVP_sha256(), nullptr);
+	}
+}
+
+Digest_Context::~Digest_Context(){
+	if(_evp) EVP_MD_CTX_free(_evp);
+#ifdef PCOLL_XXHASH
+	if(_xxh3) XXH3_freeState(_xxh3);
+#endif
+}
+
+void Digest_Context::update(const void* data, unsigned long int size){
+	switch(_algorithm){
+#ifdef PCOLL_XXHASH
+		case Checksum_Algorithm::XXH3:
+			XXH3_128bits_update(_xxh3, data, size);
+			break;
+#endif
+#ifdef PCOLL_BLAKE3
+		case Checksum_Algorithm::BLAKE3:
+			blake3_hasher_update(&_blake3, data, size);
+			break;
+#endif
+		default:
+			EVP_DigestUpdate(_evp, data, size);
+	}
+}
+
+unsigned int Digest_Context::final(unsigned char* digest){
+	switch(_algorithm){
+#ifdef PCOLL_XXHASH
+		case Checksum_Algorithm::XXH3: {
+			XXH128_canonical_t canonical;
+			XXH128_canonicalFromHash(&canonical, XXH3_128bits_digest(_xxh3));
+			std::copy(canonical.digest, canonical.digest + sizeof(canonical.digest), digest);
+			return sizeof(canonical.digest);
+		}
+#endif
+#ifdef PCOLL_BLAKE3
+		case Checksum_Algorithm::BLAKE3:
+			blake3_hasher_finalize(&_blake3, digest, BLAKE3_OUT_LEN);
+			return BLAKE3_OUT_LEN;
+#endif
+		default: {
+			unsigned int length = 0;
+			EVP_DigestFinal_ex(_evp, digest, &length);
+			return length;
+		}
+	}
+}
+
+Checksum_Algorithm File_Checksum::_algorithm = Checksum_Algorithm::SHA256;
+
 File_Checksum::File_Checksum() : _hash(nullptr) {}
 
 File_Checksum::File_Checksum(const string& input) : _hash(compute_hash_by_input(input)) {}
@@ -49,60 +164,154 @@ bool File_Checksum::operator==(const File_Checksum& other) const{
 }
 
 std::string* File_Checksum::compute_hash_by_input(const string& input){
-	unsigned char hash[SHA256_DIGEST_LENGTH];
-    SHA256_CTX sha256;
-    SHA256_Init(&sha256);
-    SHA256_Update(&sha256, input.c_str(), input.size());
-    SHA256_Final(hash, &sha256);
-    stringstream ss;
-    for(int i = 0; i < SHA256_DIGEST_LENGTH; i++) {
-        ss << hex << setw(2) << setfill('0') << (int)hash[i];
-    }
-
-	string* heap = new string(ss.str());
-
-	return heap;
+	unsigned char hash[EVP_MAX_MD_SIZE];
+	Digest_Context context(_algorithm);
+	context.update(input.c_str(), input.size());
+	unsigned int length = context.final(hash);
+	return to_hex_string(hash, length);
 }
 
 File_Checksum* File_Checksum::compute_hash_by_file(const string& path){
 
 	// Create context
-    SHA256_CTX sha256;
-    SHA256_Init(&sha256);
+	Digest_Context context(_algorithm);
 
 	// Open the file
-	std::ifstream input_file(path);
-	if(!input_file.is_open()) throw Pexception("Cannot open file '" + path + "'!");
+	int fd = Utility::open_file(path);
+	if(fd < 0) throw Pexception("Cannot open file '" + path + "'!");
 
-	// Digest
-	string line;
-	while(std::getline(input_file, line))
-		SHA256_Update(&sha256, line.c_str(), line.size());
+	// Digest the raw bytes in blocks
+	char block[64 * 1024];
+	while(true){
+		ssize_t result = read(fd, block, sizeof(block));
+		if(result < 0 && errno == EINTR) continue;
+		if(result < 0){
+			close(fd);
+			throw Pexception("Failed to read file '" + path + "'!");
+		}
+		if(result == 0) break;
+		context.update(block, result);
+	}
 
 	// Close the file
-	input_file.close();
+	close(fd);
 
 	// Get the final hash
-	unsigned char hash[SHA256_DIGEST_LENGTH];
-    SHA256_Final(hash, &sha256);
+	unsigned char hash[EVP_MAX_MD_SIZE];
+	unsigned int length = context.final(hash);
+
+	File_Checksum* chk = new File_Checksum();
+	chk->_hash = to_hex_string(hash, length);
 
-	// Convert to string
-    stringstream ss;
-    for(int i = 0; i < SHA256_DIGEST_LENGTH; i++) ss << hex << setw(2) << setfill('0') << (int)hash[i];
+    return chk;
+}
 
-	// Convert to pointer
-	string* heap = new string(ss.str());
+File_Checksum* File_Checksum::compute_hash_by_buffer(const char* data, unsigned long int size){
+	unsigned char hash[EVP_MAX_MD_SIZE];
+	Digest_Context context(_algorithm);
+	context.update(data, size);
+	unsigned int length = context.final(hash);
 
 	File_Checksum* chk = new File_Checksum();
-	chk->_hash = heap;
+	chk->_hash = to_hex_string(hash, length);
 
-    return chk;
+	return chk;
+}
+
+File_Checksum* File_Checksum::compute_hash_by_ranges(const char* data, const std::vector<std::pair<unsigned long int, unsigned long int>>& ranges){
+	unsigned char hash[EVP_MAX_MD_SIZE];
+	Digest_Context context(_algorithm);
+	for(auto& range : ranges) context.update(data + range.first, range.second);
+	unsigned int length = context.final(hash);
+
+	File_Checksum* chk = new File_Checksum();
+	chk->_hash = to_hex_string(hash, length);
+
+	return chk;
+}
+
+std::vector<File_Checksum*> File_Checksum::compute_hash_by_buffers(const std::vector<std::pair<const char*, unsigned long int>>& buffers){
+	std::vector<File_Checksum*> checksums;
+
+	// Algorithms without batching hash one at a time
+	if(_algorithm != Checksum_Algorithm::SHA256_MULTI_BUFFER){
+		for(auto& buffer : buffers)
+			checksums.push_back(compute_hash_by_buffer(buffer.first, buffer.second));
+		return checksums;
+	}
+
+	// Hash the whole batch together
+	std::vector<const unsigned char*> data;
+	std::vector<unsigned long int> sizes;
+	for(auto& buffer : buffers){
+		data.push_back(reinterpret_cast<const unsigned char*>(buffer.first));
+		sizes.push_back(buffer.second);
+	}
+	std::vector<unsigned char[Sha256_Multi_Buffer::DIGEST_LENGTH]> digests(buffers.size());
+	Sha256_Multi_Buffer::compute(data.data(), sizes.data(), buffers.size(), digests.data());
+
+	for(auto& digest : digests){
+		File_Checksum* chk = new File_Checksum();
+		chk->_hash = to_hex_string(digest, Sha256_Multi_Buffer::DIGEST_LENGTH);
+		checksums.push_back(chk);
+	}
+
+	return checksums;
+}
+
+std::string* File_Checksum::to_hex_string(const unsigned char* hash, unsigned int length){
+	stringstream ss;
+	for(unsigned int i = 0; i < length; i++) ss << hex << setw(2) << setfill('0') << (int)hash[i];
+	return new string(ss.str());
+}
+
+File_Checksum* File_Checksum::from_string(const string& checksum){
+	File_Checksum* chk = new File_Checksum();
+	chk->_hash = new string(checksum);
+	return chk;
 }
 
 std::ostream& operator<<(std::ostream& os, const File_Checksum &fc){
-    return os << "SHA256: " << *(fc._hash);
+    return os << File_Checksum::get_algorithm_name() << ": " << *(fc._hash);
 }
 
 std::string& File_Checksum::get_string() const{
 	return *_hash;
 }
+
+void File_Checksum::set_algorithm(Checksum_Algorithm algorithm){
+	_algorithm = algorithm;
+}
+
+Checksum_Algorithm File_Checksum::get_algorithm(){
+	return _algorithm;
+}
+
+string File_Checksum::get_algorithm_name(){
+	switch(_algorithm){
+		case Checksum_Algorithm::XXH3: return "xxh3";
+		case Checksum_Algorithm::BLAKE3: return "blake3";
+		default: return "sha256";
+	}
+}
+
+bool File_Checksum::is_cryptographic(){
+	return _algorithm != Checksum_Algorithm::XXH3;
+}
+
+bool File_Checksum::parse_algorithm(const string& name, Checksum_Algorithm& algorithm){
+	if(name == "sha256") algorithm = Checksum_Algorithm::SHA256;
+	else if(name == "sha256-mb") algorithm = Checksum_Algorithm::SHA256_MULTI_BUFFER;
+#ifdef PCOLL_XXHASH
+	else if(name == "xxh3") algorithm = Checksum_Algorithm::XXH3;
+#endif
+#ifdef PCOLL_BLAKE3
+	else if(name == "blake3") algorithm = Checksum_Algorithm::BLAKE3;
+#endif
+	else return false;
+	return true;
+}
+
+unsigned int File_Checksum::get_batch_size(){
+	return _algorithm == Checksum_Algorithm::SHA256_MULTI_BUFFER ? Sha256_Multi_Buffer::LANES : 1;
+}
@@ -3,9 +3,19 @@
 
 #include <string>
 #include <iostream>
+#include <vector>
+#include <utility>
 
 using std::string;
 
+/** Digest algorithms for file checksums */
+enum class Checksum_Algorithm {
+	SHA256, // SHA-256 through OpenSSL EVP, uses SHA-NI when the CPU has it
+	SHA256_MULTI_BUFFER, // SHA-256 of up to eight files at once with AVX2, same digests as SHA256
+	XXH3, // XXH3-128, not cryptographic
+	BLAKE3 // BLAKE3
+};
+
 class File_Checksum {
 public:
 	File_Checksum(const string& input);
@@ -16,12 +26,52 @@ public:
 	File_Checksum& operator=(File_Checksum&& other);
 	bool operator==(const File_Checksum& other) const;
 	static File_Checksum* compute_hash_by_file(const string& path);
+	static File_Checksum* compute_hash_by_buffer(const char* data, unsigned long int size);
+
+	/** Computes checksums of several buffers, batching them when the algorithm supports it
+	 *	@param buffers data and size of every buffer
+	 *	@return one checksum per buffer
+	 */
+	static std::vector<File_Checksum*> compute_hash_by_buffers(const std::vector<std::pair<const char*, unsigned long int>>& buffers);
+
+	/** Computes the checksum of parts of a buffer as if they followed one another
+	 *	@param data the buffer
+	 *	@param ranges offset and length of every part, in the order they are hashed
+	 */
+	static File_Checksum* compute_hash_by_ranges(const char* data, const std::vector<std::pair<unsigned long int, unsigned long int>>& ranges);
+
+	static File_Checksum* from_string(const string& checksum);
 	friend std::ostream& operator<<(std::ostream& os, const File_Checksum &fc);
 	std::string& get_string() const;
+
+	/** Selects the digest algorithm used for every checksum computed afterwards
+	 *	@param algorithm the algorithm
+	 */
+	static void set_algorithm(Checksum_Algorithm algorithm);
+	static Checksum_Algorithm get_algorithm();
+
+	/** @return name of the current algorithm, algorithms that produce the same digests share a name */
+	static string get_algorithm_name();
+
+	/** @return true if the current algorithm is collision resistant */
+	static bool is_cryptographic();
+
+	/** Looks up an algorithm by its command line name
+	 *	@param name name of the algorithm
+	 *	@param algorithm receives the algorithm
+	 *	@return false if there is no such algorithm or it is not built in
+	 */
+	static bool parse_algorithm(const string& name, Checksum_Algorithm& algorithm);
+
+	/** @return number of buffers worth handing to compute_hash_by_buffers at once */
+	static unsigned int get_batch_size();
+
 private:
 	File_Checksum();
 	std::string* _hash;
+	static Checksum_Algorithm _algorithm;
 	static std::string* compute_hash_by_input(const string& input);
+	static std::string* to_hex_string(const unsigned char* hash, unsigned int length);
 };
 
 #endif //__PCOLL_FILECHECKSUM__
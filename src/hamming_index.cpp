@@ -0,0 +1,99 @@
+#include "hamming_index.hpp"
+
+#include <bitset>
+#include <algorithm>
+#include <functional>
+
+Hamming_Index::Hamming_Index(unsigned int max_distance) :
+	_max_distance(max_distance),
+	_band_offsets(),
+	_shards(),
+	_matches(),
+	_size(0),
+	_matches_mutex()
+{
+	// Split the bits evenly, past the widest useful split every hash lands in one band of no bits
+	unsigned int bands = max_distance + 1;
+	if(bands > MAX_BANDS){
+		_band_offsets = {0, 0};
+		bands = 1;
+	}else{
+		for(unsigned int band = 0; band <= bands; band++) _band_offsets.push_back(band * 64 / bands);
+	}
+	_shards = std::make_unique<Shard[]>(bands * SHARDS);
+}
+
+uint64_t Hamming_Index::get_band(uint64_t hash, unsigned int band) const{
+	unsigned int width = _band_offsets[band + 1] - _band_offsets[band];
+	if(width == 0) return 0;
+	if(width == 64) return hash;
+	return (hash >> _band_offsets[band]) & ((1ULL << width) - 1);
+}
+
+Hamming_Index::Shard& Hamming_Index::get_shard(unsigned int band, uint64_t value){
+	return _shards[band * SHARDS + std::hash<uint64_t>()(value) % SHARDS];
+}
+
+void Hamming_Index::add(std::size_t id, uint64_t hash){
+	unsigned int bands = _band_offsets.size() - 1;
+
+	// Add to every band before looking, so of two hashes added together at least one finds the other
+	for(unsigned int band = 0; band < bands; band++){
+		uint64_t value = get_band(hash, band);
+		Shard& shard = get_shard(band, value);
+		std::unique_lock<std::shared_mutex> lock(shard.mutex);
+		shard.buckets[value].push_back(Entry{hash, id});
+	}
+
+	// Compare to the hashes that share a band
+	std::vector<Hamming_Match> matches;
+	for(unsigned int band = 0; band < bands; band++){
+		uint64_t value = get_band(hash, band);
+		Shard& shard = get_shard(band, value);
+		std::shared_lock<std::shared_mutex> lock(shard.mutex);
+		for(auto& entry : shard.buckets.at(value)){
+			if(entry.id == id) continue;
+			unsigned int distance = std::bitset<64>(entry.hash ^ hash).count();
+			if(distance > _max_distance) continue;
+
+			// A pair that shares several bands is only taken from the first of them
+			bool shared_before = false;
+			for(unsigned int other = 0; other < band && !shared_before; other++)
+				shared_before = get_band(entry.hash, other) == get_band(hash, other);
+			if(!shared_before) matches.push_back(Hamming_Match{id, entry.id, (uint8_t)distance});
+		}
+	}
+
+	std::unique_lock<std::mutex> lock(_matches_mutex);
+	_matches.insert(_matches.end(), matches.begin(), matches.end());
+	_size++;
+}
+
+unsigned int Hamming_Index::get_max_distance() const{
+	return _max_distance;
+}
+
+std::size_t Hamming_Index::size(){
+	std::unique_lock<std::mutex> lock(_matches_mutex);
+	return _size;
+}
+
+std::vector<Hamming_Match> Hamming_Index::get_matches(){
+	std::vector<Hamming_Match> matches;
+	{
+		std::unique_lock<std::mutex> lock(_matches_mutex);
+		matches = _matches;
+	}
+
+	// Both hashes of a pair added together may have found each other
+	for(auto& match : matches){
+		if(match.one > match.two) std::swap(match.one, match.two);
+	}
+	std::sort(matches.begin(), matches.end(), [](const Hamming_Match& one, const Hamming_Match& two) -> bool {
+		return one.one != two.one ? one.one < two.one : one.two < two.two;
+	});
+	matches.erase(std::unique(matches.begin(), matches.end(), [](const Hamming_Match& one, const Hamming_Match& two) -> bool {
+		return one.one == two.one && one.two == two.two;
+	}), matches.end());
+	return matches;
+}
@@ -0,0 +1,73 @@
+#ifndef __PCOLL_HAMMING_INDEX__
+#define __PCOLL_HAMMING_INDEX__
+
+#include <vector>
+#include <unordered_map>
+#include <shared_mutex>
+#include <mutex>
+#include <memory>
+#include <cstdint>
+
+/** A pair of hashes found within the distance of a Hamming_Index */
+struct Hamming_Match {
+	std::size_t one; // id of the first hash
+	std::size_t two; // id of the second hash
+	uint8_t distance; // Hamming distance between them
+};
+
+/** Finds the 64 bit hashes within a Hamming distance of each other while they are added
+ *	Every hash is split into one more band than the distance, so two hashes within the distance
+ *	agree on at least one whole band. A new hash is only compared to the hashes that share one of its
+ *	bands. Bands are split into shards with a lock each, so workers add hashes alongside each other.
+ */
+class Hamming_Index {
+public:
+	/** @param max_distance largest distance between two hashes that are matched */
+	Hamming_Index(unsigned int max_distance);
+	Hamming_Index(const Hamming_Index& other) = delete;
+	Hamming_Index& operator=(const Hamming_Index& other) = delete;
+
+	/** Adds a hash and matches it against every hash added before or alongside it, can be called from several threads
+	 *	@param id id of the hash, only added once
+	 *	@param hash the hash
+	 */
+	void add(std::size_t id, uint64_t hash);
+
+	/** @return largest distance between two hashes that are matched */
+	unsigned int get_max_distance() const;
+
+	/** @return number of hashes added */
+	std::size_t size();
+
+	/** @return every pair found so far, each once */
+	std::vector<Hamming_Match> get_matches();
+
+private:
+	struct Entry {
+		uint64_t hash;
+		std::size_t id;
+	};
+
+	struct Shard {
+		Shard() : buckets(), mutex() {}
+		std::unordered_map<uint64_t, std::vector<Entry>> buckets; // <value of the band, hashes with it>
+		std::shared_mutex mutex;
+	};
+
+	static constexpr unsigned int SHARDS = 16;
+
+	/** Largest number of bands, narrower bands match too many hashes to be worth it */
+	static constexpr unsigned int MAX_BANDS = 16;
+
+	uint64_t get_band(uint64_t hash, unsigned int band) const;
+	Shard& get_shard(unsigned int band, uint64_t value);
+
+	unsigned int _max_distance;
+	std::vector<unsigned int> _band_offsets; // first bit of every band, then one past the last band
+	std::unique_ptr<Shard[]> _shards; // SHARDS shards for every band
+	std::vector<Hamming_Match> _matches;
+	std::size_t _size;
+	std::mutex _matches_mutex;
+};
+
+#endif //__PCOLL_HAMMING_INDEX__
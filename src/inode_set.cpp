@@ -0,0 +1,41 @@
+#include "inode_set.hpp"
+
+#include <functional>
+
+Inode_Set::Inode_Set() :
+	_shards()
+{}
+
+std::size_t Inode_Set::Key_Hash::operator()(const Key& key) const{
+	return std::hash<unsigned long long int>()((unsigned long long int)key.second * 0x9E3779B97F4A7C15ULL ^ (unsigned long long int)key.first);
+}
+
+Inode_Set::Shard& Inode_Set::get_shard(const Key& key){
+	return _shards[Key_Hash()(key) % SHARDS];
+}
+
+bool Inode_Set::visit_directory(dev_t device, ino_t inode){
+	Key key(device, inode);
+	Shard& shard = get_shard(key);
+	std::unique_lock<std::mutex> lock(shard.mutex);
+	return shard.directories.insert(key).second;
+}
+
+bool Inode_Set::visit_file(dev_t device, ino_t inode, const std::string& path){
+	Key key(device, inode);
+	Shard& shard = get_shard(key);
+	std::unique_lock<std::mutex> lock(shard.mutex);
+	auto result = shard.files.emplace(key, path);
+	if(result.second) return true;
+	shard.aliases.push_back(std::make_pair(path, result.first->second));
+	return false;
+}
+
+std::list<std::pair<std::string, std::string>> Inode_Set::get_aliases(){
+	std::list<std::pair<std::string, std::string>> aliases;
+	for(auto& shard : _shards){
+		std::unique_lock<std::mutex> lock(shard.mutex);
+		aliases.insert(aliases.end(), shard.aliases.begin(), shard.aliases.end());
+	}
+	return aliases;
+}
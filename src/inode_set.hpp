@@ -0,0 +1,55 @@
+#ifndef __PCOLL_INODE_SET__
+#define __PCOLL_INODE_SET__
+
+#include <utility>
+#include <string>
+#include <list>
+#include <unordered_set>
+#include <unordered_map>
+#include <mutex>
+#include <sys/types.h>
+
+/** Remembers the directories and files a walk has already reached, by device and inode
+ *	Hardlinks, bind mounts and symlinked directories lead to the same inode under other paths.
+ *	Only the first path is walked or read, files reached again are kept as aliases of it.
+ *	The inodes are split into shards with a lock each, so walkers rarely wait on one another.
+ */
+class Inode_Set {
+public:
+	Inode_Set();
+	Inode_Set(const Inode_Set& other) = delete;
+	Inode_Set& operator=(const Inode_Set& other) = delete;
+
+	/** @return true if the directory was not reached before and should be walked */
+	bool visit_directory(dev_t device, ino_t inode);
+
+	/** @param path path the file was reached by
+	 *	@return true if the file was not reached before and should be read, otherwise the path is kept as an alias
+	 */
+	bool visit_file(dev_t device, ino_t inode, const std::string& path);
+
+	/** @return every path a file was reached by again, with the first path to that file */
+	std::list<std::pair<std::string, std::string>> get_aliases();
+
+private:
+	typedef std::pair<dev_t, ino_t> Key;
+	struct Key_Hash {
+		std::size_t operator()(const Key& key) const;
+	};
+
+	struct Shard {
+		Shard() : directories(), files(), aliases(), mutex() {}
+		std::unordered_set<Key, Key_Hash> directories;
+		std::unordered_map<Key, std::string, Key_Hash> files; // <inode, first path>
+		std::list<std::pair<std::string, std::string>> aliases; // <alias, first path>
+		std::mutex mutex;
+	};
+
+	static constexpr unsigned int SHARDS = 64;
+
+	Shard& get_shard(const Key& key);
+
+	Shard _shards[SHARDS];
+};
+
+#endif //__PCOLL_INODE_SET__
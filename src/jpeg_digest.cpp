@@ -0,0 +1,106 @@
+#include "jpeg_digest.hpp"
+#include "utility.hpp"
+
+#include <cstring>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+using std::string;
+
+/** Markers */
+static const unsigned char MARKER_SOI = 0xD8; // start of image
+static const unsigned char MARKER_EOI = 0xD9; // end of image
+static const unsigned char MARKER_SOS = 0xDA; // start of scan
+static const unsigned char MARKER_COM = 0xFE; // comment
+static const unsigned char MARKER_APP0 = 0xE0;
+static const unsigned char MARKER_APP14 = 0xEE; // Adobe, tells how the colors were transformed so it changes the picture
+static const unsigned char MARKER_APP15 = 0xEF;
+static const unsigned char MARKER_RST0 = 0xD0; // restart markers inside a scan
+static const unsigned char MARKER_RST7 = 0xD7;
+static const unsigned char MARKER_TEM = 0x01;
+
+bool Jpeg_Digest::is_jpeg(const char* data, unsigned long int size){
+	const unsigned char* bytes = reinterpret_cast<const unsigned char*>(data);
+	return size >= 3 && bytes[0] == 0xFF && bytes[1] == MARKER_SOI && bytes[2] == 0xFF;
+}
+
+bool Jpeg_Digest::get_image_ranges(const char* data, unsigned long int size, std::vector<std::pair<unsigned long int, unsigned long int>>& ranges){
+	const unsigned char* bytes = reinterpret_cast<const unsigned char*>(data);
+	if(!is_jpeg(data, size)) return false;
+	ranges.push_back(std::make_pair(0UL, 2UL));
+
+	unsigned long int position = 2;
+	while(position < size){
+		if(bytes[position] != 0xFF) return false;
+
+		// Any number of fill bytes may come before a marker
+		while(position + 1 < size && bytes[position + 1] == 0xFF) position++;
+		if(position + 1 >= size) return false;
+		unsigned char marker = bytes[position + 1];
+		unsigned long int start = position;
+		position += 2;
+
+		// Markers without a segment
+		if(marker == MARKER_EOI){
+			ranges.push_back(std::make_pair(start, 2UL));
+			return true;
+		}
+		if((marker >= MARKER_RST0 && marker <= MARKER_RST7) || marker == MARKER_TEM){
+			ranges.push_back(std::make_pair(start, 2UL));
+			continue;
+		}
+
+		// The length of a segment counts its own two bytes
+		if(position + 2 > size) return false;
+		unsigned long int length = (bytes[position] << 8) | bytes[position + 1];
+		if(length < 2 || position + length > size) return false;
+		position += length;
+
+		// Leave out the metadata
+		bool metadata = (marker >= MARKER_APP0 && marker <= MARKER_APP15 && marker != MARKER_APP14) || marker == MARKER_COM;
+		if(!metadata) ranges.push_back(std::make_pair(start, position - start));
+
+		// Entropy-coded data follows a scan header up to the next marker that is not a stuffed byte or a restart
+		if(marker == MARKER_SOS){
+			unsigned long int scan = position;
+			while(true){
+				const void* found = std::memchr(bytes + position, 0xFF, size - position);
+				if(found == nullptr) return false;
+				position = static_cast<const unsigned char*>(found) - bytes;
+				if(position + 1 >= size) return false;
+				unsigned char next = bytes[position + 1];
+				if(next != 0x00 && !(next >= MARKER_RST0 && next <= MARKER_RST7)) break;
+				position += 2;
+			}
+			ranges.push_back(std::make_pair(scan, position - scan));
+		}
+	}
+
+	// Cut off before the end of the image
+	return false;
+}
+
+File_Checksum* Jpeg_Digest::compute_hash(const string& path, const char* data, unsigned long int size){
+	std::vector<std::pair<unsigned long int, unsigned long int>> ranges;
+	if(data != nullptr) return get_image_ranges(data, size, ranges) ? File_Checksum::compute_hash_by_ranges(data, ranges) : nullptr;
+
+	// Map the file, only the image is read through
+	int fd = Utility::open_file(path);
+	if(fd < 0) throw Pexception("Cannot open file '" + path + "'!");
+	struct stat file_stat;
+	if(fstat(fd, &file_stat) != 0 || file_stat.st_size == 0){
+		close(fd);
+		return nullptr;
+	}
+	void* map = mmap(nullptr, file_stat.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+	if(map == MAP_FAILED) throw Pexception("Cannot map file '" + path + "'!");
+	madvise(map, file_stat.st_size, MADV_SEQUENTIAL);
+
+	const char* contents = static_cast<const char*>(map);
+	File_Checksum* checksum = nullptr;
+	if(get_image_ranges(contents, file_stat.st_size, ranges)) checksum = File_Checksum::compute_hash_by_ranges(contents, ranges);
+	munmap(map, file_stat.st_size);
+	return checksum;
+}
@@ -0,0 +1,37 @@
+#ifndef __PCOLL_JPEG_DIGEST__
+#define __PCOLL_JPEG_DIGEST__
+
+#include <string>
+#include <vector>
+#include <utility>
+
+#include "filechecksum.hpp"
+
+/** Checksums the image of a JPEG without its metadata
+ *	Walks the segments of the file and leaves out the APPn and COM segments that hold EXIF, XMP, IPTC,
+ *	ICC profiles and comments, so copies that were only re-tagged get the same checksum. The frame
+ *	headers, tables and entropy-coded scans that make up the picture are checksummed in file order.
+ */
+class Jpeg_Digest {
+public:
+	/** @return true if the data starts like a JPEG */
+	static bool is_jpeg(const char* data, unsigned long int size);
+
+	/** Lists the parts of a JPEG that make up its image
+	 *	@param data file contents
+	 *	@param size size of the file contents
+	 *	@param ranges receives the offset and length of every part, in file order
+	 *	@return false if the file is not a complete JPEG
+	 */
+	static bool get_image_ranges(const char* data, unsigned long int size, std::vector<std::pair<unsigned long int, unsigned long int>>& ranges);
+
+	/** Computes the checksum of the image of a JPEG
+	 *	@param path path of the file, read if data is nullptr
+	 *	@param data file contents, or nullptr
+	 *	@param size size of the file contents
+	 *	@return the checksum, nullptr if the file is not a complete JPEG
+	 */
+	static File_Checksum* compute_hash(const std::string& path, const char* data, unsigned long int size);
+};
+
+#endif //__PCOLL_JPEG_DIGEST__
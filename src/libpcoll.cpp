@@ -0,0 +1,102 @@
+#include "libpcoll.hpp"
+#include "pcoll.hpp"
+#include "pcoll_database.hpp"
+
+#include <mutex>
+#include <chrono>
+#include <thread>
+
+using std::string;
+using std::this_thread::sleep_for;
+using std::chrono::milliseconds;
+
+Pcoll_Library::Pcoll_Library(unsigned int num_threads) :
+	_num_threads(num_threads == 0 ? Utility::get_default_cores_count() : num_threads),
+	_db(std::make_unique<Pcoll_Database>())
+{}
+
+Pcoll_Library::~Pcoll_Library(){}
+
+void Pcoll_Library::set_memory_budget(unsigned long int budget){
+	_db->set_memory_budget(budget);
+}
+
+void Pcoll_Library::set_top_k(unsigned int top_k){
+	_db->set_top_k(top_k);
+}
+
+std::list<std::pair<string, string>> Pcoll_Library::insert(const std::vector<Pcoll_Buffer>& buffers){
+	std::list<std::pair<string, string>> errors;
+	std::mutex errors_mutex;
+
+	// Positions of the buffers left to insert
+	Task_Queue<std::size_t> buffer_queue;
+	for(std::size_t i = 0; i < buffers.size(); i++) buffer_queue.insert(i);
+
+	Pcoll::run_threads(_num_threads, [&](){
+		while(buffer_queue.task_count() != 0){
+
+			// Take buffers, as many as the checksum can hash at once
+			std::vector<const Pcoll_Buffer*> batch;
+			while(batch.size() < File_Checksum::get_batch_size()){
+				try{
+					const Pcoll_Buffer& buffer = buffers[buffer_queue.poll()];
+					if(_db->contains(buffer.id)) buffer_queue.decrement_task_count();
+					else batch.push_back(&buffer);
+				}catch(Pexception& pe){ break; }
+			}
+			if(batch.empty()){
+				sleep_for(milliseconds(10)); // Relax for a bit
+				continue;
+			}
+
+			// Hash the batch together straight from the caller's memory
+			std::vector<std::pair<const char*, unsigned long int>> contents;
+			for(auto& buffer : batch) contents.push_back(std::make_pair(buffer->data, buffer->size));
+			std::vector<File_Checksum*> hashes = File_Checksum::compute_hash_by_buffers(contents);
+
+			for(std::size_t i = 0; i < batch.size(); i++){
+				try{
+					_db->insert(batch[i]->id, batch[i]->data, batch[i]->size, 0, hashes[i], 0);
+				}catch(Pexception& pe){
+					std::unique_lock<std::mutex> lock(errors_mutex);
+					errors.push_back(std::make_pair(batch[i]->id, string(pe.what())));
+				}
+				_db->get_counters().files_done++;
+				buffer_queue.decrement_task_count();
+			}
+		}
+	});
+
+	return errors;
+}
+
+std::vector<std::pair<std::string_view, float>> Pcoll_Library::find_neighbors(const string& id, float percentage){
+	std::vector<std::pair<std::string_view, float>> neighbors;
+	for(auto& neighbor : _db->find_neighbors(id, percentage))
+		neighbors.push_back(std::make_pair(std::string_view(*neighbor.first), neighbor.second));
+	return neighbors;
+}
+
+Result_View Pcoll_Library::compile(float percentage){
+	return _db->compile_similarity_view(true, percentage, _num_threads, Comparison_Scope::ALL);
+}
+
+void Pcoll_Library::export_results(const Result_View& results, std::ostream& output){
+	for(auto group : results){
+		for(auto& edge : group)
+			output << group.path() << '\t' << results.get_path(edge.file) << '\t' << edge.similarity << '\n';
+	}
+}
+
+void Pcoll_Library::save_index(const string& index_path){
+	_db->save_index(index_path);
+}
+
+void Pcoll_Library::load_index(const string& index_path){
+	_db->load_index(index_path, 0);
+}
+
+unsigned int Pcoll_Library::size(){
+	return _db->size();
+}
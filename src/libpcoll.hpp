@@ -0,0 +1,96 @@
+#ifndef __PCOLL_LIBPCOLL__
+#define __PCOLL_LIBPCOLL__
+
+#include <string>
+#include <string_view>
+#include <vector>
+#include <list>
+#include <utility>
+#include <ostream>
+#include <memory>
+
+#include "result_view.hpp"
+
+class Pcoll_Database;
+
+/** A file held in memory by the caller
+ *	The contents are digested in place and must stay valid until insert() returns. An image is copied
+ *	once into an in-memory file for OpenImageIO to decode, nothing else is copied.
+ */
+struct Pcoll_Buffer {
+	Pcoll_Buffer() : id(), data(nullptr), size(0) {}
+	Pcoll_Buffer(const std::string& id, const char* data, unsigned long int size) : id(id), data(data), size(size) {}
+	Pcoll_Buffer(const Pcoll_Buffer& other) = default;
+	Pcoll_Buffer& operator=(const Pcoll_Buffer& other) = default;
+	std::string id; // name of the file, unique in the library, its extension picks the image format
+	const char* data; // file contents
+	unsigned long int size; // size of the file contents
+};
+
+/** Embeddable entry point of pcoll
+ *	Files are inserted straight from memory in batches, then compared against each other or queried
+ *	one at a time. Results refer to the library's database, so the library must outlive them. The
+ *	database is kept out of this header so users only see pcoll types.
+ */
+class Pcoll_Library {
+public:
+	/** @param num_threads number of threads digesting, decoding and comparing, zero for one per core */
+	Pcoll_Library(unsigned int num_threads);
+	~Pcoll_Library();
+	Pcoll_Library(const Pcoll_Library& other) = delete;
+	Pcoll_Library& operator=(const Pcoll_Library& other) = delete;
+
+	/** Limits the memory taken by image decodes at once
+	 *	@param budget bytes, zero for no limit
+	 */
+	void set_memory_budget(unsigned long int budget);
+
+	/** Limits every image to its closest similar images in compile()
+	 *	@param top_k most similar images kept per image, zero for every image above the percentage
+	 */
+	void set_top_k(unsigned int top_k);
+
+	/** Digests and hashes a batch of files held in memory
+	 *	@param buffers the files, ids that are already in the library are skipped
+	 *	@return id and error message of every file that could not be inserted
+	 */
+	std::list<std::pair<std::string, std::string>> insert(const std::vector<Pcoll_Buffer>& buffers);
+
+	/** Finds the files similar to one inserted file
+	 *	@param id id of the file
+	 *	@param percentage minimum similarity percentage
+	 *	@return ids of the similar files and their similarity, most similar first, the ids belong to the library
+	 */
+	std::vector<std::pair<std::string_view, float>> find_neighbors(const std::string& id, float percentage);
+
+	/** Compares every inserted file against every other one
+	 *	@param percentage minimum similarity percentage
+	 *	@return every group of similar files
+	 */
+	Result_View compile(float percentage);
+
+	/** Writes results as tab separated lines of id, similar id and similarity
+	 *	@param results results of compile()
+	 *	@param output where to write
+	 */
+	static void export_results(const Result_View& results, std::ostream& output);
+
+	/** Saves every inserted file to an index file
+	 *	@param index_path path of the index file
+	 */
+	void save_index(const std::string& index_path);
+
+	/** Adds the entries of an index file
+	 *	@param index_path path of the index file
+	 */
+	void load_index(const std::string& index_path);
+
+	/** @return number of inserted files */
+	unsigned int size();
+
+private:
+	unsigned int _num_threads;
+	std::unique_ptr<Pcoll_Database> _db;
+};
+
+#endif //__PCOLL_LIBPCOLL__
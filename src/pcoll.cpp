@@ -1,39 +1,184 @@
 #include "pcoll.hpp"
 
-#include <sstream>
 #include <chrono>
 #include <thread>
 #include <memory>
-#include <regex>
+#include <vector>
+#include <algorithm>
+#include <sstream>
+#include <sys/stat.h>
 
 using std::this_thread::sleep_for;
 using std::chrono::milliseconds;
 
-Results Pcoll::find_similar_images(std::list<string>& directories, std::unordered_set<string>& exclude, bool quiet, float percentage, unsigned int num_threads){
+static const unsigned long int MAX_BUFFERED_BYTES = 256UL * 1024 * 1024;
+static const milliseconds PROGRESS_INTERVAL(250);
+static const milliseconds CONTROL_INTERVAL(1000);
+
+/** Workers started per core in adaptive mode, the extra ones wait on disks */
+static const unsigned int ADAPTIVE_WORKERS_PER_CORE = 2;
+
+void Pcoll::run_threads(unsigned int num_threads, const std::function<void()>& function){
+
+	// Create threads
+	std::list<std::unique_ptr<std::thread>> threads;
+	for(unsigned int i = 0; i < num_threads-1; i++){
+		std::unique_ptr<std::thread> thread = std::make_unique<std::thread>(function);
+		threads.push_back(std::move(thread));
+	}
+
+	// Run on main thread
+	function();
+
+	// Join all threads if theres any
+	for(auto& thread : threads)
+		thread->join();
+}
+
+Result_View Pcoll::find_similar_images(std::list<string>& directories, Pcoll_Options& options, Pcoll_Database& db){
 
 	// Fix if zero
-	if(num_threads == 0) num_threads = 1;
+	if(options.num_threads == 0) options.num_threads = 1;
+	bool quiet = options.quiet;
+
+	// Roots inside other roots are walked as part of them
+	std::list<string> roots = collapse_roots(directories);
 
 	// Queues
 	Task_Queue<string> path_queue;
-	Task_Queue<string> file_queue;
+	Device_Queues file_queue;
+	file_queue.set_rotational(options.hdd);
 
-	// Database
-	Pcoll_Database db;
+	// Bound the neighbors kept per image
+	db.set_top_k(options.top_k);
+	db.set_distance_store(options.distance_store_path);
+	db.set_thumbnail_store(options.thumbnail_store_path, false);
 
-	// Build the initial path queue
-	for(auto& directory : directories){
-		// Poll in the queue
-		path_queue.insert(Utility::try_to_convert_to_absolute_path(directory));
+	// Compare while the disks are busy, update mode only compares against the latest volume afterwards
+	db.set_online_comparison(options.online && options.update_index_path.empty(), options.percentage);
+
+	// Decode one of the JPEGs that only differ in their metadata
+	db.set_content_digests(options.jpeg_content);
+
+	// Read blocking keys from the image headers
+	db.set_blocking(options.blocking);
+
+	// Hash tiles of every image to find crops
+	db.set_tile_matching(options.tiles);
+
+	// Split the memory budget between buffered file contents and image decodes
+	unsigned long int buffered_bytes = MAX_BUFFERED_BYTES;
+	if(options.memory_budget != 0){
+		buffered_bytes = std::min(buffered_bytes, options.memory_budget / 4);
+		db.set_memory_budget(options.memory_budget - buffered_bytes);
+	}
+
+	// In update mode, start from the prior index and put newly scanned files in the next volume
+	unsigned int volume = 0;
+	if(!options.update_index_path.empty()){
+		if(!quiet) Utility::sout.println("Loading index " + Utility::try_to_normalize_path(options.update_index_path));
+		db.load_index(options.update_index_path, volume++, true, false);
+	}
+	unsigned int indexed_count = db.size();
+
+	// Continue from the checkpoint of an interrupted run of the same scan, its files are not read again
+	std::unique_ptr<Checkpoint> checkpoint;
+	std::list<string> found_files;
+	std::list<std::pair<string, string>> found_aliases; // <alias, first path>
+	bool walked = false;
+	if(!options.checkpoint_path.empty()){
+		checkpoint = std::make_unique<Checkpoint>(options.checkpoint_path, get_scan_signature(roots, options));
+		if(checkpoint->open(options.resume, Pcoll_Database::get_index_header())){
+			if(!quiet) Utility::sout.println("Resuming from checkpoint " + Utility::try_to_normalize_path(options.checkpoint_path));
+			// The log holds no tile hashes, its images are decoded again for them
+			db.load_index(checkpoint->get_log_path(), volume, true, options.tiles);
+			walked = checkpoint->load_files(found_files, found_aliases);
+		}
+		db.set_insert_log([&](const string& entry){ checkpoint->record(entry); });
+	}
+
+	// Hardlinks, bind mounts and overlapping roots reach the same inodes more than once, they are only read once
+	Inode_Set inodes;
+
+	// Saves the files found once the walk is done
+	auto save_walk = [&](){
+		if(!checkpoint || path_queue.task_count() != 0) return;
+		try{ checkpoint->save_files(inodes.get_aliases());
+		}catch(Pexception& pe){
+			Utility::sout.printerrln(pe.what());
+		}
+	};
+
+	// Report progress from a thread of its own
+	Progress_Counters& counters = db.get_counters();
+	std::unique_ptr<Progress_Reporter> reporter;
+	if(!quiet) reporter = std::make_unique<Progress_Reporter>(counters, PROGRESS_INTERVAL);
+
+	// Decide which paths are read while walking, globs with a relative directory are relative to the working directory
+	File_Filter filter;
+	for(auto& directory : options.exclude) filter.exclude_directory(Utility::try_to_convert_to_absolute_path(directory));
+	auto absolute_glob = [](const string& glob) -> string {
+		return glob.find('/') == string::npos || glob[0] == '*' ? glob : Utility::try_to_convert_to_absolute_path(glob);
+	};
+	for(auto& glob : options.includes) filter.add_include(absolute_glob(glob));
+	for(auto& glob : options.excludes) filter.add_exclude(absolute_glob(glob));
+	filter.set_images_only(options.images_only);
+	filter.set_archives(options.archives);
+
+	// Build the initial path queue, or queue the files of a walk that already finished
+	if(walked){
+		for(auto& file : found_files) file_queue.insert(file);
+		counters.files_found += found_files.size();
+		found_files.clear();
+	}else{
+		for(auto& root : roots){
+			// Poll in the queue
+			path_queue.insert(root);
+		}
+	}
+
+	// In HDD mode, walk everything first and read the files in the order they sit on disk
+	if(options.hdd){
+		run_threads(options.num_threads, [&](){
+			while(path_queue.task_count() != 0){
+				if(!process_path(quiet, path_queue, filter, inodes, file_queue, counters, checkpoint.get()))
+					sleep_for(milliseconds(10)); // Relax for a bit
+			}
+		});
+		save_walk();
+		if(!quiet) Utility::sout.println("Ordering " + std::to_string(file_queue.task_count()) + " files by disk position");
+		Disk_Order::sort(file_queue, options.num_threads);
 	}
 
+	// Asynchronous reader that hands whole files to the workers
+	std::unique_ptr<File_Reader> reader;
+	if(options.io_depth != 0) reader = std::make_unique<File_Reader>(options.io_depth, buffered_bytes);
+
+	// In adaptive mode more workers are started than there are cores, a controller decides how many of them work
+	unsigned int num_workers = options.num_threads;
+	std::unique_ptr<Concurrency_Controller> controller;
+	if(options.adaptive){
+		num_workers = options.num_threads * ADAPTIVE_WORKERS_PER_CORE;
+		controller = std::make_unique<Concurrency_Controller>(counters, options.num_threads, num_workers, Utility::get_memory_limit(), CONTROL_INTERVAL);
+	}
+	std::atomic<unsigned int> next_worker(0);
+
 	// Build the thread function
 	auto thread_function = [&](){
+		unsigned int worker = next_worker++;
 
 		// Finish all tasks
 		while(path_queue.task_count() != 0 || file_queue.task_count() != 0){
-			bool path = process_path(quiet, path_queue, exclude, file_queue);
-			bool image = process_file(quiet, file_queue, db);
+
+			// Wait while the controller holds this worker back
+			if(controller && !controller->is_active(worker)){
+				sleep_for(milliseconds(10)); // Relax for a bit
+				continue;
+			}
+
+			bool path = process_path(quiet, path_queue, filter, inodes, file_queue, counters, checkpoint.get());
+			if(path) save_walk();
+			bool image = reader ? process_buffer(file_queue, *reader, filter, buffered_bytes, db, volume) : process_file(file_queue, filter, buffered_bytes, db, volume);
 
 			// If nothing is in the queue, wait a bit for other threads to populate it
 			if(!path && !image)
@@ -41,46 +186,170 @@ Results Pcoll::find_similar_images(std::list<string>& directories, std::unordere
 		}
 	};
 
-	// Create threads
-	std::list<std::unique_ptr<std::thread>> threads;
-	for(unsigned int i = 0; i < num_threads-1; i++){
-		std::unique_ptr<std::thread> thread = std::make_unique<std::thread>(thread_function);
-		threads.push_back(std::move(thread));
+	run_threads(num_workers, thread_function);
+	controller.reset();
+	reader.reset();
+	reporter.reset();
+
+	// Paths to files that were already found share the checksum of the first path without being read, a saved walk brings its own
+	std::list<std::pair<string, string>> aliases = inodes.get_aliases();
+	aliases.splice(aliases.end(), found_aliases);
+	for(auto& alias : aliases){
+		try{ db.insert_alias(alias.first, alias.second, volume);
+		}catch(Pexception& pe){
+			if(!quiet) Utility::sout.printerrln(pe.what());
+		}
+	}
+	if(!quiet && !aliases.empty())
+		Utility::sout.println("Added " + std::to_string(aliases.size()) + " paths to files that were already found without reading them");
+	db.set_insert_log(nullptr);
+	if(checkpoint) checkpoint->flush();
+
+	// Confirm exact groups when the checksum can't be trusted on its own
+	if(options.verify){
+		if(!quiet) Utility::sout.println("Verifying exact duplicates");
+		db.verify_exact_groups(quiet, options.num_threads);
 	}
 
-	// Run on main thread
-	thread_function();
+	// Reclaim the space of exact duplicates
+	if(options.dedupe){
+		if(!quiet) Utility::sout.println("Deduplicating exact duplicates");
+		Dedupe_Engine engine(options.dedupe_method, options.dry_run, options.journal_path);
+		Dedupe_Summary summary = engine.run(db.get_exact_groups(), quiet, options.num_threads);
+		if(!quiet){
+			Utility::sout.println((options.dry_run ? "Would deduplicate " : "Deduplicated ") + std::to_string(summary.files) + " files, reclaiming " +
+				std::to_string(summary.bytes) + " bytes, " + std::to_string(summary.failures) + " left alone");
+		}
+	}
 
-	// Join all threads if theres any
-	for(auto& thread : threads)
-		thread->join();
+	// Save the index if requested, update mode folds the new entries back into its index
+	if(!options.index_path.empty()) db.save_index(options.index_path);
+	else if(!options.update_index_path.empty()) db.save_index(options.update_index_path);
+
+	// Update mode only compares the new files against the index and against each other
+	Result_View results;
+	if(options.update_index_path.empty())
+		results = db.compile_similarity_view(quiet, options.percentage, options.num_threads, Comparison_Scope::ALL);
+	else if(db.size() != indexed_count)
+		results = db.compile_similarity_view(quiet, options.percentage, options.num_threads, Comparison_Scope::LATEST_VOLUME);
+
+	// The scan finished, nothing left to resume
+	if(checkpoint) checkpoint->remove();
+
+	return results;
+}
+
+string Pcoll::get_scan_signature(const std::list<string>& directories, const Pcoll_Options& options){
+	std::ostringstream signature;
+	for(auto& directory : directories) signature << Utility::try_to_convert_to_absolute_path(directory) << '\n';
+	std::vector<string> exclude(options.exclude.begin(), options.exclude.end());
+	std::sort(exclude.begin(), exclude.end());
+	for(auto& directory : exclude) signature << "-n " << directory << '\n';
+	for(auto& glob : options.includes) signature << "--include " << glob << '\n';
+	for(auto& glob : options.excludes) signature << "--exclude " << glob << '\n';
+	signature << options.images_only << options.archives << options.tiles;
+	return std::to_string(std::hash<string>()(signature.str()));
+}
+
+std::list<string> Pcoll::collapse_roots(const std::list<string>& directories){
+
+	// Spell every root the same way, without '.', '..' or repeated separators
+	std::list<string> normalized;
+	for(auto& directory : directories){
+		std::vector<string> names;
+		for(auto& part : filesystem::path(Utility::try_to_convert_to_absolute_path(directory))){
+			string name = part.string();
+			if(name.empty() || name == "." || name == "/") continue;
+			if(name != "..") names.push_back(name);
+			else if(!names.empty()) names.pop_back();
+		}
+		string root;
+		for(auto& name : names) root += "/" + name;
+		normalized.push_back(root.empty() ? "/" : root);
+	}
 
-	return db.compile_similarity_results(quiet, percentage, num_threads);;
+	// Drop roots that were given twice or that sit inside another root
+	std::unordered_set<string> given(normalized.begin(), normalized.end());
+	std::unordered_set<string> kept;
+	std::list<string> roots;
+	for(auto& root : normalized){
+		bool nested = root != "/" && given.count("/") != 0;
+		for(std::size_t end = root.find('/', 1); !nested && end != string::npos; end = root.find('/', end + 1))
+			nested = given.count(root.substr(0, end)) != 0;
+		if(!nested && kept.insert(root).second) roots.push_back(root);
+	}
+	return roots;
 }
 
-bool Pcoll::process_path(bool quiet, Task_Queue<std::string>& path_queue, std::unordered_set<string>& exclude, Task_Queue<std::string>& file_queue){
+Result_View Pcoll::merge_indexes(std::list<string>& indexes, Pcoll_Options& options, Pcoll_Database& db){
+
+	// Fix if zero
+	if(options.num_threads == 0) options.num_threads = 1;
+
+	// Bound the neighbors kept per image
+	db.set_top_k(options.top_k);
+	db.set_distance_store(options.distance_store_path);
+	db.set_thumbnail_store(options.thumbnail_store_path, true);
+
+	// Load every index into its own volume
+	unsigned int volume = 0;
+	for(auto& index : indexes){
+		if(!options.quiet) Utility::sout.println("Loading index " + Utility::try_to_normalize_path(index));
+		db.load_index(index, volume++);
+	}
+
+	// Save the merged index if requested
+	if(!options.index_path.empty()) db.save_index(options.index_path);
+
+	return db.compile_similarity_view(options.quiet, options.percentage, options.num_threads, Comparison_Scope::CROSS_VOLUME);
+}
+
+Result_View Pcoll::report_index(const string& index, Pcoll_Options& options, Pcoll_Database& db){
+
+	// Fix if zero
+	if(options.num_threads == 0) options.num_threads = 1;
+
+	db.set_top_k(options.top_k);
+	db.set_distance_store(options.distance_store_path);
+	db.set_thumbnail_store(options.thumbnail_store_path, true);
+
+	if(!options.quiet) Utility::sout.println("Loading index " + Utility::try_to_normalize_path(index));
+	db.load_index(index, 0);
+
+	return db.compile_similarity_view(options.quiet, options.percentage, options.num_threads, Comparison_Scope::ALL);
+}
+
+bool Pcoll::process_path(bool quiet, Task_Queue<std::string>& path_queue, const File_Filter& filter, Inode_Set& inodes, Device_Queues& file_queue, Progress_Counters& counters, Checkpoint* checkpoint){
 
 	// Get path from the queue
 	string path_string;
 	try{ path_string = path_queue.poll();
 	}catch(Pexception& perr){ return false; }
 
-	// Convert to path object to use filesystem API
-	filesystem::path path(path_string);
-
-	// If element is a directory, add items inside the directory to the queue
-	if(filesystem::is_directory(path)){
-
-		// Iterate through the directory
-		for(filesystem::path file : filesystem::directory_iterator(path)){
-			// Check if path is part of excluded directory set
-			if(exclude.find(file.string()) == exclude.end())
-				path_queue.insert(file.string());
+	// Symlinked directories are followed, symlinked files are not
+	struct stat info;
+	bool found = lstat(path_string.c_str(), &info) == 0;
+	bool symlink = found && S_ISLNK(info.st_mode);
+	if(symlink) found = stat(path_string.c_str(), &info) == 0;
+
+	// If element is a directory, add items inside the directory to the queue, unless another path already reached it
+	if(found && S_ISDIR(info.st_mode)){
+		if(inodes.visit_directory(info.st_dev, info.st_ino)){
+
+			// Iterate through the directory
+			for(filesystem::path file : filesystem::directory_iterator(filesystem::path(path_string))){
+				// Skip excluded directories and files without looking into them
+				if(!filter.is_excluded(file.string()))
+					path_queue.insert(file.string());
+			}
+		}
+	}else if(found && S_ISREG(info.st_mode) && !symlink){
+		// Drop files that are not wanted before they are read, whether it is an image that can be read is decided later
+		if(filter.is_candidate(path_string) && inodes.visit_file(info.st_dev, info.st_ino, path_string)){
+			if(checkpoint) checkpoint->add_file(path_string);
+			file_queue.insert(path_string, info.st_dev);
+			counters.files_found++;
 		}
-	}else if(filesystem::is_regular_file(path) && !filesystem::is_symlink(path)){
-		// Need to verify if this file is actually an image and can be read
-		// for now, just put in queue
-		file_queue.insert(path_string);
 
 	}else if(!quiet) Utility::sout.printerrln(path_string);
 
@@ -90,47 +359,104 @@ bool Pcoll::process_path(bool quiet, Task_Queue<std::string>& path_queue, std::u
 	return true;
 }
 
-bool Pcoll::process_file(bool quiet, Task_Queue<std::string>& file_queue, Pcoll_Database& db){
+bool Pcoll::process_file(Device_Queues& file_queue, const File_Filter& filter, unsigned long int max_member_size, Pcoll_Database& db, unsigned int volume){
 
 	// Get path from the queue
 	string path_string;
 	try{ path_string = file_queue.poll();
 	}catch(Pexception& perr){ return false; }
 
-	// Print statistics
-	if(!quiet) print_progress(path_string, db);
-
-	// Insert into database
+	// Insert into database, files that are already indexed and unchanged are skipped
 	try{
-		db.insert(path_string);
+		if(filter.is_archive(path_string)) process_archive(path_string, filter, max_member_size, db, volume);
+		else if(!db.contains(path_string)) db.insert(path_string, volume);
 	}catch(Pexception& pe){
 		Utility::sout.printerrln(pe.what());
 	}
 
 	// Update the task count
+	db.get_counters().files_done++;
+	file_queue.finish(path_string);
 	file_queue.decrement_task_count();
 
 	return true;
 }
 
+bool Pcoll::process_buffer(Device_Queues& file_queue, File_Reader& reader, const File_Filter& filter, unsigned long int max_member_size, Pcoll_Database& db, unsigned int volume){
+
+	// Hand every queued path to the reader, files that are already indexed and unchanged are skipped
+	while(true){
+		string path_string;
+		try{ path_string = file_queue.poll();
+		}catch(Pexception& perr){ break; }
+
+		// Archives are read member by member on this thread instead
+		bool archive = filter.is_archive(path_string);
+		if(archive){
+			try{ process_archive(path_string, filter, max_member_size, db, volume);
+			}catch(Pexception& pe){
+				Utility::sout.printerrln(pe.what());
+			}
+		}
 
-void Pcoll::print_progress(const string& path, Pcoll_Database& db){
-	// Try to normalize the input path string
-	/*
-	string search = filesystem::current_path().string();
-    search += "/";
-    search = std::regex_replace(path, std::regex(search), "");
-	*/
-	string search = Utility::try_to_normalize_path(path);
+		if(archive || db.contains(path_string)){
+			db.get_counters().files_done++;
+			file_queue.finish(path_string);
+			file_queue.decrement_task_count();
+		}else reader.submit(path_string);
+	}
 
-	// Build the string
-	std::stringstream ss;
-	ss << " total: " << db.size();
-	ss << "  file path being searched: " << search;
+	// Get files that have been read, as many as the checksum can hash at once
+	std::vector<File_Buffer*> buffers;
+	while(buffers.size() < File_Checksum::get_batch_size()){
+		try{ buffers.push_back(reader.poll());
+		}catch(Pexception& perr){ break; }
 
-	// Convert to string
-	search = ss.str();
+		// Read, the device can take another one while this one is hashed
+		file_queue.finish(buffers.back()->path);
+	}
+	if(buffers.empty()) return false;
 
-	// Put the string to output
-	Utility::sout.print(search);
+	// Hash the files that were read successfully together
+	std::vector<std::pair<const char*, unsigned long int>> contents;
+	for(auto& buffer : buffers){
+		if(buffer->error.empty()) contents.push_back(std::make_pair(buffer->data.get(), buffer->size));
+	}
+	std::vector<File_Checksum*> hashes = File_Checksum::compute_hash_by_buffers(contents);
+	auto hash = hashes.begin();
+
+	for(auto& buffer : buffers){
+
+		// Insert into database
+		try{
+			if(!buffer->error.empty()) throw Pexception(buffer->error);
+			db.insert(*buffer, *hash++, volume);
+		}catch(Pexception& pe){
+			Utility::sout.printerrln(pe.what());
+		}
+		reader.release(buffer);
+
+		// Update the task count
+		db.get_counters().files_done++;
+		file_queue.decrement_task_count();
+	}
+
+	return true;
+}
+
+void Pcoll::process_archive(const string& path, const File_Filter& filter, unsigned long int max_member_size, Pcoll_Database& db, unsigned int volume){
+
+	// Members are filtered by name before they are read and by their first bytes after, they are held no larger than the read buffers
+	auto accept = [&](const string& member_path){ return filter.is_candidate_name(member_path) && !db.contains(member_path); };
+	Archive_Reader::read_members(path, accept, max_member_size, [&](const File_Buffer& member){
+		try{
+			if(!member.error.empty()) throw Pexception(member.error);
+
+			// The archive passed the filter whatever its name, its members have to pass it themselves
+			if(!filter.is_candidate(member.path, member.data.get(), member.size)) return;
+			db.insert(member, volume);
+		}catch(Pexception& pe){
+			Utility::sout.printerrln(pe.what());
+		}
+	});
 }
@@ -10,24 +10,101 @@
 #include <queue>
 #include <bitset>
 #include <utility>
+#include <functional>
 
 #include "filesystem.hpp"
 #include "utility.hpp"
 #include "task_queue.hpp"
 #include "pcoll_database.hpp"
+#include "file_reader.hpp"
+#include "disk_order.hpp"
+#include "device_queues.hpp"
+#include "progress_reporter.hpp"
+#include "archive_reader.hpp"
+#include "dedupe_engine.hpp"
+#include "file_filter.hpp"
+#include "checkpoint.hpp"
+#include "inode_set.hpp"
+#include "concurrency_controller.hpp"
 
 using std::unordered_map;
 using std::unordered_set;
 using std::string;
 using std::bitset;
 
+/** Settings for a pcoll run */
+struct Pcoll_Options {
+	Pcoll_Options() : quiet(false), percentage(0.0f), num_threads(1), exclude(), includes(), excludes(), images_only(false), index_path(), update_index_path(), io_depth(0), verify(false), hdd(false), memory_budget(0), archives(false), top_k(0), distance_store_path(), thumbnail_store_path(), dedupe(false), dedupe_method(Dedupe_Method::REFLINK), dry_run(false), journal_path(), checkpoint_path(), resume(false), online(false), adaptive(false), jpeg_content(false), blocking(false), tiles(false) {}
+	bool quiet; // no progress output
+	float percentage; // minimum similarity percentage
+	unsigned int num_threads; // number of worker threads
+	std::unordered_set<string> exclude; // excluded directories
+	std::list<string> includes; // globs of the only files read, empty for every file
+	std::list<string> excludes; // globs of files and directories that are skipped
+	bool images_only; // skip files known not to be images by their name or first bytes
+	string index_path; // where to save the hash index after scanning, empty for none
+	string update_index_path; // prior index to update incrementally, empty for a full scan
+	unsigned int io_depth; // reads kept in flight by the asynchronous reader, zero reads files in the workers
+	bool verify; // compare exact duplicates byte for byte after scanning
+	bool hdd; // walk first, then read files in the order they sit on disk
+	unsigned long int memory_budget; // bytes that file buffers and image decodes may take, zero for no limit
+	bool archives; // read the members of zip and tar archives instead of the archives themselves
+	unsigned int top_k; // most similar images reported per image, zero for every image above the percentage
+	string distance_store_path; // where the pair distances of a full comparison are kept, empty for none
+	string thumbnail_store_path; // where thumbnails are kept to confirm similar pairs, empty for none
+	bool dedupe; // replace exact duplicates after scanning
+	Dedupe_Method dedupe_method; // how exact duplicates are replaced
+	bool dry_run; // only report which duplicates would be replaced
+	string journal_path; // where replacements are recorded for a rollback, empty for none
+	string checkpoint_path; // where finished inserts are logged to resume an interrupted scan, empty for none
+	bool resume; // continue from the checkpoint instead of starting over
+	bool online; // compare images while scanning instead of afterwards
+	bool adaptive; // adjust the number of scanning workers to the throughput, num_threads is where it starts
+	bool jpeg_content; // group JPEGs that differ only in their metadata and decode one of them
+	bool blocking; // only compare images whose headers say they may be duplicates
+	bool tiles; // match images by hashes of their tiles too
+};
+
 class Pcoll {
 public:
-	static Results find_similar_images(std::list<string>& directories, std::unordered_set<string>& exclude, bool quiet, float percentage, unsigned int num_threads);
+	/** Scans directories and finds similar images
+	 *	@param directories directories to scan
+	 *	@param options run settings
+	 *	@param db database the scanned files are put in, must outlive the results
+	 *	@return similar files
+	 */
+	static Result_View find_similar_images(std::list<string>& directories, Pcoll_Options& options, Pcoll_Database& db);
+
+	/** Merges independently built indexes and finds duplicates between them
+	 *	Files are only compared against files from the other indexes
+	 *	@param indexes paths of the index files
+	 *	@param options run settings
+	 *	@param db database the indexes are loaded in, must outlive the results
+	 *	@return duplicates that span more than one index
+	 */
+	static Result_View merge_indexes(std::list<string>& indexes, Pcoll_Options& options, Pcoll_Database& db);
+
+	/** Finds similar images in an index without scanning the indexed files
+	 *	With a distance store recorded at a looser percentage the images are not compared again.
+	 *	@param index path of the index file
+	 *	@param options run settings
+	 *	@param db database the index is loaded in, must outlive the results
+	 *	@return similar files
+	 */
+	static Result_View report_index(const string& index, Pcoll_Options& options, Pcoll_Database& db);
+
+	/** Runs a function on several threads, one of them the calling thread, and waits for all of them
+	 *	@param num_threads number of threads
+	 *	@param function function to run
+	 */
+	static void run_threads(unsigned int num_threads, const std::function<void()>& function);
 private:
-	static bool process_path(bool quiet, Task_Queue<std::string>& path_queue, std::unordered_set<string>& exclude, Task_Queue<std::string>& file_queue);
-	static bool process_file(bool quiet, Task_Queue<std::string>& file_queue, Pcoll_Database& db);
-	static void print_progress(const string& path, Pcoll_Database& db);
+	static std::list<string> collapse_roots(const std::list<string>& directories);
+	static string get_scan_signature(const std::list<string>& directories, const Pcoll_Options& options);
+	static bool process_path(bool quiet, Task_Queue<std::string>& path_queue, const File_Filter& filter, Inode_Set& inodes, Device_Queues& file_queue, Progress_Counters& counters, Checkpoint* checkpoint);
+	static bool process_file(Device_Queues& file_queue, const File_Filter& filter, unsigned long int max_member_size, Pcoll_Database& db, unsigned int volume);
+	static bool process_buffer(Device_Queues& file_queue, File_Reader& reader, const File_Filter& filter, unsigned long int max_member_size, Pcoll_Database& db, unsigned int volume);
+	static void process_archive(const string& path, const File_Filter& filter, unsigned long int max_member_size, Pcoll_Database& db, unsigned int volume);
 };
 
 #endif //__PCOLL_PCOLL__
@@ -1,6 +1,9 @@
 #include "pcoll_database.hpp"
 #include "task_queue.hpp"
 #include "utility.hpp"
+#include "file_filter.hpp"
+#include "jpeg_digest.hpp"
+#include "archive_reader.hpp"
 
 #include <mutex>
 #include <thread>
@@ -8,13 +11,36 @@
 #include <functional>
 #include <chrono>
 #include <thread>
+#include <fstream>
+#include <iomanip>
+#include <sstream>
+#include <map>
+#include <set>
+#include <limits>
+#include <vector>
+#include <algorithm>
+#include <atomic>
+#include <sys/stat.h>
 
 using std::this_thread::sleep_for;
 using std::chrono::milliseconds;
 using std::string;
+using std::hex;
+using std::dec;
+using std::setw;
+using std::setfill;
+
+static const char* INDEX_HEADER = "pcoll-index 3";
+
+/** Largest distance between two tile hashes that match */
+static const unsigned int MAX_TILE_DISTANCE = 8;
+
+/** Tiles two images must share on both sides to match when their whole pictures do not */
+static const std::size_t MIN_SHARED_TILES = 3;
 
 Pcoll_Database::Pcoll_Database():
 	_total(0),
+	_latest_volume(0),
 	_path_storage(),
 	_path_storage_mutex(),
 	_dhash_storage(),
@@ -23,10 +49,30 @@ Pcoll_Database::Pcoll_Database():
 	_chash_storage_mutex(),
 	_path_to_chash_database(),
 	_path_to_chash_database_mutex(),
+	_path_to_info_database(),
+	_path_to_info_database_mutex(),
 	_chash_to_path_set_database(),
 	_chash_to_path_set_database_mutex(),
+	_group_origin_database(),
 	_dhash_database(),
-	_dhash_database_mutex()
+	_dhash_database_mutex(),
+	_decode_scheduler(),
+	_counters(),
+	_top_k(0),
+	_distance_store_path(),
+	_insert_log(),
+	_online(),
+	_content_digests(false),
+	_content_database(),
+	_image_group_database(),
+	_content_database_mutex(),
+	_blocking(false),
+	_blocking_database(),
+	_blocking_database_mutex(),
+	_tile_matching(false),
+	_tile_database(),
+	_tile_database_mutex(),
+	_thumbnails()
 {}
 
 Pcoll_Database::~Pcoll_Database(){
@@ -34,32 +80,125 @@ Pcoll_Database::~Pcoll_Database(){
 }
 
 void Pcoll_Database::insert(string& path){
+	insert(path, 0);
+}
 
-	// Copy string and store it
-	string* copy_path = new string(path);
-	_path_storage.push_back(copy_path);
+void Pcoll_Database::insert(string& path, unsigned int volume){
+
+	// Record file attributes so the entry can be checked against the file later
+	struct stat file_stat;
+	if(stat(path.c_str(), &file_stat) != 0) throw Pexception("Cannot stat file '" + path + "'!");
+	File_Info info;
+	info.volume = volume;
+	info.size = file_stat.st_size;
+	info.modified = file_stat.st_mtim.tv_sec * 1000000000LL + file_stat.st_mtim.tv_nsec;
 
 	// Get file hash and store it
-	File_Checksum* hash = File_Checksum::compute_hash_by_file(*copy_path);
-	_chash_storage.push_back(hash);
+	File_Checksum* hash = File_Checksum::compute_hash_by_file(path);
+	_counters.bytes_hashed += info.size;
+
+	insert(path, hash, nullptr, info, true, nullptr);
+	log_insert(path);
+}
+
+void Pcoll_Database::insert(const File_Buffer& buffer, unsigned int volume){
+	if(!buffer.error.empty()) throw Pexception(buffer.error);
+
+	// Get the hash of the contents
+	insert(buffer, File_Checksum::compute_hash_by_buffer(buffer.data.get(), buffer.size), volume);
+}
 
-	// Update the path-chash database
+void Pcoll_Database::insert(const File_Buffer& buffer, File_Checksum* hash, unsigned int volume){
+	insert(buffer.path, buffer.data.get(), buffer.size, buffer.modified, hash, volume);
+}
+
+void Pcoll_Database::insert(const string& path, const char* data, unsigned long int size, long long int modified, File_Checksum* hash, unsigned int volume){
+	File_Info info;
+	info.volume = volume;
+	info.size = size;
+	info.modified = modified;
+	_counters.bytes_hashed += info.size;
+
+	// Members of archives carry the size and modification time of their archive, an index can only check those
+	if(path.find(Archive_Reader::SEPARATOR) != string::npos) stat_entry(path, info);
+
+	insert(path, hash, nullptr, info, true, data);
+	log_insert(path);
+}
+
+void Pcoll_Database::insert_alias(const string& path, const string& original, unsigned int volume){
+	if(contains(path)) return;
+
+	// Find the checksum of the first path
+	string checksum;
+	{
+		std::shared_lock<std::shared_mutex> lock(_path_to_chash_database_mutex);
+		auto search = _path_to_chash_database.find(std::hash<string>()(original));
+		if(search == _path_to_chash_database.end()) throw Pexception("'" + original + "' is not in the database!");
+		checksum = search->second->get_string();
+	}
+
+	File_Info info;
+	if(!stat_entry(path, info)) throw Pexception("Cannot stat file '" + path + "'!");
+	info.volume = volume;
+	info.original = std::hash<string>()(original);
+
+	// Same file, same checksum and difference hash, nothing to read
+	insert(path, File_Checksum::from_string(checksum), nullptr, info, false, nullptr);
+}
+
+bool Pcoll_Database::same_file(const string& one, const string& two){
+	std::shared_lock<std::shared_mutex> lock(_path_to_info_database_mutex);
+	auto get_file_id = [&](const string& path) -> std::size_t {
+		std::size_t path_id = std::hash<string>()(path);
+		auto search = _path_to_info_database.find(path_id);
+		return search != _path_to_info_database.end() && search->second.original != 0 ? search->second.original : path_id;
+	};
+	return get_file_id(one) == get_file_id(two);
+}
+
+void Pcoll_Database::insert(const string& path, File_Checksum* hash, Difference_Hash* dhash, const File_Info& info, bool compute_dhash, const char* data){
+
+	// Store the checksum
+	{
+		std::unique_lock<std::shared_mutex> lock(_chash_storage_mutex);
+		_chash_storage.push_back(hash);
+	}
+
+	// Update the path-chash database, ignore paths that are already in the database
+	auto path_id = std::hash<string>()(path);
 	{
 		std::unique_lock<std::shared_mutex> lock(_path_to_chash_database_mutex);
-		auto id = std::hash<string>()(*copy_path);
-		auto search = _path_to_chash_database.find(id);
-		if(search == _path_to_chash_database.end()){
-			_path_to_chash_database.insert(std::make_pair(id, hash));
+		auto search = _path_to_chash_database.find(path_id);
+		if(search != _path_to_chash_database.end()){
+			delete dhash;
+			return;
 		}
+		_path_to_chash_database.insert(std::make_pair(path_id, hash));
+	}
+
+	// Copy string and store it
+	string* copy_path = new string(path);
+	{
+		std::unique_lock<std::shared_mutex> lock(_path_storage_mutex);
+		_path_storage.push_back(copy_path);
+	}
+
+	// Update the path-info database
+	{
+		std::unique_lock<std::shared_mutex> lock(_path_to_info_database_mutex);
+		_path_to_info_database.insert(std::make_pair(path_id, info));
+		if(info.volume > _latest_volume) _latest_volume = info.volume;
 	}
 
+	bool new_group = false;
+	auto id = std::hash<string>()(hash->get_string());
 	{ // Scope for chash_database unique_lock
 
 		// Lock the database for updating
 		std::unique_lock<std::shared_mutex> lock(_chash_to_path_set_database_mutex);
 
 		// Look for matching hash
-		auto id = std::hash<string>()(hash->get_string());
 		auto search = _chash_to_path_set_database.find(id);
 		if(search == _chash_to_path_set_database.end()){  // A matching hash not is found
 
@@ -69,32 +208,503 @@ void Pcoll_Database::insert(string& path){
 
 			// Put the new set in the database with the hash
 			_chash_to_path_set_database.insert(std::make_pair(id, set));
+			_group_origin_database[id] = copy_path;
+			new_group = true;
+			_counters.groups++;
+
+		}else{ // a matching hash is found, add to the set
+			search->second.insert(copy_path);
+		}
+	}
 
-			// Check if file is an image
-			if(Utility::is_image(*copy_path)){
+	// Only the first file of a group needs a difference hash, one read from an index fills in a group that has none yet
+	if(!new_group){
+		if(dhash != nullptr && !compute_dhash){
+			std::unique_lock<std::shared_mutex> lock(_dhash_database_mutex);
+			if(_dhash_database.insert(std::make_pair(id, dhash)).second){
+				lock.unlock();
+				{
+					std::unique_lock<std::shared_mutex> lock_storage(_dhash_storage_mutex);
+					_dhash_storage.push_back(dhash);
+				}
+				{
+					std::unique_lock<std::shared_mutex> lock_origin(_chash_to_path_set_database_mutex);
+					_group_origin_database[id] = copy_path;
+				}
+				compare_online(id, *dhash);
+				dhash = nullptr;
+			}
+		}
+		delete dhash;
+		_total++;
+		return;
+	}
+
+	// A JPEG with the image of one inserted before shares its difference hash
+	if(dhash == nullptr && compute_dhash && _content_digests && share_image(*copy_path, data, info.size, id)){
+		_total++;
+		return;
+	}
+
+	// Decoding happens outside of the locks so that workers can decode in parallel within the memory budget
+	if(dhash == nullptr && compute_dhash) dhash = decode_image(id, *copy_path, hash->get_string(), data, info.size);
+	if(dhash != nullptr) store_difference_hash(id, dhash);
+
+	_total++;
+}
 
-				// Compute the hash
-				Difference_Hash* dhash = new Difference_Hash(*copy_path);
+Difference_Hash* Pcoll_Database::decode_image(std::size_t chash_id, const string& path, const string& checksum, const char* data, unsigned long int size){
+
+	// Check if file is an image, decode from memory if the contents have been read already
+	// Files known not to be images by their name or first bytes are not probed, contents in memory are only opened once
+	// The blocking key comes from the header that is read before decoding, the thumbnail from the same pass as the hash
+	Blocking_Key key;
+	bool keep_thumbnail = _tile_matching || _thumbnails.is_open();
+	std::vector<float> thumbnail(keep_thumbnail ? Difference_Hash::THUMBNAIL_SIZE * Difference_Hash::THUMBNAIL_SIZE : 0);
+	Difference_Hash* dhash = nullptr;
+	if(File_Filter::classify(path, data, size) != File_Kind::NOT_IMAGE){
+		if(data == nullptr && Utility::is_image(path))
+			dhash = _decode_scheduler.compute_hash(path, nullptr, 0, _blocking ? &key : nullptr, keep_thumbnail ? thumbnail.data() : nullptr);
+		else if(data != nullptr)
+			dhash = _decode_scheduler.compute_hash(path, data, size, _blocking ? &key : nullptr, keep_thumbnail ? thumbnail.data() : nullptr);
+	}
+	if(dhash == nullptr) return nullptr;
 
-				// Store it in the storage
-				_dhash_storage.push_back(dhash);
+	_counters.images_decoded++;
+	if(_blocking){
+		std::unique_lock<std::shared_mutex> lock(_blocking_database_mutex);
+		_blocking_database[chash_id] = key;
+	}
+	if(_tile_matching){
+		std::vector<Tile_Hash> tiles = Tile_Hashes::compute(thumbnail.data());
+		std::unique_lock<std::shared_mutex> lock(_tile_database_mutex);
+		_tile_database[chash_id] = std::move(tiles);
+	}
+	if(_thumbnails.is_open()) _thumbnails.add(checksum, thumbnail.data());
+	return dhash;
+}
+
+void Pcoll_Database::store_difference_hash(std::size_t chash_id, Difference_Hash* dhash){
+
+	// Store it in the storage
+	{
+		std::unique_lock<std::shared_mutex> lock(_dhash_storage_mutex);
+		_dhash_storage.push_back(dhash);
+	}
+
+	// Then put it in the database
+	{
+		std::unique_lock<std::shared_mutex> lock(_dhash_database_mutex);
+		_dhash_database.insert(std::make_pair(chash_id, dhash));
+	}
+	compare_online(chash_id, *dhash);
+}
 
-				// Then put it in the database
-				std::unique_lock<std::shared_mutex> lock(_dhash_database_mutex);
-				_dhash_database.insert(std::make_pair(id, dhash));
+void Pcoll_Database::save_index(const string& index_path){
+
+	// Write to a temporary file first so an existing index survives a failed write
+	string temporary_path = index_path + ".tmp";
+	std::ofstream output(temporary_path, std::ios::trunc);
+	if(!output.is_open()) throw Pexception("Cannot open index file '" + temporary_path + "' for writing!");
+
+	// Lock everything for reading
+	std::shared_lock<std::shared_mutex> lock_path_storage(_path_storage_mutex);
+	std::shared_lock<std::shared_mutex> lock_path_to_chash(_path_to_chash_database_mutex);
+	std::shared_lock<std::shared_mutex> lock_path_to_info(_path_to_info_database_mutex);
+	std::shared_lock<std::shared_mutex> lock_dhash(_dhash_database_mutex);
+
+	// Header, then one line per file
+	output << get_index_header() << "\n";
+	for(auto& path : _path_storage){
+		if(_path_to_info_database.at(std::hash<string>()(*path)).original != 0) continue; // Aliases are found again by the walk
+		write_index_entry(output, *path);
+		output << '\n';
+	}
+
+	output.close();
+	if(output.fail()) throw Pexception("Failed to write index file '" + temporary_path + "'!");
+
+	// Replace the old index
+	if(std::rename(temporary_path.c_str(), index_path.c_str()) != 0) throw Pexception("Failed to replace index file '" + index_path + "'!");
+}
+
+string Pcoll_Database::get_index_header(){
+	return string(INDEX_HEADER) + " " + File_Checksum::get_algorithm_name();
+}
+
+void Pcoll_Database::write_index_entry(std::ostream& output, const string& path){
+
+	// <checksum> <dhash or -> <size> <modified> <path>
+	auto path_id = std::hash<string>()(path);
+	File_Checksum* chash = _path_to_chash_database.at(path_id);
+	const File_Info& info = _path_to_info_database.at(path_id);
+
+	output << chash->get_string() << '\t';
+	auto search = _dhash_database.find(get_image_group(std::hash<string>()(chash->get_string())));
+	if(search != _dhash_database.end())
+		output << hex << setw(16) << setfill('0') << search->second->get_bitset().to_ullong() << dec;
+	else
+		output << '-';
+	output << '\t' << info.size << '\t' << info.modified << '\t' << path;
+}
+
+void Pcoll_Database::set_insert_log(const std::function<void(const string&)>& function){
+	_insert_log = function;
+}
+
+void Pcoll_Database::log_insert(const string& path){
+	if(!_insert_log) return;
+	std::ostringstream entry;
+	{
+		std::shared_lock<std::shared_mutex> lock_path_to_chash(_path_to_chash_database_mutex);
+		std::shared_lock<std::shared_mutex> lock_path_to_info(_path_to_info_database_mutex);
+		std::shared_lock<std::shared_mutex> lock_dhash(_dhash_database_mutex);
+		write_index_entry(entry, path);
+	}
+	_insert_log(entry.str());
+}
+
+void Pcoll_Database::load_index(const string& index_path, unsigned int volume){
+	load_index(index_path, volume, false, false);
+}
+
+void Pcoll_Database::load_index(const string& index_path, unsigned int volume, bool verify, bool decode_images){
+
+	// Open the index file
+	std::ifstream input(index_path);
+	if(!input.is_open()) throw Pexception("Cannot open index file '" + index_path + "'!");
+
+	// Check the header
+	string line;
+	string header = INDEX_HEADER;
+	if(!std::getline(input, line) || line.compare(0, header.size() + 1, header + " ") != 0) throw Pexception("'" + index_path + "' is not a pcoll index!");
+
+	// Checksums are only comparable if they use the same digest
+	string algorithm = line.substr(header.size() + 1);
+	if(algorithm != File_Checksum::get_algorithm_name())
+		throw Pexception("'" + index_path + "' uses " + algorithm + " checksums, select that digest to use it!");
+
+	unsigned int line_number = 1;
+	while(std::getline(input, line)){
+		line_number++;
+		if(line.empty()) continue;
+
+		// Split the first four fields, the path is the rest of the line
+		string fields[4];
+		size_t position = 0;
+		for(unsigned int i = 0; i < 4; i++){
+			size_t tab = line.find('\t', position);
+			if(tab == string::npos) throw Pexception("Malformed entry in '" + index_path + "' at line " + std::to_string(line_number) + "!");
+			fields[i] = line.substr(position, tab - position);
+			position = tab + 1;
+		}
+
+		File_Info info;
+		info.volume = volume;
+		Difference_Hash* dhash = nullptr;
+		try{
+			info.size = std::stoul(fields[2]);
+			info.modified = std::stoll(fields[3]);
+			if(fields[1] != "-") dhash = new Difference_Hash(bitset<64>(std::stoull(fields[1], nullptr, 16)));
+		}catch(std::logic_error& e){
+			throw Pexception("Malformed entry in '" + index_path + "' at line " + std::to_string(line_number) + "!");
+		}
+
+		// Drop entries that no longer match their file
+		string path = line.substr(position);
+		if(verify){
+			File_Info current;
+			if(!stat_entry(path, current) || current.size != info.size || current.modified != info.modified){
+				delete dhash;
+				continue;
 			}
-		}else{ // a matching hash is found, add to the set
-			search->second.insert(copy_path);
 		}
+
+		// The checksum still holds, the image is decoded again and its difference hash with it
+		if(decode_images && dhash != nullptr && path.find(Archive_Reader::SEPARATOR) == string::npos){
+			delete dhash;
+			insert(path, File_Checksum::from_string(fields[0]), nullptr, info, true, nullptr);
+		}else insert(path, File_Checksum::from_string(fields[0]), dhash, info, false, nullptr);
 	}
+}
 
-	_total++;
+bool Pcoll_Database::stat_entry(const string& path, File_Info& info){
+
+	// A virtual path is checked by the archive it points into
+	struct stat file_stat;
+	auto separator = path.find(Archive_Reader::SEPARATOR);
+	bool in_archive = separator != string::npos && stat(path.substr(0, separator).c_str(), &file_stat) == 0 && S_ISREG(file_stat.st_mode);
+	if(!in_archive && stat(path.c_str(), &file_stat) != 0) return false;
+
+	info.size = file_stat.st_size;
+	info.modified = file_stat.st_mtim.tv_sec * 1000000000LL + file_stat.st_mtim.tv_nsec;
+	return true;
+}
+
+void Pcoll_Database::verify_exact_groups(bool quiet, unsigned int num_threads){
+
+	// Ensure that number of threads is not zero
+	if(num_threads == 0) num_threads = 1;
+
+	// Only groups with more than one file need checking
+	Task_Queue<std::size_t> group_queue; // <File_Checksum id>
+	for(auto& entry : _chash_to_path_set_database){
+		if(entry.second.size() > 1) group_queue.insert(entry.first);
+	}
+
+	// Groups that turned out to hold different contents, split into clusters of identical files
+	std::list<std::pair<std::size_t, std::vector<std::vector<string*>>>> split_groups;
+	std::mutex split_groups_mutex;
+
+	// Build the thread function
+	auto verification_function = [&](){
+
+		// Finish all tasks
+		while(group_queue.task_count() != 0){
+			try{
+				// Extract
+				std::size_t chash_id = group_queue.poll();
+
+				// Put every file in the first cluster it is identical to
+				std::vector<std::vector<string*>> clusters;
+				for(auto& path : _chash_to_path_set_database.at(chash_id)){
+					bool placed = false;
+					for(auto& cluster : clusters){
+						try{
+							placed = Utility::files_identical(*cluster.front(), *path);
+						}catch(Pexception& pe){
+							// Can't verify, trust the checksum
+							if(!quiet) Utility::sout.printerrln(pe.what());
+							placed = true;
+						}
+						if(placed){
+							cluster.push_back(path);
+							break;
+						}
+					}
+					if(!placed) clusters.push_back(std::vector<string*>(1, path));
+				}
+
+				if(clusters.size() > 1){
+
+					// The cluster of the file the group was hashed from keeps the group with its difference hash
+					string* origin = _group_origin_database.at(chash_id);
+					for(auto& cluster : clusters){
+						if(std::find(cluster.begin(), cluster.end(), origin) != cluster.end()){
+							std::swap(cluster, clusters.front());
+							break;
+						}
+					}
+
+					std::unique_lock<std::mutex> lock(split_groups_mutex);
+					split_groups.push_back(std::make_pair(chash_id, clusters));
+				}
+
+				// Decrement task count
+				group_queue.decrement_task_count();
+
+			}catch(Pexception &e){
+				sleep_for(milliseconds(10)); // Relax for a bit
+			}
+		}
+	};
+
+	// Create threads
+	std::list<std::unique_ptr<std::thread>> threads;
+	for(unsigned int i = 0; i < num_threads-1; i++){
+		std::unique_ptr<std::thread> thread = std::make_unique<std::thread>(verification_function);
+		threads.push_back(std::move(thread));
+	}
+
+	// Run on main thread
+	verification_function();
+
+	// Join all threads if theres any
+	for(auto& thread : threads)
+		thread->join();
+
+	// Give every extra cluster its own checksum so it becomes its own group
+	for(auto& split : split_groups){
+		const string& checksum = _path_to_chash_database.at(std::hash<string>()(*split.second.front().front()))->get_string();
+		if(!quiet) Utility::sout.printerrln("Checksum collision on " + checksum + ", splitting group");
+
+		for(unsigned int i = 1; i < split.second.size(); i++){
+			auto& cluster = split.second[i];
+			File_Checksum* hash = File_Checksum::from_string(checksum + "#" + std::to_string(i));
+			_chash_storage.push_back(hash);
+			auto id = std::hash<string>()(hash->get_string());
+
+			// Move the files over
+			for(auto& path : cluster){
+				_chash_to_path_set_database[split.first].erase(path);
+				_chash_to_path_set_database[id].insert(path);
+				_path_to_chash_database[std::hash<string>()(*path)] = hash;
+			}
+			_group_origin_database[id] = cluster.front();
+
+			// The new group needs its own difference hash, blocking key, tiles and thumbnail
+			try{
+				Difference_Hash* dhash = decode_image(id, *cluster.front(), hash->get_string(), nullptr, 0);
+				if(dhash != nullptr) store_difference_hash(id, dhash);
+			}catch(Pexception& pe){
+				if(!quiet) Utility::sout.printerrln(pe.what());
+			}
+		}
+	}
+}
+
+std::list<std::vector<const string*>> Pcoll_Database::get_exact_groups(){
+	std::shared_lock<std::shared_mutex> lock(_chash_to_path_set_database_mutex);
+	std::shared_lock<std::shared_mutex> lock_path_to_info(_path_to_info_database_mutex);
+	std::list<std::vector<const string*>> groups;
+	for(auto& entry : _chash_to_path_set_database){
+		if(entry.second.size() < 2) continue;
+
+		// An alias is the same file as its first path, there is nothing to deduplicate
+		std::vector<const string*> files;
+		for(auto& path : entry.second){
+			if(_path_to_info_database.at(std::hash<string>()(*path)).original == 0) files.push_back(path);
+		}
+		if(files.size() > 1) groups.push_back(std::move(files));
+	}
+	return groups;
+}
+
+bool Pcoll_Database::contains(const string& path){
+	std::shared_lock<std::shared_mutex> lock(_path_to_chash_database_mutex);
+	return _path_to_chash_database.find(std::hash<string>()(path)) != _path_to_chash_database.end();
+}
+
+std::vector<std::pair<const string*, float>> Pcoll_Database::find_neighbors(const string& path, float percentage){
+	std::vector<std::pair<const string*, float>> neighbors;
+
+	// Find the checksum of the file
+	File_Checksum* chash;
+	{
+		std::shared_lock<std::shared_mutex> lock(_path_to_chash_database_mutex);
+		auto search = _path_to_chash_database.find(std::hash<string>()(path));
+		if(search == _path_to_chash_database.end()) throw Pexception("'" + path + "' is not in the database!");
+		chash = search->second;
+	}
+	size_t chash_id = get_image_group(std::hash<string>()(chash->get_string()));
+	auto image_groups = get_image_groups();
+
+	// Calls a function with every group that shares the difference hash of a group, that group included
+	auto for_each_group = [&](std::size_t image_id, const std::function<void(std::size_t)>& function){
+		function(image_id);
+		auto members = image_groups.find(image_id);
+		if(members != image_groups.end()) for(auto& member : members->second) function(member);
+	};
+
+	// Files with the same checksum or the same image are identical
+	std::shared_lock<std::shared_mutex> lock_chash(_chash_to_path_set_database_mutex);
+	for_each_group(chash_id, [&](std::size_t group){
+		for(auto& other : _chash_to_path_set_database.at(group)){
+			if(!same_file(*other, path)) neighbors.push_back(std::make_pair(other, 1.0f));
+		}
+	});
+
+	// Compare the difference hash against every other group
+	std::shared_lock<std::shared_mutex> lock_dhash(_dhash_database_mutex);
+	auto dhash = _dhash_database.find(chash_id);
+	if(dhash != _dhash_database.end()){
+		for(auto& entry : _dhash_database){
+			if(entry.first == chash_id) continue;
+			float similarity = dhash->second->compare(*entry.second);
+			if(similarity < percentage) continue;
+			similarity = similarity == 1.0f ? 0.99f : similarity; // Same difference hash but different contents
+			for_each_group(entry.first, [&](std::size_t group){
+				for(auto& other : _chash_to_path_set_database.at(group))
+					neighbors.push_back(std::make_pair(other, similarity));
+			});
+		}
+	}
+
+	// Most similar first
+	std::sort(neighbors.begin(), neighbors.end(), [](const std::pair<const string*, float>& one, const std::pair<const string*, float>& two) -> bool {
+		return one.second != two.second ? one.second > two.second : *one.first < *two.first;
+	});
+
+	return neighbors;
+}
+
+void Pcoll_Database::set_memory_budget(unsigned long int budget){
+	_decode_scheduler.set_memory_budget(budget);
+}
+
+void Pcoll_Database::set_top_k(unsigned int top_k){
+	_top_k = top_k;
+}
+
+void Pcoll_Database::set_distance_store(const string& path){
+	_distance_store_path = path;
+}
+
+void Pcoll_Database::set_online_comparison(bool online, float percentage){
+	if(online) _online = std::make_unique<Hamming_Index>(Distance_Store::get_max_distance(percentage));
+	else _online.reset();
+}
+
+void Pcoll_Database::compare_online(std::size_t chash_id, const Difference_Hash& dhash){
+	if(_online) _online->add(chash_id, dhash.get_bitset().to_ullong());
+}
+
+void Pcoll_Database::set_content_digests(bool content_digests){
+	_content_digests = content_digests;
+}
+
+void Pcoll_Database::set_blocking(bool blocking){
+	_blocking = blocking;
+}
+
+void Pcoll_Database::set_tile_matching(bool tile_matching){
+	_tile_matching = tile_matching;
+}
+
+void Pcoll_Database::set_thumbnail_store(const string& path, bool read_only){
+	if(path.empty()) _thumbnails.close();
+	else _thumbnails.open(path, read_only);
+}
+
+bool Pcoll_Database::share_image(const string& path, const char* data, unsigned long int size, std::size_t chash_id){
+
+	// Only complete JPEGs have an image checksum
+	File_Checksum* content = nullptr;
+	try{ content = Jpeg_Digest::compute_hash(path, data, size);
+	}catch(Pexception& pe){ return false; }
+	if(content == nullptr) return false;
+	auto content_id = std::hash<string>()(content->get_string());
+	delete content;
+
+	// The first group with the image keeps it, the others share its difference hash
+	std::unique_lock<std::shared_mutex> lock(_content_database_mutex);
+	auto result = _content_database.insert(std::make_pair(content_id, chash_id));
+	if(result.second) return false;
+	_image_group_database[chash_id] = result.first->second;
+	return true;
+}
+
+std::size_t Pcoll_Database::get_image_group(std::size_t chash_id){
+	std::shared_lock<std::shared_mutex> lock(_content_database_mutex);
+	auto search = _image_group_database.find(chash_id);
+	return search == _image_group_database.end() ? chash_id : search->second;
+}
+
+std::unordered_map<std::size_t, std::vector<std::size_t>> Pcoll_Database::get_image_groups(){
+	std::shared_lock<std::shared_mutex> lock(_content_database_mutex);
+	std::unordered_map<std::size_t, std::vector<std::size_t>> image_groups; // <File_Checksum id with the difference hash, File_Checksum ids sharing it>
+	for(auto& entry : _image_group_database) image_groups[entry.second].push_back(entry.first);
+	return image_groups;
 }
 
 unsigned int Pcoll_Database::size() {
 	return _total;
 }
 
+Progress_Counters& Pcoll_Database::get_counters(){
+	return _counters;
+}
+
 Results Pcoll_Database::compile_similarity_results(bool quiet, float percentage){
 
 	// Get the number of cores available on the computer
@@ -109,18 +719,66 @@ Results Pcoll_Database::compile_similarity_results(bool quiet, float percentage)
 }
 
 Results Pcoll_Database::compile_similarity_results(bool quiet, float percentage, unsigned int num_threads){
+	return compile_similarity_results(quiet, percentage, num_threads, Comparison_Scope::ALL);
+}
+
+Results Pcoll_Database::compile_similarity_results(bool quiet, float percentage, unsigned int num_threads, Comparison_Scope scope){
+
+	// Copy the view into lists of paths
+	Result_View view = compile_similarity_view(quiet, percentage, num_threads, scope);
+	Results results;
+	for(auto group : view){
+		std::list<std::pair<string, float>> collisions;
+		for(auto& edge : group) collisions.push_back(std::make_pair(string(view.get_path(edge.file)), edge.similarity));
+		results.collisions.push_back(std::make_pair(string(group.path()), collisions));
+	}
+
+	return results;
+}
+
+Result_View Pcoll_Database::compile_similarity_view(bool quiet, float percentage, unsigned int num_threads, Comparison_Scope scope){
 
 	// Ensure that number of threads is not zero
 	if(num_threads == 0) num_threads = 1;
 
+	// Number the checksum groups that have a Difference Hash, in the same order on every run
+	std::vector<std::size_t> group_ids; // <group number, File_Checksum id>
+	group_ids.reserve(_dhash_database.size());
+	for(auto& entry : _dhash_database) group_ids.push_back(entry.first);
+	std::sort(group_ids.begin(), group_ids.end());
+	std::unordered_map<std::size_t, uint32_t> group_numbers; // <File_Checksum id, group number>
+	for(uint32_t group = 0; group < group_ids.size(); group++) group_numbers[group_ids[group]] = group;
+
+	// Groups that share the difference hash of a group with the same image are reported with it
+	auto image_groups = get_image_groups();
+
 	// Compute similarity in Difference Hashes
-	unordered_map<std::size_t, std::unordered_map<std::size_t, float>> dhash_results = compile_dhash_similarity(percentage, num_threads); // <Checksum_id, <Checksum_id, similarity>>
+	Distance_Graph dhash_results = compile_dhash_similarity(percentage, num_threads, scope, group_ids);
 
-	// Create results storage
-	Results results;
+	// Give every path an id
+	std::vector<const string*> paths;
+	{
+		std::shared_lock<std::shared_mutex> lock_path_storage(_path_storage_mutex);
+		paths.assign(_path_storage.begin(), _path_storage.end());
+	}
+
+	// Look up the id of a path by its storage address
+	std::vector<std::pair<const string*, unsigned int>> ids(paths.size());
+	for(unsigned int i = 0; i < paths.size(); i++) ids[i] = std::make_pair(paths[i], i);
+	auto by_address = [](const std::pair<const string*, unsigned int>& one, const std::pair<const string*, unsigned int>& two) -> bool {
+		return std::less<const string*>()(one.first, two.first);
+	};
+	std::sort(ids.begin(), ids.end(), by_address);
+	auto get_id = [&](const string* path) -> unsigned int {
+		return std::lower_bound(ids.begin(), ids.end(), std::make_pair(path, 0u), by_address)->second;
+	};
+
+	// Groups found by all threads
+	std::vector<std::pair<unsigned int, std::vector<Result_Edge>>> groups;
+	std::mutex groups_mutex;
 
 	// Create queue
-	Task_Queue<string*> results_queue;
+	Task_Queue<unsigned int> results_queue;
 
 	// Build the thread function
 	auto results_compilation_function = [&](){
@@ -131,58 +789,59 @@ Results Pcoll_Database::compile_similarity_results(bool quiet, float percentage,
 			// Try to extract dhash queue
 			try{
 				// Extract
-				string* path = results_queue.poll();
+				unsigned int id = results_queue.poll();
+				const string* path = paths[id];
 
 				// Construct list
-				std::list<std::pair<string, float>> collisions;
+				std::vector<Result_Edge> edges;
+
+				// Get the volume the path came from
+				unsigned int volume = get_volume(*path);
 
 				// Process Checksums - find chash to corresponding path
-				File_Checksum* chash = _path_to_chash_database[std::hash<string>()(*path)];
+				File_Checksum* chash = _path_to_chash_database.at(std::hash<string>()(*path));
 
-				// Get id of that checksum
-				size_t chash_id = std::hash<string>()(chash->get_string());
+				// Get id of that checksum, or of the group it shares the image with
+				size_t chash_id = get_image_group(std::hash<string>()(chash->get_string()));
 
-				// Get list of file paths with same Checksum
-				std::unordered_set<std::string*> files = _chash_to_path_set_database[chash_id];
+				// Put the files of a group and of the groups that share its image in the list
+				auto add_files = [&](std::size_t image_id, float percent){
+					auto add_group = [&](std::size_t group){
+						for(auto& other_files : _chash_to_path_set_database.at(group)){
+							if(other_files != path && in_scope(scope, volume, get_volume(*other_files)) && !same_file(*other_files, *path)) // Ignore if the comparing file is by itself, out of scope or an alias of it
+								edges.push_back(Result_Edge{get_id(other_files), percent});
+						}
+					};
+					add_group(image_id);
+					auto members = image_groups.find(image_id);
+					if(members != image_groups.end()) for(auto& member : members->second) add_group(member);
+				};
 
-				// Put collisions in the list
-				for(auto& other_files : files){
-					if(*other_files != *path){ // Ignore if the comparing file is by itself
-						std::string str(*other_files); // copy
-						collisions.push_back(std::make_pair(str, 1.0f));
-					}
-				}
+				// Put collisions in the list, files with the same image are as good as identical
+				add_files(chash_id, 1.0f);
 
 				// Process Difference Hash - find dhash set to corresponding chash
-				std::unordered_map<std::size_t, float> dhash_collisions = dhash_results[chash_id];
-
-				// Put dhash collisions in the list
-				for(auto& entry : dhash_collisions){
-
-					// Get file path names of corresponding File Checksum
-					std::unordered_set<string*> paths = _chash_to_path_set_database[entry.first];
-
-					// Go through file paths
-					for(auto& other_files : paths){
-						if(*other_files != *path){ // Ignore if the comparing file is by itself
-							float percent = entry.second == 1.0f ? 0.99f : entry.second; // If both files don't match the checksum but rates 100% on Dhash, it's safe to assume it's very similar but not same
-							std::string str(*other_files); // copy
-							collisions.push_back(std::make_pair(str, percent));
-						}
+				auto dhash_collisions = group_numbers.find(chash_id);
+				if(dhash_collisions != group_numbers.end()){
+					// Put dhash collisions in the list
+					for(auto entry = dhash_results.begin(dhash_collisions->second); entry != dhash_results.end(dhash_collisions->second); entry++){
+
+						// Put the file paths of corresponding File Checksum in the list
+						float percent = entry->distance == 0 ? 0.99f : Distance_Store::get_similarity(entry->distance); // If both files don't match the checksum but rates 100% on Dhash, it's safe to assume it's very similar but not same
+						add_files(group_ids[entry->group], percent);
 					}
 				}
 
-				if(collisions.size() != 0){
+				if(edges.size() != 0){
 
 					// Sort the list to descending percentage of matches
-					collisions.sort([](const std::pair<string,float>& one, const std::pair<string,float>& two) -> bool {
-						return one.second > two.second;
+					std::sort(edges.begin(), edges.end(), [](const Result_Edge& one, const Result_Edge& two) -> bool {
+						return one.similarity != two.similarity ? one.similarity > two.similarity : one.file < two.file;
 					});
 
-					// Put the list into the results struct
-					std::string str(*path); // copy
-					results.collisions.push_back(std::make_pair(str, collisions));
-
+					// Put the list into the results
+					std::unique_lock<std::mutex> lock_mutex(groups_mutex);
+					groups.push_back(std::make_pair(id, std::move(edges)));
 				}
 
 				// Decrement task count
@@ -194,6 +853,9 @@ Results Pcoll_Database::compile_similarity_results(bool quiet, float percentage,
 		}
 	};
 
+	// Populate the queue before starting threads so they don't see an empty queue and leave
+	for(unsigned int i = 0; i < paths.size(); i++) results_queue.insert(i);
+
 	// Create threads
 	std::list<std::unique_ptr<std::thread>> threads;
 	for(unsigned int i = 0; i < num_threads-1; i++){
@@ -201,27 +863,35 @@ Results Pcoll_Database::compile_similarity_results(bool quiet, float percentage,
 		threads.push_back(std::move(thread));
 	}
 
-	{
-		std::shared_lock<std::shared_mutex> lock_path_storage(_path_storage_mutex);
-		for(auto& entry : _path_storage){
-			results_queue.insert(entry);
-		}
-	}
-
-	// Run on main thread// Run on main thread
+	// Run on main thread
 	results_compilation_function();
 
 	// Join all threads if theres any
 	for(auto& thread : threads)
 		thread->join();
 	threads.clear();
+	ids = std::vector<std::pair<const string*, unsigned int>>();
 
 	// Sort the results starting with highest hits
-	results.collisions.sort([](const std::pair<string, std::list<std::pair<string, float>>>& one, const std::pair<string, std::list<std::pair<string, float>>>& two) -> bool {
-		return one.second.size() > two.second.size();
+	std::sort(groups.begin(), groups.end(), [](const std::pair<unsigned int, std::vector<Result_Edge>>& one, const std::pair<unsigned int, std::vector<Result_Edge>>& two) -> bool {
+		return one.second.size() != two.second.size() ? one.second.size() > two.second.size() : one.first < two.first;
 	});
 
-	return results;
+	// Lay the groups out one after another
+	std::vector<unsigned int> group_files;
+	std::vector<std::size_t> group_offsets;
+	std::vector<Result_Edge> edges;
+	group_files.reserve(groups.size());
+	group_offsets.reserve(groups.size() + 1);
+	group_offsets.push_back(0);
+	for(auto& group : groups){
+		group_files.push_back(group.first);
+		edges.insert(edges.end(), group.second.begin(), group.second.end());
+		group_offsets.push_back(edges.size());
+		group.second = std::vector<Result_Edge>();
+	}
+
+	return Result_View(std::move(paths), std::move(group_files), std::move(group_offsets), std::move(edges));
 }
 
 void Pcoll_Database::reset(){
@@ -233,6 +903,8 @@ void Pcoll_Database::reset(){
 
 	// Clear databases
 	_path_to_chash_database.clear();
+	_path_to_info_database.clear();
+	_latest_volume = 0;
 	_chash_to_path_set_database.clear();
 	_dhash_database.clear();
 
@@ -245,110 +917,395 @@ void Pcoll_Database::reset(){
 	// Delete chashes
 	for(auto& hash : _chash_storage) delete hash;
 
+	_group_origin_database.clear();
+	_content_database.clear();
+	_image_group_database.clear();
+	_blocking_database.clear();
+	_tile_database.clear();
+
 	_total = 0;
+	_counters.groups = 0;
+
+	// Start over with the same distance
+	if(_online) _online = std::make_unique<Hamming_Index>(_online->get_max_distance());
 }
 
-unordered_map<std::size_t, std::unordered_map<std::size_t, float>> Pcoll_Database::compile_dhash_similarity(float percentage, unsigned int num_threads){
+bool Pcoll_Database::in_scope(Comparison_Scope scope, unsigned int volume_one, unsigned int volume_two) const{
+	switch(scope){
+		case Comparison_Scope::CROSS_VOLUME: return volume_one != volume_two;
+		case Comparison_Scope::LATEST_VOLUME: return volume_one == _latest_volume || volume_two == _latest_volume;
+		default: return true;
+	}
+}
 
-	// Create results storage
-	unordered_map<std::size_t, std::unordered_map<std::size_t, float>> results; // <File_Checksum id, map<File_Checksum id, percent>>
-	std::mutex results_mutex;
+unsigned int Pcoll_Database::get_volume(const string& path){
+	std::shared_lock<std::shared_mutex> lock(_path_to_info_database_mutex);
+	return _path_to_info_database.at(std::hash<string>()(path)).volume;
+}
 
-	// Compare dhash to every other dhash in dhash database
-	Task_Queue<std::unordered_map<std::size_t, Difference_Hash*>::const_iterator> dhash_queue; // <File_Checksum id, Difference_Hash*>
-	Task_Queue<std::pair<std::size_t, std::size_t>> compare_queue; // <File_Checksum id, File_Checksum id>
+Distance_Graph Pcoll_Database::compile_dhash_similarity(float percentage, unsigned int num_threads, Comparison_Scope scope, const std::vector<std::size_t>& group_ids){
 
-	// Build the thread function
-	auto dhash_comparison_function = [&](){
+	// Edges found by every thread, each thread only touches its own
+	std::vector<std::vector<Distance_Edge>> buffers(num_threads);
+	unsigned int max_distance = Distance_Store::get_max_distance(percentage);
 
-		// Finish all tasks
-		while(dhash_queue.task_count() != 0 || compare_queue.task_count() != 0){
+	// Look up the dhashes by group number
+	std::vector<const Difference_Hash*> dhashes;
+	dhashes.reserve(group_ids.size());
+	for(auto& chash_id : group_ids) dhashes.push_back(_dhash_database.at(chash_id));
 
-			//std::cout << "tc1:\t" << dhash_queue.task_count() << "\ttc2:\t" << compare_queue.task_count() << std::endl << std::flush;
+	// Look up the blocking keys by group number, every group shares the unknown key without blocking
+	std::vector<Blocking_Key> keys(group_ids.size());
+	if(_blocking){
+		std::shared_lock<std::shared_mutex> lock(_blocking_database_mutex);
+		for(uint32_t group = 0; group < group_ids.size(); group++){
+			auto search = _blocking_database.find(group_ids[group]);
+			if(search != _blocking_database.end()) keys[group] = search->second;
+		}
+	}
 
-			// Flags for threads to either wait
-			bool dhash_queue_results = true;
-			bool compare_queue_results = true;
+	// Sort the groups into the volumes their files came from and the blocks of their keys, a checksum can be in several volumes
+	std::map<std::pair<unsigned int, Blocking_Key>, std::vector<uint32_t>> cell_groups; // <volume and key, group numbers>
+	for(uint32_t group = 0; group < group_ids.size(); group++){
+		std::unordered_set<unsigned int> seen;
+		for(auto& path : _chash_to_path_set_database[group_ids[group]]){
+			unsigned int volume = scope == Comparison_Scope::ALL ? 0 : get_volume(*path);
+			if(seen.insert(volume).second) cell_groups[std::make_pair(volume, keys[group])].push_back(group);
+		}
+	}
+	std::vector<Comparison_Cell> cells;
+	cells.reserve(cell_groups.size());
+	for(auto& entry : cell_groups) cells.push_back(Comparison_Cell{entry.first.first, entry.first.second, std::move(entry.second)});
+
+	// Index the cells by their keys and every part of the keys by the values seen
+	std::map<Blocking_Key, std::vector<std::size_t>> key_cells; // <key, cells of every volume>
+	std::set<int32_t> aspects, orientations, dates;
+	std::set<std::size_t> models;
+	for(std::size_t cell = 0; cell < cells.size(); cell++){
+		const Blocking_Key& key = cells[cell].key;
+		key_cells[key].push_back(cell);
+		aspects.insert(key.aspect);
+		orientations.insert(key.orientation);
+		dates.insert(key.date);
+		models.insert(key.model);
+	}
 
-			// Try to extract dhash queue
-			try{
-				// Extract
-				auto element = dhash_queue.poll();
+	// Values a part of a key is near, an unknown one is near every value seen
+	auto near_values = [](int32_t value, const std::set<int32_t>& seen, bool adjacent) -> std::vector<int32_t> {
+		if(value == Blocking_Key::UNKNOWN) return std::vector<int32_t>(seen.begin(), seen.end());
+		std::vector<int32_t> values{Blocking_Key::UNKNOWN, value};
+		if(adjacent && value - 1 != Blocking_Key::UNKNOWN) values.push_back(value - 1);
+		if(adjacent && value != std::numeric_limits<int32_t>::max()) values.push_back(value + 1);
+		return values;
+	};
 
-				// Store the current value
-				std::size_t file_id = element->first;
+	// List the cells every cell needs to be compared with, only the keys near its own are looked up
+	std::vector<std::vector<std::size_t>> near_cells(cells.size());
+	for(auto& entry : key_cells){
+		const Blocking_Key& key = entry.first;
+		std::vector<int32_t> near_aspects = near_values(key.aspect, aspects, true);
+		std::vector<int32_t> near_orientations = near_values(key.orientation, orientations, false);
+		std::vector<int32_t> near_dates = near_values(key.date, dates, true);
+		std::vector<std::size_t> near_models = key.model == 0 ? std::vector<std::size_t>(models.begin(), models.end()) : std::vector<std::size_t>{0, key.model};
+
+		// Keys made of unknown parts are near too many to look up, go through the keys seen instead
+		std::vector<const std::vector<std::size_t>*> near_keys;
+		auto add_key = [&](const Blocking_Key& other){
+			auto search = key_cells.find(other);
+			if(search != key_cells.end()) near_keys.push_back(&search->second);
+		};
+		if(near_aspects.size() * near_orientations.size() * near_dates.size() * near_models.size() > key_cells.size()){
+			for(auto& other : key_cells){
+				if(key.is_near(other.first)) near_keys.push_back(&other.second);
+			}
+		}else{
+			Blocking_Key other;
+			for(auto& aspect : near_aspects){
+				other.aspect = aspect;
+				for(auto& orientation : near_orientations){
+					other.orientation = orientation;
+					for(auto& date : near_dates){
+						other.date = date;
+						for(auto& model : near_models){
+							other.model = model;
+							add_key(other);
+						}
+					}
+				}
+			}
+		}
+
+		for(auto& one : entry.second){
+			for(auto& others : near_keys){
+				for(auto& two : *others){
+					if(in_scope(scope, cells[one].volume, cells[two].volume)) near_cells[one].push_back(two);
+				}
+			}
+			std::sort(near_cells[one].begin(), near_cells[one].end());
+		}
+	}
 
-				// Advance the element;
-				element++;
+	// Pairs are kept if their thumbnails correlate enough, pairs without both thumbnails stay
+	std::vector<uint32_t> thumbnails;
+	if(_thumbnails.is_open()){
+		thumbnails.resize(group_ids.size());
+		for(uint32_t group = 0; group < group_ids.size(); group++) thumbnails[group] = _thumbnails.find(get_checksum(group_ids[group]));
+	}
+	auto confirm = [&](uint32_t one, uint32_t two) -> bool {
+		if(thumbnails.empty() || thumbnails[one] == Thumbnail_Store::NONE || thumbnails[two] == Thumbnail_Store::NONE) return true;
+		return _thumbnails.correlate(thumbnails[one], thumbnails[two]) >= percentage;
+	};
 
-				// Iterate elements
-				for(; element != _dhash_database.cend(); element++){
-					compare_queue.insert(std::make_pair(file_id, element->first));
+	// Pairs of groups found by their tiles are kept if they are in scope, near each other, not found by their whole hashes and confirmed
+	auto add_tile_matches = [&](bool both_ways){
+		if(!_tile_matching) return;
+		std::vector<std::vector<unsigned int>> group_volumes(group_ids.size());
+		for(auto& cell : cells){
+			for(auto& group : cell.groups) group_volumes[group].push_back(cell.volume);
+		}
+		auto may_pair = [&](uint32_t one, uint32_t two) -> bool {
+			if(!keys[one].is_near(keys[two]) || Difference_Hash::distance(*dhashes[one], *dhashes[two]) <= max_distance) return false;
+			for(auto& volume_one : group_volumes[one]){
+				for(auto& volume_two : group_volumes[two]){
+					if(in_scope(scope, volume_one, volume_two)) return confirm(one, two);
+				}
+			}
+			return false;
+		};
+		auto& edges = buffers.front();
+		std::size_t first = edges.size();
+		compile_tile_matches(max_distance, num_threads, group_ids, may_pair, edges);
+		if(!both_ways){
+			std::size_t last = edges.size();
+			for(std::size_t edge = first; edge < last; edge++) edges.push_back(Distance_Edge{edges[edge].two, edges[edge].one, edges[edge].distance});
+		}
+	};
+
+	Distance_Graph graph;
+	bool record = !_distance_store_path.empty() && scope == Comparison_Scope::ALL && !_blocking && !_tile_matching; // A store only holds every pair of whole hashes
+
+	// Groups compared while they were inserted only need their pairs collected, those across blocks are dropped
+	if(scope == Comparison_Scope::ALL && read_online_matches(max_distance, group_ids, buffers.front())){
+		auto& edges = buffers.front();
+		edges.erase(std::remove_if(edges.begin(), edges.end(), [&](const Distance_Edge& edge){
+			return !keys[edge.one].is_near(keys[edge.two]);
+		}), edges.end());
+		if(record) save_distance_store(max_distance, group_ids, buffers);
+		confirm_by_thumbnails(num_threads, confirm, buffers);
+		add_tile_matches(true);
+		graph.build(buffers, group_ids.size(), true, _top_k, num_threads);
+		return graph;
+	}
+
+	// With a neighbor limit every dhash needs its whole row to pick its closest ones
+	if(_top_k != 0){
+		compile_dhash_nearest(max_distance, num_threads, dhashes, cells, near_cells, confirm, buffers);
+		add_tile_matches(false);
+		graph.build(buffers, group_ids.size(), false, _top_k, num_threads);
+		return graph;
+	}
+
+	// A store recorded from the same images at a looser percentage already holds every pair
+	if(record && read_distance_store(max_distance, group_ids, buffers.front())){
+		confirm_by_thumbnails(num_threads, confirm, buffers);
+		graph.build(buffers, group_ids.size(), true, 0, num_threads);
+		return graph;
+	}
+
+	// Pair up the cells that need to be compared, a cell paired with itself is compared within
+	std::vector<std::pair<const std::vector<uint32_t>*, const std::vector<uint32_t>*>> blocks;
+	for(std::size_t one = 0; one < cells.size(); one++){
+		for(auto& two : near_cells[one]){
+			if(two >= one) blocks.push_back(std::make_pair(&cells[one].groups, &cells[two].groups));
+		}
+	}
+
+	// Compare every dhash in a row of the block to the dhashes in the column of the block
+	Task_Queue<std::pair<std::size_t, std::size_t>> row_queue; // <block index, row index>
+	for(std::size_t block = 0; block < blocks.size(); block++){
+		for(std::size_t row = 0; row < blocks[block].first->size(); row++){
+			row_queue.insert(std::make_pair(block, row));
+		}
+	}
+
+	// Build the thread function
+	auto dhash_comparison_function = [&](unsigned int thread_index){
+		std::vector<Distance_Edge>& edges = buffers[thread_index];
+
+		// Finish all tasks
+		while(row_queue.task_count() != 0){
+
+			// Try to extract row queue
+			try{
+				// Extract
+				auto element = row_queue.poll();
+				auto& block = blocks[element.first];
+
+				// Get the Difference Hash of the row
+				uint32_t group = (*block.first)[element.second];
+				const Difference_Hash& first = *dhashes[group];
+
+				// Compare against the column, a block within a volume only needs the upper triangle
+				std::size_t column = block.first == block.second ? element.second + 1 : 0;
+				for(; column < block.second->size(); column++){
+					uint32_t other = (*block.second)[column];
+					if(other == group) continue;
+
+					// Keep the pair once if it is close enough
+					unsigned int distance = Difference_Hash::distance(first, *dhashes[other]);
+					if(distance <= max_distance) edges.push_back(Distance_Edge{group, other, (uint8_t)distance});
 				}
 
 				// Decrement task count
-				dhash_queue.decrement_task_count();
+				row_queue.decrement_task_count();
 
 			}catch(Pexception &e){
-				dhash_queue_results = false;
+				sleep_for(milliseconds(10)); // Relax for a bit
 			}
+		}
+	};
 
-			// Try to extract compare queue
-			try{
-				// Extract
-				auto element = compare_queue.poll();
+	// Create threads
+	std::list<std::unique_ptr<std::thread>> threads;
+	for(unsigned int i = 1; i < num_threads; i++){
+		std::unique_ptr<std::thread> thread = std::make_unique<std::thread>(dhash_comparison_function, i);
+		threads.push_back(std::move(thread));
+	}
 
-				// Get Difference Hashes
-				Difference_Hash* first = _dhash_database[element.first];
-				Difference_Hash* second = _dhash_database[element.second];
+	// Run on main thread
+	dhash_comparison_function(0);
 
-				// Get comparison results
-				float result_percent = Difference_Hash::compare(*first, *second);
+	// Join all threads if theres any
+	for(auto& thread : threads)
+		thread->join();
 
-				// If equal or exceed the expected percentage, insert
-				if(result_percent >= percentage){
+	// Keep the pairs closest first for later percentages
+	if(record) save_distance_store(max_distance, group_ids, buffers);
 
-					// Lock the results storage and insert results
-					std::unique_lock<std::mutex> lock_mutex(results_mutex);
+	confirm_by_thumbnails(num_threads, confirm, buffers);
+	add_tile_matches(true);
+	graph.build(buffers, group_ids.size(), true, 0, num_threads);
+	return graph;
+}
 
-					// Find first part of pair in the results map
-					auto search_dhash_results = results.find(element.first);
-					if(search_dhash_results == results.end()){
+bool Pcoll_Database::read_distance_store(unsigned int max_distance, const std::vector<std::size_t>& group_ids, std::vector<Distance_Edge>& edges){
+	struct stat buffer;
+	if(stat(_distance_store_path.c_str(), &buffer) != 0) return false;
+
+	Distance_Store store;
+	store.load(_distance_store_path);
+
+	// Only usable if it was recorded from the same groups at the same or a looser percentage
+	if(store.get_max_distance() < max_distance || store.get_groups().size() != group_ids.size()) return false;
+	std::unordered_map<std::size_t, uint32_t> group_numbers; // <File_Checksum id, group number>
+	for(uint32_t group = 0; group < group_ids.size(); group++) group_numbers[group_ids[group]] = group;
+	std::vector<uint32_t> numbers; // <store group number, group number>
+	numbers.reserve(group_ids.size());
+	for(auto& checksum : store.get_groups()){
+		auto search = group_numbers.find(std::hash<string>()(checksum));
+		if(search == group_numbers.end()) return false;
+		numbers.push_back(search->second);
+	}
 
-						// If it doesnt exist, create new map and put results in
-						unordered_map<std::size_t, float> map;
-						map.insert(std::make_pair(element.second, result_percent));
-						results.insert(std::make_pair(element.first, map));
+	store.for_each_edge(max_distance, [&](const Distance_Edge& edge){
+		edges.push_back(Distance_Edge{numbers[edge.one], numbers[edge.two], edge.distance});
+	});
+	return true;
+}
 
-					}else{
-						// It exists, update the map
-						search_dhash_results->second.insert(std::make_pair(element.second, result_percent));
-					}
+void Pcoll_Database::save_distance_store(unsigned int max_distance, const std::vector<std::size_t>& group_ids, const std::vector<std::vector<Distance_Edge>>& buffers){
+	Distance_Store store;
+	for(auto& chash_id : group_ids) store.add_group(get_checksum(chash_id));
+	for(auto& buffer : buffers) store.add_edges(buffer);
+	store.set_max_distance(max_distance);
+	store.sort();
+	store.save(_distance_store_path);
+}
 
-					// Vice versa - find second part of pair in the results map
-					search_dhash_results = results.find(element.second);
-					if(search_dhash_results == results.end()){
+bool Pcoll_Database::read_online_matches(unsigned int max_distance, const std::vector<std::size_t>& group_ids, std::vector<Distance_Edge>& edges){
 
-						// If it doesnt exist, create new map and put results in
-						unordered_map<std::size_t, float> map;
-						map.insert(std::make_pair(element.first, result_percent));
-						results.insert(std::make_pair(element.second, map));
+	// Only usable if every group was compared at the same or a looser percentage
+	if(!_online || _online->get_max_distance() < max_distance || _online->size() != group_ids.size()) return false;
+	std::unordered_map<std::size_t, uint32_t> group_numbers; // <File_Checksum id, group number>
+	for(uint32_t group = 0; group < group_ids.size(); group++) group_numbers[group_ids[group]] = group;
+
+	std::vector<Distance_Edge> matched;
+	for(auto& match : _online->get_matches()){
+		if(match.distance > max_distance) continue;
+		auto one = group_numbers.find(match.one);
+		auto two = group_numbers.find(match.two);
+		if(one == group_numbers.end() || two == group_numbers.end()) return false;
+		matched.push_back(Distance_Edge{one->second, two->second, match.distance});
+	}
+	edges.insert(edges.end(), matched.begin(), matched.end());
+	return true;
+}
+
+string Pcoll_Database::get_checksum(std::size_t chash_id){
+	const string* path = *_chash_to_path_set_database.at(chash_id).begin();
+	return _path_to_chash_database.at(std::hash<string>()(*path))->get_string();
+}
+
+void Pcoll_Database::compile_dhash_nearest(unsigned int max_distance, unsigned int num_threads, const std::vector<const Difference_Hash*>& dhashes, const std::vector<Comparison_Cell>& cells, const std::vector<std::vector<std::size_t>>& near_cells, const std::function<bool(uint32_t, uint32_t)>& confirm, std::vector<std::vector<Distance_Edge>>& buffers){
+
+	// Every row of every cell is a task
+	Task_Queue<std::pair<std::size_t, std::size_t>> row_queue; // <cell index, row index>
+	for(std::size_t cell = 0; cell < cells.size(); cell++){
+		for(std::size_t row = 0; row < cells[cell].groups.size(); row++){
+			row_queue.insert(std::make_pair(cell, row));
+		}
+	}
+
+	// Farthest on top, so it is the one replaced
+	auto farthest_on_top = [](const std::pair<unsigned int, uint32_t>& one, const std::pair<unsigned int, uint32_t>& two) -> bool {
+		return one.first < two.first;
+	};
 
-					}else{
-						// It exists, update the map
-						search_dhash_results->second.insert(std::make_pair(element.first, result_percent));
+	// Build the thread function
+	auto dhash_comparison_function = [&](unsigned int thread_index){
+		std::vector<Distance_Edge>& edges = buffers[thread_index];
+
+		// The closest dhashes of the current row, reused for every row this thread takes
+		std::vector<std::pair<unsigned int, uint32_t>> heap; // <distance, group number>
+		heap.reserve(_top_k + 1);
+
+		// Finish all tasks
+		while(row_queue.task_count() != 0){
+
+			// Try to extract row queue
+			try{
+				// Extract
+				auto element = row_queue.poll();
+
+				// Get the Difference Hash of the row
+				uint32_t group = cells[element.first].groups[element.second];
+				const Difference_Hash& first = *dhashes[group];
+
+				// Compare against every cell in scope and near it, keeping the closest confirmed ones
+				heap.clear();
+				for(auto& cell : near_cells[element.first]){
+					for(auto& other : cells[cell].groups){
+						if(other == group) continue;
+						unsigned int distance = Difference_Hash::distance(first, *dhashes[other]);
+						if(distance > max_distance || (heap.size() == _top_k && distance >= heap.front().first) || !confirm(group, other)) continue;
+						if(heap.size() < _top_k){
+							heap.push_back(std::make_pair(distance, other));
+							std::push_heap(heap.begin(), heap.end(), farthest_on_top);
+						}else{
+							std::pop_heap(heap.begin(), heap.end(), farthest_on_top);
+							heap.back() = std::make_pair(distance, other);
+							std::push_heap(heap.begin(), heap.end(), farthest_on_top);
+						}
 					}
 				}
 
+				// A checksum in several volumes has a row in each, the graph keeps the best of all of them
+				for(auto& entry : heap) edges.push_back(Distance_Edge{group, entry.second, (uint8_t)entry.first});
+
 				// Decrement task count
-				compare_queue.decrement_task_count();
+				row_queue.decrement_task_count();
 
 			}catch(Pexception &e){
-				compare_queue_results = false;
-			}
-
-			// If nothing is in the queues, wait a bit for other threads to populate it
-			if(!dhash_queue_results && !compare_queue_results){
 				sleep_for(milliseconds(10)); // Relax for a bit
 			}
 		}
@@ -356,24 +1313,106 @@ unordered_map<std::size_t, std::unordered_map<std::size_t, float>> Pcoll_Databas
 
 	// Create threads
 	std::list<std::unique_ptr<std::thread>> threads;
-	for(unsigned int i = 0; i < num_threads-1; i++){
-		std::unique_ptr<std::thread> thread = std::make_unique<std::thread>(dhash_comparison_function);
+	for(unsigned int i = 1; i < num_threads; i++){
+		std::unique_ptr<std::thread> thread = std::make_unique<std::thread>(dhash_comparison_function, i);
 		threads.push_back(std::move(thread));
 	}
 
-	// Populate dhash_queue
-	for(auto entry = _dhash_database.cbegin(); entry != _dhash_database.cend(); entry++){
-		dhash_queue.insert(entry);
+	// Run on main thread
+	dhash_comparison_function(0);
+
+	// Join all threads if theres any
+	for(auto& thread : threads)
+		thread->join();
+}
+
+void Pcoll_Database::confirm_by_thumbnails(unsigned int num_threads, const std::function<bool(uint32_t, uint32_t)>& confirm, std::vector<std::vector<Distance_Edge>>& buffers){
+	if(!_thumbnails.is_open()) return;
+
+	// Drop the pairs that are not confirmed
+	auto confirm_function = [&](unsigned int thread_index){
+		for(std::size_t buffer = thread_index; buffer < buffers.size(); buffer += num_threads){
+			auto& edges = buffers[buffer];
+			edges.erase(std::remove_if(edges.begin(), edges.end(), [&](const Distance_Edge& edge){
+				return !confirm(edge.one, edge.two);
+			}), edges.end());
+		}
+	};
+
+	// Create threads
+	std::list<std::unique_ptr<std::thread>> threads;
+	for(unsigned int i = 1; i < num_threads; i++)
+		threads.push_back(std::make_unique<std::thread>(confirm_function, i));
+
+	// Run on main thread
+	confirm_function(0);
+
+	// Join all threads if theres any
+	for(auto& thread : threads)
+		thread->join();
+}
+
+void Pcoll_Database::compile_tile_matches(unsigned int max_distance, unsigned int num_threads, const std::vector<std::size_t>& group_ids, const std::function<bool(uint32_t, uint32_t)>& may_pair, std::vector<Distance_Edge>& edges){
+
+	// Number every tile of every group
+	std::vector<std::pair<uint32_t, uint8_t>> tiles; // <group number, tile in the layout>
+	std::vector<uint64_t> hashes;
+	{
+		std::shared_lock<std::shared_mutex> lock(_tile_database_mutex);
+		for(uint32_t group = 0; group < group_ids.size(); group++){
+			auto search = _tile_database.find(group_ids[group]);
+			if(search == _tile_database.end()) continue;
+			for(auto& tile : search->second){
+				tiles.push_back(std::make_pair(group, tile.tile));
+				hashes.push_back(tile.hash);
+			}
+		}
 	}
+	if(tiles.empty()) return;
+
+	// Tiles are only compared with the tiles they share a band with, a looser distance would need too many narrow bands
+	Hamming_Index index(std::min(max_distance, MAX_TILE_DISTANCE));
+	std::atomic<std::size_t> next_tile(0);
+	auto tile_function = [&](){
+		std::size_t tile;
+		while((tile = next_tile.fetch_add(1)) < tiles.size()) index.add(tile, hashes[tile]);
+	};
+
+	// Create threads
+	std::list<std::unique_ptr<std::thread>> threads;
+	for(unsigned int i = 1; i < num_threads; i++)
+		threads.push_back(std::make_unique<std::thread>(tile_function));
 
-	// Run on main thread// Run on main thread
-	dhash_comparison_function();
+	// Run on main thread
+	tile_function();
 
 	// Join all threads if theres any
 	for(auto& thread : threads)
 		thread->join();
 
-	return results;
+	// Collect the tiles every pair of groups shares
+	struct Shared_Tiles {
+		std::bitset<Tile_Hashes::TILE_COUNT> one; // tiles of the first group matched
+		std::bitset<Tile_Hashes::TILE_COUNT> two; // tiles of the second group matched
+		bool frame; // the whole picture of one group matched a tile of the other
+	};
+	std::unordered_map<uint64_t, Shared_Tiles> pairs; // <group numbers, shared tiles>
+	for(auto& match : index.get_matches()){
+		auto one = tiles[match.one], two = tiles[match.two];
+		if(one.first == two.first) continue;
+		if(one.first > two.first) std::swap(one, two);
+		auto& shared = pairs.emplace(((uint64_t)one.first << 32) | two.first, Shared_Tiles{{}, {}, false}).first->second;
+		shared.one.set(one.second);
+		shared.two.set(two.second);
+		if(Tile_Hashes::is_frame(one.second) || Tile_Hashes::is_frame(two.second)) shared.frame = true; // a crop is a scaled down tile of its original
+	}
+
+	// Enough distinct tiles on both sides, or the whole picture of one, make a pair
+	for(auto& pair : pairs){
+		if(std::min(pair.second.one.count(), pair.second.two.count()) < MIN_SHARED_TILES && !pair.second.frame) continue;
+		uint32_t one = pair.first >> 32, two = pair.first & 0xFFFFFFFF;
+		if(may_pair(one, two)) edges.push_back(Distance_Edge{one, two, (uint8_t)max_distance}); // Tiles only match parts of the pictures, so report them at the loosest similarity asked for
+	}
 }
 
 void Pcoll_Database::print_progress(const unsigned int task_count, const unsigned int collisions){
@@ -9,9 +9,21 @@
 #include <list>
 #include <utility>
 #include <functional>
+#include <vector>
+#include <map>
+#include <memory>
 
 #include "diffhash.hpp"
 #include "filechecksum.hpp"
+#include "file_reader.hpp"
+#include "decode_scheduler.hpp"
+#include "progress_reporter.hpp"
+#include "result_view.hpp"
+#include "distance_store.hpp"
+#include "hamming_index.hpp"
+#include "blocking_key.hpp"
+#include "tile_hashes.hpp"
+#include "thumbnail_store.hpp"
 
 using std::string;
 
@@ -22,20 +34,210 @@ struct Results {
 	std::list<std::pair<string, std::list<std::pair<string, float>>>> collisions;
 };
 
+/** File attributes recorded when a file is inserted */
+struct File_Info {
+	File_Info() : volume(0), size(0), modified(0), original(0) {}
+	unsigned int volume; // index or scan the file came from
+	unsigned long int size; // size in bytes, of the archive for its members
+	long long int modified; // modification time in nanoseconds, of the archive for its members
+	std::size_t original; // id of the first path to the same file for aliases, zero otherwise
+};
+
+/** Selects which entries are compared against each other */
+enum class Comparison_Scope {
+	ALL, // every entry against every other entry
+	CROSS_VOLUME, // only entries that came from different volumes
+	LATEST_VOLUME // only pairs that have an entry from the highest volume
+};
+
 class Pcoll_Database{
 public:
 	Pcoll_Database();
 	~Pcoll_Database();
 	void insert(std::string& path);
+	void insert(std::string& path, unsigned int volume);
+
+	/** Inserts a file that has already been read into memory
+	 *	@param buffer the file contents
+	 *	@param volume volume number given to the file
+	 */
+	void insert(const File_Buffer& buffer, unsigned int volume);
+
+	/** Inserts a file that has already been read into memory and hashed
+	 *	@param buffer the file contents
+	 *	@param hash checksum of the contents, owned by the database afterwards
+	 *	@param volume volume number given to the file
+	 */
+	void insert(const File_Buffer& buffer, File_Checksum* hash, unsigned int volume);
+
+	/** Inserts a file held in memory by the caller, the contents are read in place
+	 *	@param path name of the file, its extension picks the image format
+	 *	@param data file contents
+	 *	@param size size of the file contents
+	 *	@param modified modification time in nanoseconds
+	 *	@param hash checksum of the contents, owned by the database afterwards
+	 *	@param volume volume number given to the file
+	 */
+	void insert(const std::string& path, const char* data, unsigned long int size, long long int modified, File_Checksum* hash, unsigned int volume);
+
+	/** Writes every entry in the database to an index file
+	 *	@param index_path path of the index file
+	 */
+	void save_index(const std::string& index_path);
+
+	/** Reads entries from an index file into the database without reading the indexed files
+	 *	@param index_path path of the index file
+	 *	@param volume volume number given to every entry in the index
+	 */
+	void load_index(const std::string& index_path, unsigned int volume);
+
+	/** Reads entries from an index file into the database without reading the indexed files
+	 *	@param index_path path of the index file
+	 *	@param volume volume number given to every entry in the index
+	 *	@param verify if true, entries whose file is gone or has changed size or modification time are dropped, members of archives are checked by their archive
+	 *	@param decode_images if true, indexed images outside of archives are decoded again for what an index does not hold, like tile hashes
+	 */
+	void load_index(const std::string& index_path, unsigned int volume, bool verify, bool decode_images);
+
+	/** @return first line of an index file */
+	static std::string get_index_header();
+
+	/** Calls a function with the index entry of every file inserted from then on, entries read from an index excluded
+	 *	@param function called with one index line without its line break, nullptr for none
+	 */
+	void set_insert_log(const std::function<void(const std::string&)>& function);
+
+	/** Inserts another path to a file that is already in the database without reading it
+	 *	Hardlinks and bind mounts reach one file by several paths. The alias shares the checksum of
+	 *	the first path and is never reported as a duplicate of it, nor saved in an index.
+	 *	Throws Pexception if the first path is not in the database or the alias can't be found.
+	 *	@param path path of the alias
+	 *	@param original first path to the file
+	 *	@param volume index or scan the file came from
+	 */
+	void insert_alias(const std::string& path, const std::string& original, unsigned int volume);
+
+	bool contains(const std::string& path);
+
+	/** Finds the files similar to one file in the database
+	 *	@param path path of the file
+	 *	@param percentage minimum similarity percentage
+	 *	@return paths of the similar files and their similarity, most similar first, the paths belong to the database
+	 */
+	std::vector<std::pair<const std::string*, float>> find_neighbors(const std::string& path, float percentage);
+
+	/** Compares the files of every exact checksum group byte for byte
+	 *	Files that differ from the rest of their group are split off into a group of their own.
+	 *	Needed when the checksum is not collision resistant.
+	 *	@param quiet no error output
+	 *	@param num_threads number of threads comparing groups
+	 */
+	void verify_exact_groups(bool quiet, unsigned int num_threads);
+
+	/** @return paths of the files of every exact checksum group with more than one file, aliases excluded, the paths belong to the database */
+	std::list<std::vector<const std::string*>> get_exact_groups();
+
+	/** Limits the memory taken by image decodes at once
+	 *	@param budget bytes, zero for no limit
+	 */
+	void set_memory_budget(unsigned long int budget);
+
+	/** Limits every image to its closest similar images when comparing
+	 *	Keeps memory proportional to the number of images no matter how similar they are.
+	 *	@param top_k most similar images kept per image, zero for every image above the percentage
+	 */
+	void set_top_k(unsigned int top_k);
+
+	/** Keeps the distances of a full comparison in a file
+	 *	A comparison records every pair within its percentage there. A later comparison of the same
+	 *	images at the same or a stricter percentage reads the pairs back instead of comparing again.
+	 *	@param path path of the distance store, empty for none
+	 */
+	void set_distance_store(const std::string& path);
+
+	/** Compares the difference hash of every new group as soon as it is inserted
+	 *	The pairs found while scanning are what a comparison of every entry at the same or a stricter
+	 *	percentage needs, so it only has to collect them afterwards.
+	 *	@param online if true, groups are compared while they are inserted
+	 *	@param percentage loosest similarity percentage the pairs are kept for
+	 */
+	void set_online_comparison(bool online, float percentage);
+
+	/** Checksums the image of every new JPEG without its metadata
+	 *	A JPEG whose image matches one inserted before is not decoded. It shares the difference hash of
+	 *	that one and is reported as identical to it.
+	 *	@param content_digests if true, JPEGs are checksummed without their metadata too
+	 */
+	void set_content_digests(bool content_digests);
+
+	/** Compares images only to those whose headers say they may be duplicates
+	 *	The aspect ratio, orientation, capture date and camera are read from the header of every new image.
+	 *	@param blocking if true, images in blocks that are not near each other are not compared
+	 */
+	void set_blocking(bool blocking);
+
+	/** Matches cropped and letterboxed copies by hashes of tiles of every new image
+	 *	@param tile_matching if true, images that share enough tiles are reported as similar too
+	 */
+	void set_tile_matching(bool tile_matching);
+
+	/** Keeps a thumbnail of every new image in a file and confirms similar pairs by their thumbnails
+	 *	@param path path of the store, empty for none
+	 *	@param read_only if true, the store is only used to confirm pairs and no thumbnails are added
+	 */
+	void set_thumbnail_store(const std::string& path, bool read_only);
+
 	unsigned int size();
+
+	/** @return counters tracking the progress of inserts, for a Progress_Reporter */
+	Progress_Counters& get_counters();
+
 	Results compile_similarity_results(bool quiet, float percentage);
 	Results compile_similarity_results(bool quiet, float percentage, unsigned int num_threads);
+	Results compile_similarity_results(bool quiet, float percentage, unsigned int num_threads, Comparison_Scope scope);
+
+	/** Compares every file and returns the matches without copying any path
+	 *	@param quiet no progress output
+	 *	@param percentage minimum similarity percentage
+	 *	@param num_threads number of threads comparing
+	 *	@param scope which entries are compared against each other
+	 *	@return view of the matches, only valid while the database is alive and unchanged
+	 */
+	Result_View compile_similarity_view(bool quiet, float percentage, unsigned int num_threads, Comparison_Scope scope);
 	void reset();
 private:
+	void insert(const std::string& path, File_Checksum* hash, Difference_Hash* dhash, const File_Info& info, bool compute_dhash, const char* data);
+	Difference_Hash* decode_image(std::size_t chash_id, const std::string& path, const std::string& checksum, const char* data, unsigned long int size);
+	void store_difference_hash(std::size_t chash_id, Difference_Hash* dhash);
+	static bool stat_entry(const std::string& path, File_Info& info);
+	bool same_file(const std::string& one, const std::string& two);
+	void write_index_entry(std::ostream& output, const std::string& path);
+	void log_insert(const std::string& path);
+	bool in_scope(Comparison_Scope scope, unsigned int volume_one, unsigned int volume_two) const;
+	unsigned int get_volume(const std::string& path);
 	void print_progress(const unsigned int task_count, const unsigned int collisions);
-	unordered_map<std::size_t, std::unordered_map<std::size_t, float>> compile_dhash_similarity(float percentage, unsigned int num_threads);
+	Distance_Graph compile_dhash_similarity(float percentage, unsigned int num_threads, Comparison_Scope scope, const std::vector<std::size_t>& group_ids);
+	bool read_distance_store(unsigned int max_distance, const std::vector<std::size_t>& group_ids, std::vector<Distance_Edge>& edges);
+	void save_distance_store(unsigned int max_distance, const std::vector<std::size_t>& group_ids, const std::vector<std::vector<Distance_Edge>>& buffers);
+	bool read_online_matches(unsigned int max_distance, const std::vector<std::size_t>& group_ids, std::vector<Distance_Edge>& edges);
+	void compare_online(std::size_t chash_id, const Difference_Hash& dhash);
+	bool share_image(const std::string& path, const char* data, unsigned long int size, std::size_t chash_id);
+	std::size_t get_image_group(std::size_t chash_id);
+	std::unordered_map<std::size_t, std::vector<std::size_t>> get_image_groups();
+	string get_checksum(std::size_t chash_id);
 
-	unsigned int _total;
+	/** The groups of one volume that share a blocking key */
+	struct Comparison_Cell {
+		unsigned int volume;
+		Blocking_Key key;
+		std::vector<uint32_t> groups; // group numbers
+	};
+	void compile_dhash_nearest(unsigned int max_distance, unsigned int num_threads, const std::vector<const Difference_Hash*>& dhashes, const std::vector<Comparison_Cell>& cells, const std::vector<std::vector<std::size_t>>& near_cells, const std::function<bool(uint32_t, uint32_t)>& confirm, std::vector<std::vector<Distance_Edge>>& buffers);
+	void confirm_by_thumbnails(unsigned int num_threads, const std::function<bool(uint32_t, uint32_t)>& confirm, std::vector<std::vector<Distance_Edge>>& buffers);
+	void compile_tile_matches(unsigned int max_distance, unsigned int num_threads, const std::vector<std::size_t>& group_ids, const std::function<bool(uint32_t, uint32_t)>& may_pair, std::vector<Distance_Edge>& edges);
+
+	std::atomic<unsigned int> _total;
+	unsigned int _latest_volume;
 
 	/** path string storage */
 	std::list<std::string*> _path_storage;
@@ -53,13 +255,65 @@ private:
 	std::unordered_map<std::size_t, File_Checksum*> _path_to_chash_database;
 	std::shared_mutex _path_to_chash_database_mutex;
 
+	/** path to file info database */
+	std::unordered_map<std::size_t, File_Info> _path_to_info_database;
+	std::shared_mutex _path_to_info_database_mutex;
+
 	/** checksum to set of paths database */
 	std::unordered_map<std::size_t, std::unordered_set<std::string*>> _chash_to_path_set_database;
 	std::shared_mutex _chash_to_path_set_database_mutex;
 
+	/** checksum to the first file of its group, the one its difference hash came from, under the same lock */
+	std::unordered_map<std::size_t, std::string*> _group_origin_database;
+
 	/** difference hash database */
 	std::unordered_map<std::size_t, Difference_Hash*> _dhash_database;
 	std::shared_mutex _dhash_database_mutex;
+
+	/** admits image decodes against the memory budget */
+	Decode_Scheduler _decode_scheduler;
+
+	/** progress of inserts */
+	Progress_Counters _counters;
+
+	/** most similar images kept per image, zero for no limit */
+	unsigned int _top_k;
+
+	/** path of the distance store, empty for none */
+	std::string _distance_store_path;
+
+	/** receives the index entry of every inserted file */
+	std::function<void(const std::string&)> _insert_log;
+
+	/** difference hashes compared while inserting, nullptr when comparing afterwards */
+	std::unique_ptr<Hamming_Index> _online;
+
+	/** JPEGs are checksummed without their metadata too */
+	bool _content_digests;
+
+	/** checksum of the image of a JPEG to the group it was first seen in */
+	std::unordered_map<std::size_t, std::size_t> _content_database;
+
+	/** groups that share the difference hash of the group with the same image */
+	std::unordered_map<std::size_t, std::size_t> _image_group_database;
+	std::shared_mutex _content_database_mutex;
+
+	/** images are only compared within blocks that are near each other */
+	bool _blocking;
+
+	/** checksum to blocking key database, groups without one match every block */
+	std::unordered_map<std::size_t, Blocking_Key> _blocking_database;
+	std::shared_mutex _blocking_database_mutex;
+
+	/** images are matched by their tiles too */
+	bool _tile_matching;
+
+	/** checksum to tile hashes database */
+	std::unordered_map<std::size_t, std::vector<Tile_Hash>> _tile_database;
+	std::shared_mutex _tile_database_mutex;
+
+	/** thumbnails of the groups, not open when pairs are not confirmed */
+	Thumbnail_Store _thumbnails;
 };
 
 #endif //__PCOLL_DATABASE__
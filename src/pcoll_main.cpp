@@ -2,6 +2,9 @@
 
 #include <iomanip>
 #include <regex>
+#include <cerrno>
+#include <cstdlib>
+#include <limits>
 #include <iostream>
 #include <string>
 #include <vector>
@@ -24,6 +27,8 @@ using std::list;
 using std::istream;
 
 static const float DEFAULT_SIMILARITY_PERCENTAGE = 0.9f;
+static const unsigned long int MAX_IO_DEPTH = 1024;
+static const unsigned long int MAX_MEMORY_BUDGET = std::numeric_limits<unsigned long int>::max() / (1024 * 1024); // in MiB
 
 string cleanFileBackSlash(const path &fpath){
 	string dir = fpath.string();
@@ -34,14 +39,70 @@ string cleanFileBackSlash(const path &fpath){
 	return dir;
 }
 
+bool parse_bounded(const char* text, unsigned long int max, unsigned long int& value){
+	if(!std::regex_match(text, std::regex("[0-9]+"))) return false;
+	errno = 0;
+	value = std::strtoul(text, nullptr, 10);
+	return errno != ERANGE && value <= max;
+}
+
 int usage(const char* program_name, const string& message){
     if(message.length() != 0) cerr << "ERROR: " << message << endl;
-    cout << "Usage: " << program_name << " -q -t <integer> -p <float/integer> <directory> ...<additional_directories> -n <excluded_directory> ...<excluded_directories>" << endl;
+    cout << "Usage: " << program_name << " -q -t <integer> -p <float/integer> --top-k <integer> -o <index> -u <index> --io-depth <integer> --memory-budget <integer> --digest <name> --verify --hdd --archives --distances <file> --dedupe <method> --dry-run --journal <file> --include <glob> --exclude <glob> --images-only --checkpoint <file> --resume --online --adaptive --jpeg-content --blocking --tiles --thumbnails <file> <directory> ...<additional_directories> -n <excluded_directory> ...<excluded_directories>" << endl;
+    cout << "       " << program_name << " -q -t <integer> -p <float/integer> --top-k <integer> --thumbnails <file> -o <index> -m <index> <index> ...<additional_indexes>" << endl;
+    cout << "       " << program_name << " -q -t <integer> -p <float/integer> --top-k <integer> --distances <file> --thumbnails <file> -r <index>" << endl;
+    cout << "       " << program_name << " -q --rollback <journal>" << endl;
     cout << "  [options]" << endl;
     cout << "\t-q :\tquiet mode - default is disabled" << endl;
-	cout << "\t-t :\tthread count - default is your CPU's core count" << endl;
+	cout << "\t-t :\tthread count - default is the number of cores available, within the CPU quota and affinity of the process" << endl;
 	cout << "\t-p :\tsimilarity percentage - set a minimum similarity percentage. " << endl;;
 	cout << "\t\tMust be either a float number between 0.0-1.0 or an integer between 0 and 100. Default value is " << DEFAULT_SIMILARITY_PERCENTAGE << endl;
+    cout << "\t--top-k :\tnearest neighbors - only report the given number of most similar images per image, still above the similarity percentage." << endl;
+    cout << "\t\tDefault is 0, which reports every image above the similarity percentage" << endl;
+    cout << "\t-o :\tindex output - save the hashes of every scanned or merged file to an index file" << endl;
+    cout << "\t-u :\tupdate mode - load a prior index, only hash new or changed files and report duplicates involving them." << endl;
+    cout << "\t\tThe new files are folded back into the index unless -o is given" << endl;
+    cout << "\t--io-depth :\tasynchronous reads - keep this many reads in flight from a dedicated reader (io_uring when available)." << endl;
+    cout << "\t\tAt most " << MAX_IO_DEPTH << ". Default is 0, which reads files synchronously in the worker threads" << endl;
+    cout << "\t--memory-budget :\tmemory budget - most memory in MiB that file buffers and image decodes take at once." << endl;
+    cout << "\t\tImages too big for it are decoded at a reduced resolution or one at a time. Default is 0, no limit" << endl;
+    cout << "\t--digest :\tchecksum digest - sha256 (default), sha256-mb (hashes up to eight files at once with AVX2, needs --io-depth)";
+#ifdef PCOLL_XXHASH
+    cout << ", xxh3 (XXH3-128, not cryptographic)";
+#endif
+#ifdef PCOLL_BLAKE3
+    cout << ", blake3";
+#endif
+    cout << endl;
+    cout << "\t--verify :\tverification - compare exact duplicates byte for byte, recommended with non-cryptographic digests" << endl;
+    cout << "\t--hdd :\tspinning disk mode - list every file first, then read them in the order they are stored on disk" << endl;
+#ifdef PCOLL_LIBARCHIVE
+    cout << "\t--archives :\tarchive mode - read the files inside zip and tar archives without extracting them, named like archive.zip!/dir/img.jpg" << endl;
+#endif
+    cout << "\t--dedupe :\tdeduplication - replace exact duplicates with a reflink (btrfs, XFS) or a hardlink of one file of their group" << endl;
+    cout << "\t\tafter comparing them byte for byte. Methods: reflink, hardlink" << endl;
+    cout << "\t--dry-run :\tdry run - only report the duplicates --dedupe would replace" << endl;
+    cout << "\t--journal :\tjournal - record every replacement of --dedupe in a file" << endl;
+    cout << "\t--rollback :\trollback mode - turn the replacements recorded in a journal back into files of their own" << endl;
+    cout << "\t--distances :\tdistance store - keep the distance of every pair above the similarity percentage in a file." << endl;
+    cout << "\t\tLater runs over the same images with the same or a higher percentage read it instead of comparing again" << endl;
+    cout << "\t--thumbnails :\tthumbnail store - keep a grayscale thumbnail of every image in a file and only report pairs" << endl;
+    cout << "\t\twhose thumbnails correlate at least as much as the similarity percentage. Later runs reuse the thumbnails" << endl;
+    cout << "\t-r :\treport mode - report similar images from an index without scanning, fast with --distances" << endl;
+    cout << "\t-m :\tmerge mode - merge the given indexes and only report duplicates found between different indexes" << endl;
+    cout << "\t--include :\tinclude glob - only read files that match one of the given globs, can be repeated" << endl;
+    cout << "\t--exclude :\texclude glob - skip files and directories that match the glob, can be repeated." << endl;
+    cout << "\t\tGlobs without a '/' match file names, others match paths and may use ** for any number of directories" << endl;
+    cout << "\t--images-only :\timage mode - skip files that are known not to be images by their extension or first bytes" << endl;
+    cout << "\t--checkpoint :\tcheckpoint - log every hashed file to a file while scanning, deleted once the scan finishes" << endl;
+    cout << "\t--resume :\tresume - continue an interrupted scan from its checkpoint without reading its hashed files again" << endl;
+    cout << "\t--online :\tonline mode - compare every image while scanning, so the results are ready when the last file is read" << endl;
+    cout << "\t--adaptive :\tadaptive mode - start up to twice as many scanning threads and keep as many of them working" << endl;
+    cout << "\t\tas raise throughput, fewer while memory runs short or the disks fall behind" << endl;
+    cout << "\t--jpeg-content :\tJPEG content mode - report JPEGs that differ only in their metadata as identical, decoding one of them" << endl;
+    cout << "\t--blocking :\tblocking mode - only compare images with a similar aspect ratio, the same orientation and camera" << endl;
+    cout << "\t\tand capture dates within about two months, as read from their headers. Missing facts match anything" << endl;
+    cout << "\t--tiles :\ttile mode - also match cropped and letterboxed copies by hashes of overlapping tiles at two scales" << endl;
     cout << "\t-n :\texclude flag - list directories you want to be excluded from the search" << endl;
     return -1;
 }
@@ -50,6 +111,22 @@ int usage(const char* program_name){
     return usage(program_name, "");
 }
 
+void print_results(const Result_View& results){
+	unsigned int count = 1;
+	std::unordered_set<unsigned int> files; // every file that is in a group or matched by one
+	for(auto group : results){
+		cout << count++ << "/" << results.size() << " images: " << group.size() << " - " << Utility::try_to_normalize_path(string(group.path())) << endl;
+		files.insert(group.file());
+		unsigned int inner_count = 1;
+		for(auto& edge : group){
+			cout << "\t" << inner_count++ << "/" << group.size() << " " << ((int)(edge.similarity * 100)) << "% - " << Utility::try_to_normalize_path(string(results.get_path(edge.file))) <<  endl;
+			files.insert(edge.file);
+		}
+		cout << endl;
+	}
+	cout << "Total similar files found: " << files.size() << endl;
+}
+
 int main(int argc, char* argv[]){
     // Write a welcome message
     cout << "pcoll v0.1 - finds similar pictures in directories" << endl;
@@ -63,9 +140,43 @@ int main(int argc, char* argv[]){
     bool quiet = false;
 	bool thread = false;
 	bool percent = false;
+	bool merge = false;
 	unsigned int thread_count = 1;
 	float percentage = DEFAULT_SIMILARITY_PERCENTAGE;
-	while(strcmp(argv[arg_pos], "-q") == 0 || strcmp(argv[arg_pos], "-t") == 0 || strcmp(argv[arg_pos], "-p") == 0){
+	string index_path;
+	string update_index_path;
+	bool depth = false;
+	unsigned int io_depth = 0;
+	bool budget = false;
+	unsigned long int memory_budget = 0;
+	unsigned int top_k = 0;
+	bool digest = false;
+	bool verify = false;
+	bool hdd = false;
+	bool archives = false;
+	string distance_store_path;
+	string thumbnail_store_path;
+	string report_index_path;
+	bool dedupe = false;
+	Dedupe_Method dedupe_method = Dedupe_Method::REFLINK;
+	bool dry_run = false;
+	string journal_path;
+	string rollback_path;
+	list<string> includes;
+	list<string> excludes;
+	bool images_only = false;
+	string checkpoint_path;
+	bool resume = false;
+	bool online = false;
+	bool adaptive = false;
+	bool jpeg_content = false;
+	bool blocking = false;
+	bool tiles = false;
+	while(arg_pos < (unsigned int)argc && argv[arg_pos][0] == '-' && strcmp(argv[arg_pos], "-n") != 0){
+
+		// Options that take a value need one
+		if(strcmp(argv[arg_pos], "-q") != 0 && strcmp(argv[arg_pos], "-m") != 0 && strcmp(argv[arg_pos], "--verify") != 0 && strcmp(argv[arg_pos], "--hdd") != 0 && strcmp(argv[arg_pos], "--archives") != 0 && strcmp(argv[arg_pos], "--dry-run") != 0 && strcmp(argv[arg_pos], "--images-only") != 0 && strcmp(argv[arg_pos], "--resume") != 0 && strcmp(argv[arg_pos], "--online") != 0 && strcmp(argv[arg_pos], "--adaptive") != 0 && strcmp(argv[arg_pos], "--jpeg-content") != 0 && strcmp(argv[arg_pos], "--blocking") != 0 && strcmp(argv[arg_pos], "--tiles") != 0 && arg_pos + 1 >= (unsigned int)argc)
+			return usage(argv[0], string("missing value for option ") + argv[arg_pos]);
 
 		// Quiet flag
 		if(strcmp(argv[arg_pos], "-q") == 0){
@@ -75,7 +186,7 @@ int main(int argc, char* argv[]){
 		}
 
 		// Threads count option
-		if(strcmp(argv[arg_pos], "-t") == 0){
+		else if(strcmp(argv[arg_pos], "-t") == 0){
 			if(thread == true) return usage(argv[0]);
 			arg_pos++;
 			if(!std::regex_match(argv[arg_pos], std::regex("[-]?([0-9]*.)?[0-9]+")))
@@ -92,7 +203,7 @@ int main(int argc, char* argv[]){
 		}
 
 		// Percentage option
-		if(strcmp(argv[arg_pos], "-p") == 0){
+		else if(strcmp(argv[arg_pos], "-p") == 0){
 			if(percent == true) return usage(argv[0]);
 			arg_pos++;
 			if(std::regex_match(argv[arg_pos], std::regex("[-]?[0-9]+"))){
@@ -110,6 +221,322 @@ int main(int argc, char* argv[]){
 			arg_pos++;
 			percent = true;
 		}
+
+		// Nearest neighbors option
+		else if(strcmp(argv[arg_pos], "--top-k") == 0){
+			if(top_k != 0) return usage(argv[0]);
+			arg_pos++;
+			if(!std::regex_match(argv[arg_pos], std::regex("[0-9]+")) || std::atoi(argv[arg_pos]) <= 0)
+				return usage(argv[0], "the neighbor count must be a positive integer above zero!");
+			top_k = std::atoi(argv[arg_pos]);
+			arg_pos++;
+		}
+
+		// Index output option
+		else if(strcmp(argv[arg_pos], "-o") == 0){
+			if(!index_path.empty()) return usage(argv[0]);
+			arg_pos++;
+			index_path = argv[arg_pos];
+			arg_pos++;
+		}
+
+		// Update mode option
+		else if(strcmp(argv[arg_pos], "-u") == 0){
+			if(!update_index_path.empty()) return usage(argv[0]);
+			arg_pos++;
+			update_index_path = argv[arg_pos];
+			if(!exists(path(update_index_path)) || is_directory(path(update_index_path)))
+				return usage(argv[0], "Index '" + update_index_path + "' does not exist");
+			arg_pos++;
+		}
+
+		// Asynchronous read depth option
+		else if(strcmp(argv[arg_pos], "--io-depth") == 0){
+			if(depth == true) return usage(argv[0]);
+			arg_pos++;
+			unsigned long int input;
+			if(!parse_bounded(argv[arg_pos], MAX_IO_DEPTH, input))
+				return usage(argv[0], "the io depth must be an integer ranging from 0 to " + std::to_string(MAX_IO_DEPTH) + "!");
+			io_depth = input;
+			arg_pos++;
+			depth = true;
+		}
+
+		// Memory budget option
+		else if(strcmp(argv[arg_pos], "--memory-budget") == 0){
+			if(budget == true) return usage(argv[0]);
+			arg_pos++;
+			if(!parse_bounded(argv[arg_pos], MAX_MEMORY_BUDGET, memory_budget))
+				return usage(argv[0], "the memory budget must be an integer ranging from 0 to " + std::to_string(MAX_MEMORY_BUDGET) + "!");
+			memory_budget *= 1024 * 1024;
+			arg_pos++;
+			budget = true;
+		}
+
+		// Digest option
+		else if(strcmp(argv[arg_pos], "--digest") == 0){
+			if(digest == true) return usage(argv[0]);
+			arg_pos++;
+			Checksum_Algorithm algorithm;
+			if(!File_Checksum::parse_algorithm(argv[arg_pos], algorithm))
+				return usage(argv[0], string("unknown or unavailable digest ") + argv[arg_pos]);
+			File_Checksum::set_algorithm(algorithm);
+			arg_pos++;
+			digest = true;
+		}
+
+		// Verification flag
+		else if(strcmp(argv[arg_pos], "--verify") == 0){
+			if(verify == true) return usage(argv[0]);
+			verify = true;
+			arg_pos++;
+		}
+
+		// Spinning disk flag
+		else if(strcmp(argv[arg_pos], "--hdd") == 0){
+			if(hdd == true) return usage(argv[0]);
+			hdd = true;
+			arg_pos++;
+		}
+
+		// Archive flag
+		else if(strcmp(argv[arg_pos], "--archives") == 0){
+			if(archives == true) return usage(argv[0]);
+#ifndef PCOLL_LIBARCHIVE
+			return usage(argv[0], "archive mode needs pcoll to be built with libarchive");
+#endif
+			archives = true;
+			arg_pos++;
+		}
+
+		// Deduplication option
+		else if(strcmp(argv[arg_pos], "--dedupe") == 0){
+			if(dedupe == true) return usage(argv[0]);
+			arg_pos++;
+			if(!Dedupe_Engine::parse_method(argv[arg_pos], dedupe_method))
+				return usage(argv[0], string("unknown dedupe method ") + argv[arg_pos]);
+			dedupe = true;
+			arg_pos++;
+		}
+
+		// Dry run flag
+		else if(strcmp(argv[arg_pos], "--dry-run") == 0){
+			if(dry_run == true) return usage(argv[0]);
+			dry_run = true;
+			arg_pos++;
+		}
+
+		// Journal option
+		else if(strcmp(argv[arg_pos], "--journal") == 0){
+			if(!journal_path.empty()) return usage(argv[0]);
+			arg_pos++;
+			journal_path = argv[arg_pos];
+			arg_pos++;
+		}
+
+		// Rollback mode option
+		else if(strcmp(argv[arg_pos], "--rollback") == 0){
+			if(!rollback_path.empty()) return usage(argv[0]);
+			arg_pos++;
+			rollback_path = argv[arg_pos];
+			if(!exists(path(rollback_path)) || is_directory(path(rollback_path)))
+				return usage(argv[0], "Journal '" + rollback_path + "' does not exist");
+			arg_pos++;
+		}
+
+		// Include glob option
+		else if(strcmp(argv[arg_pos], "--include") == 0){
+			arg_pos++;
+			includes.push_back(argv[arg_pos]);
+			arg_pos++;
+		}
+
+		// Exclude glob option
+		else if(strcmp(argv[arg_pos], "--exclude") == 0){
+			arg_pos++;
+			excludes.push_back(argv[arg_pos]);
+			arg_pos++;
+		}
+
+		// Image mode flag
+		else if(strcmp(argv[arg_pos], "--images-only") == 0){
+			if(images_only == true) return usage(argv[0]);
+			images_only = true;
+			arg_pos++;
+		}
+
+		// Checkpoint option
+		else if(strcmp(argv[arg_pos], "--checkpoint") == 0){
+			if(!checkpoint_path.empty()) return usage(argv[0]);
+			arg_pos++;
+			checkpoint_path = argv[arg_pos];
+			arg_pos++;
+		}
+
+		// Resume flag
+		else if(strcmp(argv[arg_pos], "--resume") == 0){
+			if(resume == true) return usage(argv[0]);
+			resume = true;
+			arg_pos++;
+		}
+
+		// Online mode flag
+		else if(strcmp(argv[arg_pos], "--online") == 0){
+			if(online == true) return usage(argv[0]);
+			online = true;
+			arg_pos++;
+		}
+
+		// Adaptive mode flag
+		else if(strcmp(argv[arg_pos], "--adaptive") == 0){
+			if(adaptive == true) return usage(argv[0]);
+			adaptive = true;
+			arg_pos++;
+		}
+
+		// JPEG content mode flag
+		else if(strcmp(argv[arg_pos], "--jpeg-content") == 0){
+			if(jpeg_content == true) return usage(argv[0]);
+			jpeg_content = true;
+			arg_pos++;
+		}
+
+		// Blocking mode flag
+		else if(strcmp(argv[arg_pos], "--blocking") == 0){
+			if(blocking == true) return usage(argv[0]);
+			blocking = true;
+			arg_pos++;
+		}
+
+		// Tile mode flag
+		else if(strcmp(argv[arg_pos], "--tiles") == 0){
+			if(tiles == true) return usage(argv[0]);
+			tiles = true;
+			arg_pos++;
+		}
+
+		// Distance store option
+		else if(strcmp(argv[arg_pos], "--distances") == 0){
+			if(!distance_store_path.empty()) return usage(argv[0]);
+			arg_pos++;
+			distance_store_path = argv[arg_pos];
+			arg_pos++;
+		}
+
+		// Thumbnail store option
+		else if(strcmp(argv[arg_pos], "--thumbnails") == 0){
+			if(!thumbnail_store_path.empty()) return usage(argv[0]);
+			arg_pos++;
+			thumbnail_store_path = argv[arg_pos];
+			arg_pos++;
+		}
+
+		// Report mode option
+		else if(strcmp(argv[arg_pos], "-r") == 0){
+			if(!report_index_path.empty()) return usage(argv[0]);
+			arg_pos++;
+			report_index_path = argv[arg_pos];
+			if(!exists(path(report_index_path)) || is_directory(path(report_index_path)))
+				return usage(argv[0], "Index '" + report_index_path + "' does not exist");
+			arg_pos++;
+		}
+
+		// Merge mode flag
+		else if(strcmp(argv[arg_pos], "-m") == 0){
+			if(merge == true) return usage(argv[0]);
+			merge = true;
+			arg_pos++;
+		}
+
+		else return usage(argv[0], string("unknown option ") + argv[arg_pos]);
+	}
+
+	// Build the run settings
+	Pcoll_Options options;
+	options.quiet = quiet;
+	options.percentage = percentage;
+	options.num_threads = thread ? thread_count : Utility::get_default_cores_count();
+	options.index_path = index_path;
+	options.update_index_path = update_index_path;
+	options.io_depth = io_depth;
+	options.verify = verify;
+	options.hdd = hdd;
+	options.memory_budget = memory_budget;
+	options.archives = archives;
+	options.top_k = top_k;
+	options.distance_store_path = distance_store_path;
+	options.thumbnail_store_path = thumbnail_store_path;
+	options.dedupe = dedupe;
+	options.dedupe_method = dedupe_method;
+	options.dry_run = dry_run;
+	options.journal_path = journal_path;
+	options.includes = includes;
+	options.excludes = excludes;
+	options.images_only = images_only;
+	options.checkpoint_path = checkpoint_path;
+	options.resume = resume;
+	options.online = online;
+	options.adaptive = adaptive;
+	options.jpeg_content = jpeg_content;
+	options.blocking = blocking;
+	options.tiles = tiles;
+
+	// Rollback mode only reads the journal
+	if(!rollback_path.empty()){
+		if(arg_pos != (unsigned int)argc) return usage(argv[0], "rollback mode takes no directories");
+		try{
+			unsigned int count = Dedupe_Engine::rollback(rollback_path, quiet);
+			cout << "Restored " << count << " files" << endl;
+		}catch(Pexception& pe){
+			cerr << "ERROR: " << pe.what() << endl;
+			return -1;
+		}
+		return 0;
+	}
+	if((dry_run || !journal_path.empty()) && !dedupe) return usage(argv[0], "--dry-run and --journal need --dedupe");
+	if(dedupe && (merge || !report_index_path.empty())) return usage(argv[0], "--dedupe needs a scan");
+	if(resume && checkpoint_path.empty()) return usage(argv[0], "--resume needs --checkpoint");
+	if(!checkpoint_path.empty() && (merge || !report_index_path.empty())) return usage(argv[0], "--checkpoint needs a scan");
+	if(adaptive && (merge || !report_index_path.empty())) return usage(argv[0], "adaptive mode needs a scan");
+	if(online && (merge || !report_index_path.empty() || !update_index_path.empty())) return usage(argv[0], "online mode needs a full scan");
+	if(jpeg_content && (merge || !report_index_path.empty())) return usage(argv[0], "JPEG content mode needs a scan");
+	if(blocking && (merge || !report_index_path.empty())) return usage(argv[0], "blocking mode needs a scan");
+	if(tiles && (merge || !report_index_path.empty())) return usage(argv[0], "tile mode needs a scan");
+
+	// Report mode only reads the index
+	if(!report_index_path.empty()){
+		if(merge || !update_index_path.empty()) return usage(argv[0], "report mode cannot be combined with merge or update mode");
+		if(arg_pos != (unsigned int)argc) return usage(argv[0], "report mode takes no directories");
+		try{
+			Pcoll_Database db;
+			print_results(Pcoll::report_index(report_index_path, options, db));
+		}catch(Pexception& pe){
+			cerr << "ERROR: " << pe.what() << endl;
+			return -1;
+		}
+		return 0;
+	}
+
+	// Merge mode takes index files instead of directories
+	if(merge && !update_index_path.empty()) return usage(argv[0], "merge mode and update mode cannot be combined");
+	if(merge){
+		list<string> indexes;
+		for(unsigned int i = arg_pos; i < (unsigned int)argc; i++){
+			path index(argv[i]);
+			if(!exists(index)) return usage(argv[0], "Index '" + index.string() + "' does not exist");
+			if(is_directory(index)) return usage(argv[0], "Specified path '" + index.string() + "' is not an index file");
+			indexes.push_back(index.string());
+		}
+		if(indexes.size() < 2) return usage(argv[0], "merge mode needs at least two indexes");
+
+		try{
+			Pcoll_Database db;
+			print_results(Pcoll::merge_indexes(indexes, options, db));
+		}catch(Pexception& pe){
+			cerr << "ERROR: " << pe.what() << endl;
+			return -1;
+		}
+		return 0;
 	}
 
     // Process the arguments and check them for errors
@@ -156,19 +583,12 @@ int main(int argc, char* argv[]){
     }
 
     // Start the hasher
-	auto results = thread ?
-		Pcoll::find_similar_images(directories, exclude, quiet, percentage, thread_count) :
-		Pcoll::find_similar_images(directories, exclude, quiet, percentage, Utility::get_default_cores_count());
-
-	// Show results
-	unsigned int count = 1;
-	for(auto& entry : results.collisions){
-		cout << count++ << "/" << results.collisions.size() << " images: " << entry.second.size() << " - " << Utility::try_to_normalize_path(entry.first) << endl;
-		unsigned int inner_count = 1;
-		for(auto& inner : entry.second){
-			cout << "\t" << inner_count++ << "/" << entry.second.size() << " " << ((int)(inner.second * 100)) << "% - " << Utility::try_to_normalize_path(inner.first) <<  endl;
-		}
-		cout << endl;
+	options.exclude = exclude;
+	try{
+		Pcoll_Database db;
+		print_results(Pcoll::find_similar_images(directories, options, db));
+	}catch(Pexception& pe){
+		cerr << "ERROR: " << pe.what() << endl;
+		return -1;
 	}
-	cout << "Total similar files found: " << results.files << endl;
 }
@@ -0,0 +1,79 @@
+#include "progress_reporter.hpp"
+#include "utility.hpp"
+
+#include <sstream>
+#include <iomanip>
+
+using std::chrono::steady_clock;
+using std::chrono::duration;
+
+/** Weight of the latest sample in the smoothed rates */
+static const double RATE_SMOOTHING = 0.3;
+
+Progress_Reporter::Progress_Reporter(const Progress_Counters& counters, std::chrono::milliseconds interval) :
+	_counters(counters),
+	_interval(interval),
+	_stopping(false),
+	_mutex(),
+	_condition(),
+	_thread()
+{
+	_thread = std::make_unique<std::thread>(&Progress_Reporter::thread_function, this);
+}
+
+Progress_Reporter::~Progress_Reporter(){
+	{
+		std::unique_lock<std::mutex> lock(_mutex);
+		_stopping = true;
+	}
+	_condition.notify_all();
+	_thread->join();
+}
+
+void Progress_Reporter::thread_function(){
+	unsigned long int last_files = 0, last_bytes = 0, last_images = 0;
+	double file_rate = 0, byte_rate = 0, image_rate = 0;
+	auto last_time = steady_clock::now();
+
+	while(true){
+		{
+			std::unique_lock<std::mutex> lock(_mutex);
+			if(_condition.wait_for(lock, _interval, [&](){ return _stopping; })) return;
+		}
+
+		// Sample the counters
+		unsigned long int found = _counters.files_found;
+		unsigned long int files = _counters.files_done;
+		unsigned long int bytes = _counters.bytes_hashed;
+		unsigned long int images = _counters.images_decoded;
+		unsigned long int groups = _counters.groups;
+
+		// Rates of every stage since the last sample, smoothed
+		auto now = steady_clock::now();
+		double seconds = duration<double>(now - last_time).count();
+		if(seconds <= 0) continue;
+		file_rate += RATE_SMOOTHING * ((files - last_files) / seconds - file_rate);
+		byte_rate += RATE_SMOOTHING * ((bytes - last_bytes) / seconds - byte_rate);
+		image_rate += RATE_SMOOTHING * ((images - last_images) / seconds - image_rate);
+		last_files = files;
+		last_bytes = bytes;
+		last_images = images;
+		last_time = now;
+
+		// Build the string
+		std::stringstream ss;
+		ss << std::fixed << std::setprecision(1);
+		ss << " files: " << files << "/" << found << " (" << file_rate << "/s)";
+		ss << "  read: " << bytes / (1024.0 * 1024.0) << " MiB (" << byte_rate / (1024.0 * 1024.0) << " MiB/s)";
+		ss << "  images: " << images << " (" << image_rate << "/s)";
+		ss << "  groups: " << groups;
+
+		// Time left for the files found so far
+		if(file_rate >= 0.1 && found > files){
+			unsigned long int eta = (found - files) / file_rate;
+			ss << "  ETA: " << eta / 60 << ":" << std::setw(2) << std::setfill('0') << eta % 60;
+		}
+
+		Utility::sout.print(ss.str());
+	}
+}
@@ -0,0 +1,49 @@
+#ifndef __PCOLL_PROGRESS_REPORTER__
+#define __PCOLL_PROGRESS_REPORTER__
+
+#include <atomic>
+#include <chrono>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <memory>
+#include <string>
+
+/** Counters bumped by the workers and sampled by the reporter */
+struct Progress_Counters {
+	Progress_Counters() : files_found(0), files_done(0), bytes_hashed(0), images_decoded(0), groups(0) {}
+	std::atomic<unsigned long int> files_found; // files queued for hashing
+	std::atomic<unsigned long int> files_done; // files hashed, skipped or failed
+	std::atomic<unsigned long int> bytes_hashed; // bytes of file contents checksummed
+	std::atomic<unsigned long int> images_decoded; // images given a difference hash
+	std::atomic<unsigned long int> groups; // distinct checksums
+};
+
+/** Prints the progress of a scan from a thread of its own
+ *	The counters are sampled at a fixed interval, so the workers only ever increment them.
+ */
+class Progress_Reporter {
+public:
+	/** Starts the reporter thread
+	 *	@param counters counters to sample, must outlive the reporter
+	 *	@param interval time between two reports
+	 */
+	Progress_Reporter(const Progress_Counters& counters, std::chrono::milliseconds interval);
+
+	/** Stops the reporter thread */
+	~Progress_Reporter();
+	Progress_Reporter(const Progress_Reporter& other) = delete;
+	Progress_Reporter& operator=(const Progress_Reporter& other) = delete;
+
+private:
+	void thread_function();
+
+	const Progress_Counters& _counters;
+	std::chrono::milliseconds _interval;
+	bool _stopping;
+	std::mutex _mutex;
+	std::condition_variable _condition;
+	std::unique_ptr<std::thread> _thread;
+};
+
+#endif //__PCOLL_PROGRESS_REPORTER__
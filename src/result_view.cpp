@@ -0,0 +1,56 @@
+#include "result_view.hpp"
+
+Result_Group::Result_Group(const Result_View& view, std::size_t index) : _view(&view), _index(index) {}
+
+unsigned int Result_Group::file() const{
+	return _view->_group_files[_index];
+}
+
+std::string_view Result_Group::path() const{
+	return _view->get_path(file());
+}
+
+const Result_Edge* Result_Group::begin() const{
+	return _view->_edges.data() + _view->_group_offsets[_index];
+}
+
+const Result_Edge* Result_Group::end() const{
+	return _view->_edges.data() + _view->_group_offsets[_index + 1];
+}
+
+std::size_t Result_Group::size() const{
+	return _view->_group_offsets[_index + 1] - _view->_group_offsets[_index];
+}
+
+Result_View::Result_View() : _paths(), _group_files(), _group_offsets(1, 0), _edges() {}
+
+Result_View::Result_View(std::vector<const std::string*>&& paths, std::vector<unsigned int>&& group_files, std::vector<std::size_t>&& group_offsets, std::vector<Result_Edge>&& edges) :
+	_paths(std::move(paths)),
+	_group_files(std::move(group_files)),
+	_group_offsets(std::move(group_offsets)),
+	_edges(std::move(edges))
+{}
+
+std::size_t Result_View::size() const{
+	return _group_files.size();
+}
+
+std::size_t Result_View::get_edge_count() const{
+	return _edges.size();
+}
+
+Result_Group Result_View::operator[](std::size_t index) const{
+	return Result_Group(*this, index);
+}
+
+Result_View::Iterator Result_View::begin() const{
+	return Iterator(*this, 0);
+}
+
+Result_View::Iterator Result_View::end() const{
+	return Iterator(*this, size());
+}
+
+std::string_view Result_View::get_path(unsigned int file) const{
+	return *_paths[file];
+}
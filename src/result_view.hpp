@@ -0,0 +1,89 @@
+#ifndef __PCOLL_RESULT_VIEW__
+#define __PCOLL_RESULT_VIEW__
+
+#include <string>
+#include <string_view>
+#include <vector>
+#include <cstddef>
+
+/** A match of a file against another file */
+struct Result_Edge {
+	unsigned int file; // id of the other file
+	float similarity; // 1.0 for identical contents
+};
+
+class Result_View;
+
+/** A file and every file it matches, most similar first */
+class Result_Group {
+public:
+	Result_Group(const Result_View& view, std::size_t index);
+
+	/** @return id of the file */
+	unsigned int file() const;
+
+	/** @return path of the file, points into the database */
+	std::string_view path() const;
+
+	const Result_Edge* begin() const;
+	const Result_Edge* end() const;
+	std::size_t size() const;
+
+private:
+	const Result_View* _view;
+	std::size_t _index;
+};
+
+/** Similarity results that refer to the database instead of copying it
+ *	Files are identified by ids and their paths are resolved on demand from the database storage, so
+ *	the database must outlive the view. Groups are ordered by their number of matches, most first.
+ */
+class Result_View {
+public:
+	/** Iterates over the groups of a view */
+	class Iterator {
+	public:
+		Iterator(const Result_View& view, std::size_t index) : _view(&view), _index(index) {}
+		Result_Group operator*() const { return Result_Group(*_view, _index); }
+		Iterator& operator++(){ _index++; return *this; }
+		bool operator!=(const Iterator& other) const { return _index != other._index; }
+		bool operator==(const Iterator& other) const { return _index == other._index; }
+	private:
+		const Result_View* _view;
+		std::size_t _index;
+	};
+
+	/** Construct an empty view */
+	Result_View();
+
+	/** Construct a view
+	 *	@param paths path of every file id, owned by the database
+	 *	@param group_files file id of every group
+	 *	@param group_offsets index of the first edge of every group, followed by the number of edges
+	 *	@param edges edges of all groups, one group after another
+	 */
+	Result_View(std::vector<const std::string*>&& paths, std::vector<unsigned int>&& group_files, std::vector<std::size_t>&& group_offsets, std::vector<Result_Edge>&& edges);
+
+	/** @return number of groups */
+	std::size_t size() const;
+
+	/** @return number of edges in all groups */
+	std::size_t get_edge_count() const;
+
+	Result_Group operator[](std::size_t index) const;
+	Iterator begin() const;
+	Iterator end() const;
+
+	/** @return path of a file id, points into the database */
+	std::string_view get_path(unsigned int file) const;
+
+private:
+	friend class Result_Group;
+
+	std::vector<const std::string*> _paths;
+	std::vector<unsigned int> _group_files;
+	std::vector<std::size_t> _group_offsets;
+	std::vector<Result_Edge> _edges;
+};
+
+#endif //__PCOLL_RESULT_VIEW__
@@ -0,0 +1,174 @@
+#include "sha256_multi_buffer.hpp"
+
+#include <cstring>
+#include <cstdint>
+#include <algorithm>
+#include <openssl/evp.h>
+
+// The lanes are AVX2 registers, other architectures hash one buffer at a time
+#if defined(__x86_64__) || defined(__i386__)
+#define PCOLL_SHA256_LANES
+#include <immintrin.h>
+#endif
+
+#ifdef PCOLL_SHA256_LANES
+static const uint32_t K[64] = {
+	0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5,
+	0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3, 0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174,
+	0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+	0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147, 0x06ca6351, 0x14292967,
+	0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13, 0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85,
+	0xa2bfe8a1, 0xa81a664b, 0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+	0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f, 0x682e6ff3,
+	0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208, 0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2
+};
+
+static const uint32_t H0[8] = {
+	0x6a09e667, 0xbb67ae85, 0x3c6ef372, 0xa54ff53a, 0x510e527f, 0x9b05688c, 0x1f83d9ab, 0x5be0cd19
+};
+
+static const unsigned int BLOCK_SIZE = 64;
+
+static inline uint32_t load_big_endian(const unsigned char* p){
+	return ((uint32_t)p[0] << 24) | ((uint32_t)p[1] << 16) | ((uint32_t)p[2] << 8) | (uint32_t)p[3];
+}
+
+__attribute__((target("avx2")))
+static inline __m256i rotate_right(__m256i x, int n){
+	return _mm256_or_si256(_mm256_srli_epi32(x, n), _mm256_slli_epi32(x, 32 - n));
+}
+
+/** Runs the compression function on one block of every lane */
+__attribute__((target("avx2")))
+static void compress(__m256i* state, const unsigned char* const* blocks){
+
+	// Message schedule, one word of every lane per register
+	__m256i w[64];
+	for(unsigned int t = 0; t < 16; t++){
+		w[t] = _mm256_set_epi32(
+			load_big_endian(blocks[7] + 4 * t), load_big_endian(blocks[6] + 4 * t),
+			load_big_endian(blocks[5] + 4 * t), load_big_endian(blocks[4] + 4 * t),
+			load_big_endian(blocks[3] + 4 * t), load_big_endian(blocks[2] + 4 * t),
+			load_big_endian(blocks[1] + 4 * t), load_big_endian(blocks[0] + 4 * t));
+	}
+	for(unsigned int t = 16; t < 64; t++){
+		__m256i s0 = _mm256_xor_si256(_mm256_xor_si256(rotate_right(w[t - 15], 7), rotate_right(w[t - 15], 18)), _mm256_srli_epi32(w[t - 15], 3));
+		__m256i s1 = _mm256_xor_si256(_mm256_xor_si256(rotate_right(w[t - 2], 17), rotate_right(w[t - 2], 19)), _mm256_srli_epi32(w[t - 2], 10));
+		w[t] = _mm256_add_epi32(_mm256_add_epi32(w[t - 16], s0), _mm256_add_epi32(w[t - 7], s1));
+	}
+
+	__m256i a = state[0], b = state[1], c = state[2], d = state[3];
+	__m256i e = state[4], f = state[5], g = state[6], h = state[7];
+
+	for(unsigned int t = 0; t < 64; t++){
+		__m256i S1 = _mm256_xor_si256(_mm256_xor_si256(rotate_right(e, 6), rotate_right(e, 11)), rotate_right(e, 25));
+		__m256i ch = _mm256_xor_si256(_mm256_and_si256(e, f), _mm256_andnot_si256(e, g));
+		__m256i t1 = _mm256_add_epi32(_mm256_add_epi32(_mm256_add_epi32(h, S1), _mm256_add_epi32(ch, _mm256_set1_epi32(K[t]))), w[t]);
+		__m256i S0 = _mm256_xor_si256(_mm256_xor_si256(rotate_right(a, 2), rotate_right(a, 13)), rotate_right(a, 22));
+		__m256i maj = _mm256_xor_si256(_mm256_xor_si256(_mm256_and_si256(a, b), _mm256_and_si256(a, c)), _mm256_and_si256(b, c));
+		__m256i t2 = _mm256_add_epi32(S0, maj);
+		h = g;
+		g = f;
+		f = e;
+		e = _mm256_add_epi32(d, t1);
+		d = c;
+		c = b;
+		b = a;
+		a = _mm256_add_epi32(t1, t2);
+	}
+
+	state[0] = _mm256_add_epi32(state[0], a);
+	state[1] = _mm256_add_epi32(state[1], b);
+	state[2] = _mm256_add_epi32(state[2], c);
+	state[3] = _mm256_add_epi32(state[3], d);
+	state[4] = _mm256_add_epi32(state[4], e);
+	state[5] = _mm256_add_epi32(state[5], f);
+	state[6] = _mm256_add_epi32(state[6], g);
+	state[7] = _mm256_add_epi32(state[7], h);
+}
+#endif
+
+bool Sha256_Multi_Buffer::is_supported(){
+#ifdef PCOLL_SHA256_LANES
+	return __builtin_cpu_supports("avx2");
+#else
+	return false;
+#endif
+}
+
+void Sha256_Multi_Buffer::compute(const unsigned char* const* data, const unsigned long int* sizes, unsigned int count, unsigned char (*digests)[DIGEST_LENGTH]){
+
+	// Without AVX2, hash one at a time
+	if(!is_supported()){
+		for(unsigned int i = 0; i < count; i++){
+			unsigned int length = DIGEST_LENGTH;
+			EVP_Digest(data[i], sizes[i], digests[i], &length, EVP_sha256(), nullptr);
+		}
+		return;
+	}
+
+#ifdef PCOLL_SHA256_LANES
+	// Hash in batches of eight
+	for(unsigned int i = 0; i < count; i += LANES)
+		compute_lanes(data + i, sizes + i, std::min(LANES, count - i), digests + i);
+#endif
+}
+
+#ifdef PCOLL_SHA256_LANES
+__attribute__((target("avx2")))
+void Sha256_Multi_Buffer::compute_lanes(const unsigned char* const* data, const unsigned long int* sizes, unsigned int count, unsigned char (*digests)[DIGEST_LENGTH]){
+
+	// The padded end of every lane's message, at most two blocks
+	unsigned char tails[LANES][2 * BLOCK_SIZE];
+	unsigned long int full_blocks[LANES];
+	unsigned long int total_blocks[LANES];
+	unsigned long int max_blocks = 0;
+	std::memset(tails, 0, sizeof(tails));
+	for(unsigned int lane = 0; lane < count; lane++){
+		full_blocks[lane] = sizes[lane] / BLOCK_SIZE;
+		unsigned long int remainder = sizes[lane] % BLOCK_SIZE;
+		unsigned long int tail_blocks = remainder + 9 > BLOCK_SIZE ? 2 : 1;
+		total_blocks[lane] = full_blocks[lane] + tail_blocks;
+		max_blocks = std::max(max_blocks, total_blocks[lane]);
+
+		// Remaining bytes, the 1 bit, zeros and the length in bits
+		std::memcpy(tails[lane], data[lane] + full_blocks[lane] * BLOCK_SIZE, remainder);
+		tails[lane][remainder] = 0x80;
+		unsigned long int bits = sizes[lane] * 8;
+		for(unsigned int i = 0; i < 8; i++)
+			tails[lane][tail_blocks * BLOCK_SIZE - 1 - i] = (unsigned char)(bits >> (8 * i));
+	}
+
+	// Lanes that are done or unused work on a dummy block
+	static const unsigned char zero_block[BLOCK_SIZE] = {0};
+
+	__m256i state[8];
+	for(unsigned int i = 0; i < 8; i++) state[i] = _mm256_set1_epi32(H0[i]);
+
+	for(unsigned long int block = 0; block < max_blocks; block++){
+
+		// Pick the block of every lane
+		const unsigned char* blocks[LANES];
+		for(unsigned int lane = 0; lane < LANES; lane++){
+			if(lane >= count || block >= total_blocks[lane]) blocks[lane] = zero_block;
+			else if(block < full_blocks[lane]) blocks[lane] = data[lane] + block * BLOCK_SIZE;
+			else blocks[lane] = tails[lane] + (block - full_blocks[lane]) * BLOCK_SIZE;
+		}
+
+		compress(state, blocks);
+
+		// Take out the digest of every lane that just finished
+		for(unsigned int lane = 0; lane < count; lane++){
+			if(block + 1 != total_blocks[lane]) continue;
+			alignas(32) uint32_t words[LANES];
+			for(unsigned int i = 0; i < 8; i++){
+				_mm256_store_si256(reinterpret_cast<__m256i*>(words), state[i]);
+				digests[lane][4 * i] = (unsigned char)(words[lane] >> 24);
+				digests[lane][4 * i + 1] = (unsigned char)(words[lane] >> 16);
+				digests[lane][4 * i + 2] = (unsigned char)(words[lane] >> 8);
+				digests[lane][4 * i + 3] = (unsigned char)words[lane];
+			}
+		}
+	}
+}
+#endif
@@ -0,0 +1,28 @@
+#ifndef __PCOLL_SHA256_MULTI_BUFFER__
+#define __PCOLL_SHA256_MULTI_BUFFER__
+
+/** SHA-256 of several independent buffers at once
+ *	Eight buffers are hashed in the lanes of AVX2 registers, so a batch of files costs about as much
+ *	as the longest one. Falls back to hashing one buffer at a time when AVX2 is not available.
+ */
+class Sha256_Multi_Buffer {
+public:
+	static constexpr unsigned int LANES = 8;
+	static constexpr unsigned int DIGEST_LENGTH = 32;
+
+	/** Computes the SHA-256 digest of every buffer
+	 *	@param data buffers to hash
+	 *	@param sizes size of every buffer
+	 *	@param count number of buffers
+	 *	@param digests receives one 32 byte digest per buffer
+	 */
+	static void compute(const unsigned char* const* data, const unsigned long int* sizes, unsigned int count, unsigned char (*digests)[DIGEST_LENGTH]);
+
+	/** @return true if the CPU can hash several buffers at once */
+	static bool is_supported();
+
+private:
+	static void compute_lanes(const unsigned char* const* data, const unsigned long int* sizes, unsigned int count, unsigned char (*digests)[DIGEST_LENGTH]);
+};
+
+#endif //__PCOLL_SHA256_MULTI_BUFFER__
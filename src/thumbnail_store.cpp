@@ -0,0 +1,193 @@
+#include "thumbnail_store.hpp"
+#include "utility.hpp"
+
+#include <cstring>
+#include <cerrno>
+#include <cmath>
+#include <algorithm>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+// The dot product uses AVX2 where the CPU has it, other architectures only have the scalar loop
+#if defined(__x86_64__) || defined(__i386__)
+#define PCOLL_THUMBNAIL_AVX2
+#include <immintrin.h>
+#endif
+
+using std::string;
+
+static const char* STORE_MAGIC = "pcoll-thumbnails 1";
+
+/** Thumbnails the file has room for at first */
+static const uint32_t INITIAL_CAPACITY = 1024;
+
+Thumbnail_Store::Thumbnail_Store() : _path(), _fd(-1), _read_only(false), _map(nullptr), _map_size(0), _capacity(0), _numbers(), _mutex() {}
+
+Thumbnail_Store::~Thumbnail_Store(){
+	close();
+}
+
+void Thumbnail_Store::open(const string& path, bool read_only){
+	close();
+	_path = path;
+	_read_only = read_only;
+	_fd = ::open(path.c_str(), read_only ? O_RDONLY | O_CLOEXEC : O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+	if(_fd < 0) throw Pexception("Cannot open thumbnail store '" + path + "': " + std::strerror(errno));
+
+	// Only a new or empty file becomes a store, any other file must already be one with the same layout
+	struct stat info;
+	if(fstat(_fd, &info) != 0){
+		int error = errno;
+		close();
+		throw Pexception("Cannot read thumbnail store '" + path + "': " + std::strerror(error));
+	}
+	Header header;
+	std::memset(&header, 0, sizeof(Header));
+	if(info.st_size == 0){
+		if(read_only){
+			close();
+			return;
+		}
+		std::strncpy(header.magic, STORE_MAGIC, sizeof(header.magic));
+		header.side = SIDE;
+	}else if((std::size_t)info.st_size < sizeof(Header) || pread(_fd, &header, sizeof(Header), 0) != sizeof(Header)
+		|| std::strncmp(header.magic, STORE_MAGIC, sizeof(header.magic)) != 0 || header.side != SIDE
+		|| (std::size_t)info.st_size < sizeof(Header) + (std::size_t)header.count * sizeof(Record)){
+		close();
+		throw Pexception("'" + path + "' is not a thumbnail store!");
+	}
+
+	// A store that is only read is mapped as it is, one that is written gets room to grow
+	if(read_only){
+		_map_size = sizeof(Header) + (std::size_t)header.count * sizeof(Record);
+		void* map = mmap(nullptr, _map_size, PROT_READ, MAP_SHARED, _fd, 0);
+		if(map == MAP_FAILED){
+			int error = errno;
+			close();
+			throw Pexception("Cannot map thumbnail store '" + path + "': " + std::strerror(error));
+		}
+		_map = static_cast<char*>(map);
+		_capacity = header.count;
+	}else{
+		reserve(std::max(header.count, INITIAL_CAPACITY));
+		std::memcpy(_map, &header, sizeof(Header));
+	}
+	for(uint32_t number = 0; number < header.count; number++){
+		Record* record = get_record(number);
+		_numbers.emplace(std::hash<string>()(string(record->checksum, strnlen(record->checksum, CHECKSUM_SIZE))), number);
+	}
+}
+
+void Thumbnail_Store::close(){
+	if(_map != nullptr){
+		std::size_t used = sizeof(Header) + (std::size_t)reinterpret_cast<Header*>(_map)->count * sizeof(Record);
+		munmap(_map, _map_size);
+		_map = nullptr;
+		if(!_read_only && ftruncate(_fd, used) != 0) Utility::sout.printerrln("Cannot trim thumbnail store '" + _path + "': " + std::strerror(errno));
+	}
+	if(_fd >= 0) ::close(_fd);
+	_fd = -1;
+	_map_size = 0;
+	_capacity = 0;
+	_read_only = false;
+	_numbers.clear();
+}
+
+bool Thumbnail_Store::is_open() const{
+	return _map != nullptr;
+}
+
+void Thumbnail_Store::reserve(uint32_t count){
+	if(count <= _capacity) return;
+
+	// Double the room so a scan grows the file a few times only
+	uint32_t capacity = std::max(count, _capacity * 2);
+	std::size_t size = sizeof(Header) + (std::size_t)capacity * sizeof(Record);
+	if(ftruncate(_fd, size) != 0) throw Pexception("Cannot grow thumbnail store '" + _path + "': " + std::strerror(errno));
+	void* map = _map == nullptr ? mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, _fd, 0) : mremap(_map, _map_size, size, MREMAP_MAYMOVE);
+	if(map == MAP_FAILED) throw Pexception("Cannot map thumbnail store '" + _path + "': " + std::strerror(errno));
+	_map = static_cast<char*>(map);
+	_map_size = size;
+	_capacity = capacity;
+}
+
+Thumbnail_Store::Record* Thumbnail_Store::get_record(uint32_t number) const{
+	return reinterpret_cast<Record*>(_map + sizeof(Header) + (std::size_t)number * sizeof(Record));
+}
+
+void Thumbnail_Store::add(const string& checksum, const float* thumbnail){
+	if(checksum.size() > CHECKSUM_SIZE) return;
+	std::unique_lock<std::mutex> lock(_mutex);
+	if(_map == nullptr || _read_only || !_numbers.emplace(std::hash<string>()(checksum), NONE).second) return;
+
+	Header* header = reinterpret_cast<Header*>(_map);
+	uint32_t number = header->count;
+	reserve(number + 1);
+	header = reinterpret_cast<Header*>(_map);
+
+	// A byte per cell, with the sums the correlation needs
+	Record* record = get_record(number);
+	std::memset(record->checksum, 0, CHECKSUM_SIZE);
+	std::memcpy(record->checksum, checksum.data(), checksum.size());
+	record->sum = 0;
+	record->squares = 0;
+	for(unsigned int cell = 0; cell < CELLS; cell++){
+		uint8_t value = (uint8_t)std::lround(std::min(1.0f, std::max(0.0f, thumbnail[cell])) * 255);
+		record->cells[cell] = value;
+		record->sum += value;
+		record->squares += (uint32_t)value * value;
+	}
+
+	// Counted once it is complete, so a store cut off by a crash only loses the last thumbnail
+	header->count = number + 1;
+	_numbers[std::hash<string>()(checksum)] = number;
+}
+
+uint32_t Thumbnail_Store::find(const string& checksum) const{
+	auto search = _numbers.find(std::hash<string>()(checksum));
+	return search == _numbers.end() ? NONE : search->second;
+}
+
+#ifdef PCOLL_THUMBNAIL_AVX2
+__attribute__((target("avx2")))
+static uint32_t dot_product_avx2(const uint8_t* one, const uint8_t* two, unsigned int count){
+
+	// Widen 16 cells at a time to 16 bits and multiply-add neighboring pairs into 32 bits
+	__m256i sums = _mm256_setzero_si256();
+	for(unsigned int i = 0; i < count; i += 16){
+		__m256i a = _mm256_cvtepu8_epi16(_mm_loadu_si128(reinterpret_cast<const __m128i*>(one + i)));
+		__m256i b = _mm256_cvtepu8_epi16(_mm_loadu_si128(reinterpret_cast<const __m128i*>(two + i)));
+		sums = _mm256_add_epi32(sums, _mm256_madd_epi16(a, b));
+	}
+	uint32_t lanes[8];
+	_mm256_storeu_si256(reinterpret_cast<__m256i*>(lanes), sums);
+	return lanes[0] + lanes[1] + lanes[2] + lanes[3] + lanes[4] + lanes[5] + lanes[6] + lanes[7];
+}
+#endif
+
+uint32_t Thumbnail_Store::dot_product(const uint8_t* one, const uint8_t* two){
+#ifdef PCOLL_THUMBNAIL_AVX2
+	static const bool avx2 = __builtin_cpu_supports("avx2");
+	if(avx2) return dot_product_avx2(one, two, CELLS);
+#endif
+	uint32_t sum = 0;
+	for(unsigned int cell = 0; cell < CELLS; cell++) sum += (uint32_t)one[cell] * two[cell];
+	return sum;
+}
+
+float Thumbnail_Store::correlate(uint32_t one, uint32_t two) const{
+	const Record* first = get_record(one);
+	const Record* second = get_record(two);
+
+	// Pearson correlation of the cells, unchanged by brightness and contrast
+	double count = CELLS;
+	double covariance = count * dot_product(first->cells, second->cells) - (double)first->sum * second->sum;
+	double variance_one = count * first->squares - (double)first->sum * first->sum;
+	double variance_two = count * second->squares - (double)second->sum * second->sum;
+
+	// Flat thumbnails only correlate with each other
+	if(variance_one <= 0 || variance_two <= 0) return variance_one <= 0 && variance_two <= 0 ? 1.0f : 0.0f;
+	return covariance / std::sqrt(variance_one * variance_two);
+}
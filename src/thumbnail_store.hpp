@@ -0,0 +1,91 @@
+#ifndef __PCOLL_THUMBNAIL_STORE__
+#define __PCOLL_THUMBNAIL_STORE__
+
+#include <string>
+#include <unordered_map>
+#include <mutex>
+#include <cstdint>
+
+#include "diffhash.hpp"
+
+/** Grayscale thumbnails of checksum groups in a memory-mapped file
+ *	Every thumbnail is the luminance of an image averaged into THUMBNAIL_SIZE cells on a side by the
+ *	pass that computes its difference hash, stored as a byte per cell. Thumbnails are named by their
+ *	checksum so the file is kept and reused by later scans. Pairs of images are confirmed by the
+ *	correlation of their thumbnails without decoding them again.
+ */
+class Thumbnail_Store {
+public:
+	static constexpr uint32_t NONE = UINT32_MAX;
+
+	Thumbnail_Store();
+	~Thumbnail_Store();
+	Thumbnail_Store(const Thumbnail_Store& other) = delete;
+	Thumbnail_Store& operator=(const Thumbnail_Store& other) = delete;
+
+	/** Maps a store, a new or empty file becomes an empty store
+	 *	Throws Pexception if the file holds something other than a store.
+	 *	@param path path of the file
+	 *	@param read_only if true, the file is neither created nor written and add() does nothing
+	 */
+	void open(const std::string& path, bool read_only);
+
+	/** Unmaps the store, cutting off the room it had left */
+	void close();
+
+	/** @return true if a store is mapped */
+	bool is_open() const;
+
+	/** Adds the thumbnail of a group that has none, can be called from several threads
+	 *	@param checksum checksum of the group
+	 *	@param thumbnail THUMBNAIL_SIZE rows of luminance values between zero and one
+	 */
+	void add(const std::string& checksum, const float* thumbnail);
+
+	/** Looks up the thumbnail of a group, not alongside add()
+	 *	@param checksum checksum of the group
+	 *	@return number of the thumbnail, NONE if the group has none
+	 */
+	uint32_t find(const std::string& checksum) const;
+
+	/** Correlates two thumbnails, not alongside add()
+	 *	@return normalized cross-correlation, 1 for the same picture
+	 */
+	float correlate(uint32_t one, uint32_t two) const;
+
+private:
+	static constexpr unsigned int SIDE = Difference_Hash::THUMBNAIL_SIZE;
+	static constexpr unsigned int CELLS = SIDE * SIDE;
+	static constexpr unsigned int CHECKSUM_SIZE = 80; // longest checksum kept, with room for a collision suffix
+
+	struct Header {
+		char magic[24];
+		uint32_t side; // cells on a side of every thumbnail
+		uint32_t count; // thumbnails written
+	};
+
+	struct Record {
+		char checksum[CHECKSUM_SIZE]; // padded with zeros
+		uint32_t sum; // of the cells
+		uint32_t squares; // sum of the squares of the cells
+		uint8_t cells[CELLS];
+	};
+
+	/** Grows the file and its mapping to hold at least a number of thumbnails */
+	void reserve(uint32_t count);
+	Record* get_record(uint32_t number) const;
+
+	/** Sum of the products of the cells of two thumbnails */
+	static uint32_t dot_product(const uint8_t* one, const uint8_t* two);
+
+	std::string _path;
+	int _fd;
+	bool _read_only;
+	char* _map;
+	std::size_t _map_size;
+	uint32_t _capacity;
+	std::unordered_map<std::size_t, uint32_t> _numbers; // <checksum id, number of the thumbnail>
+	std::mutex _mutex;
+};
+
+#endif //__PCOLL_THUMBNAIL_STORE__
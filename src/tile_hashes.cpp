@@ -0,0 +1,107 @@
+#include "tile_hashes.hpp"
+#include "diffhash.hpp"
+
+#include <algorithm>
+#include <cmath>
+
+/** Cells on a side of the thumbnail */
+static const unsigned int SIZE = Difference_Hash::THUMBNAIL_SIZE;
+
+/** Sides of the tiles and the step between them, in thumbnail cells */
+static const unsigned int TILE_SIDES[] = {SIZE / 2, SIZE * 3 / 4};
+static const unsigned int TILE_STEP = SIZE / 4;
+
+/** Numbers of the tiles that cover the whole picture, after the scaled tiles */
+static const uint8_t FRAME_TILE = 13;
+static const uint8_t TRIMMED_TILE = 14;
+
+/** Smallest difference between the darkest and the brightest cell of a tile that is hashed */
+static const float MIN_TILE_CONTRAST = 0.05f;
+
+/** Largest difference within a row or column of cells that is taken as a bar */
+static const float MAX_BAR_CONTRAST = 0.02f;
+
+/** Smallest side of the picture inside the bars */
+static const unsigned int MIN_TRIMMED_SIDE = SIZE / 4;
+
+std::vector<Tile_Hash> Tile_Hashes::compute(const float* thumbnail){
+	std::vector<Tile_Hash> hashes;
+	uint64_t hash;
+
+	// Overlapping tiles at every scale, numbered row by row, smallest first
+	uint8_t tile = 0;
+	for(auto& side : TILE_SIDES){
+		for(unsigned int y = 0; y + side <= SIZE; y += TILE_STEP){
+			for(unsigned int x = 0; x + side <= SIZE; x += TILE_STEP, tile++){
+				if(hash_rectangle(thumbnail, x, y, side, side, hash)) hashes.push_back(Tile_Hash{hash, tile});
+			}
+		}
+	}
+
+	// The whole frame, and the picture inside its bars if it has any
+	if(hash_rectangle(thumbnail, 0, 0, SIZE, SIZE, hash)) hashes.push_back(Tile_Hash{hash, FRAME_TILE});
+	unsigned int x, y, width, height;
+	trim_bars(thumbnail, x, y, width, height);
+	if((width != SIZE || height != SIZE) && hash_rectangle(thumbnail, x, y, width, height, hash))
+		hashes.push_back(Tile_Hash{hash, TRIMMED_TILE});
+
+	return hashes;
+}
+
+bool Tile_Hashes::is_frame(uint8_t tile){
+	return tile == FRAME_TILE || tile == TRIMMED_TILE;
+}
+
+bool Tile_Hashes::hash_rectangle(const float* thumbnail, unsigned int x, unsigned int y, unsigned int width, unsigned int height, uint64_t& hash){
+
+	// Average the rectangle into 9 columns and 8 rows, cells repeat when the rectangle is smaller
+	float cells[8][9];
+	float darkest = 1e30f, brightest = -1e30f;
+	for(unsigned int row = 0; row < 8; row++){
+		unsigned int row_begin = y + row * height / 8;
+		unsigned int row_end = std::max(row_begin + 1, y + (row + 1) * height / 8);
+		for(unsigned int column = 0; column < 9; column++){
+			unsigned int column_begin = x + column * width / 9;
+			unsigned int column_end = std::max(column_begin + 1, x + (column + 1) * width / 9);
+			float sum = 0;
+			for(unsigned int cell_y = row_begin; cell_y < row_end; cell_y++){
+				for(unsigned int cell_x = column_begin; cell_x < column_end; cell_x++) sum += thumbnail[cell_y * SIZE + cell_x];
+			}
+			cells[row][column] = sum / ((row_end - row_begin) * (column_end - column_begin));
+			darkest = std::min(darkest, cells[row][column]);
+			brightest = std::max(brightest, cells[row][column]);
+		}
+	}
+	if(brightest - darkest < MIN_TILE_CONTRAST) return false;
+
+	// A bit for every pair of neighboring cells, set if it gets brighter to the right
+	hash = 0;
+	for(unsigned int row = 0; row < 8; row++){
+		for(unsigned int column = 0; column < 8; column++){
+			hash = (hash << 1) | (cells[row][column] < cells[row][column + 1] ? 1 : 0);
+		}
+	}
+	return true;
+}
+
+void Tile_Hashes::trim_bars(const float* thumbnail, unsigned int& x, unsigned int& y, unsigned int& width, unsigned int& height){
+
+	// A row or column is part of a bar if it is uniform and looks like the edge it grows from
+	auto uniform = [&](unsigned int first, unsigned int step, unsigned int count, float edge) -> bool {
+		for(unsigned int i = 0; i < count; i++){
+			if(std::abs(thumbnail[first + i * step] - edge) > MAX_BAR_CONTRAST) return false;
+		}
+		return true;
+	};
+
+	unsigned int top = 0, bottom = SIZE, left = 0, right = SIZE;
+	while(bottom - top > MIN_TRIMMED_SIDE && uniform(top * SIZE, 1, SIZE, thumbnail[0])) top++;
+	while(bottom - top > MIN_TRIMMED_SIDE && uniform((bottom - 1) * SIZE, 1, SIZE, thumbnail[(SIZE - 1) * SIZE])) bottom--;
+	while(right - left > MIN_TRIMMED_SIDE && uniform(left, SIZE, SIZE, thumbnail[0])) left++;
+	while(right - left > MIN_TRIMMED_SIDE && uniform(right - 1, SIZE, SIZE, thumbnail[SIZE - 1])) right--;
+
+	x = left;
+	y = top;
+	width = right - left;
+	height = bottom - top;
+}
@@ -0,0 +1,44 @@
+#ifndef __PCOLL_TILE_HASHES__
+#define __PCOLL_TILE_HASHES__
+
+#include <vector>
+#include <cstdint>
+
+/** Difference hash of one tile of an image */
+struct Tile_Hash {
+	uint64_t hash;
+	uint8_t tile; // number of the tile in the layout
+};
+
+/** Hashes overlapping tiles of a luminance thumbnail at several scales
+ *	Tiles of a half and three quarters of the thumbnail are laid out a quarter apart, so a crop of an
+ *	image shares some of them with the image. The whole frame and the frame without letterbox or
+ *	pillarbox bars are hashed too. Every tile is sampled to 9x8 cells and hashed by comparing
+ *	neighboring cells along each row. Tiles without enough contrast, such as bars, are left out as
+ *	they would match anything.
+ */
+class Tile_Hashes {
+public:
+	/** Computes the hashes of the tiles
+	 *	@param thumbnail Difference_Hash::THUMBNAIL_SIZE rows of luminance values
+	 *	@return a hash for every tile with enough contrast
+	 */
+	static std::vector<Tile_Hash> compute(const float* thumbnail);
+
+	/** @return true if a tile covers the whole picture */
+	static bool is_frame(uint8_t tile);
+
+	/** Number of tiles in the layout, each fits a bit of a uint16_t */
+	static constexpr unsigned int TILE_COUNT = 15;
+
+private:
+	/** Hashes a rectangle of the thumbnail
+	 *	@return false if the rectangle has too little contrast
+	 */
+	static bool hash_rectangle(const float* thumbnail, unsigned int x, unsigned int y, unsigned int width, unsigned int height, uint64_t& hash);
+
+	/** Finds the picture inside uniform bars along the edges of the thumbnail */
+	static void trim_bars(const float* thumbnail, unsigned int& x, unsigned int& y, unsigned int& width, unsigned int& height);
+};
+
+#endif //__PCOLL_TILE_HASHES__
@@ -2,7 +2,19 @@
 
 #include <iostream>
 #include <thread>
-#include <regex>
+#include <fstream>
+#include <list>
+#include <algorithm>
+#include <cstring>
+#include <cerrno>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <sched.h>
+#include <sys/ioctl.h>
+#include <linux/fs.h>
+#include <linux/fiemap.h>
 
 using std::string;
 using std::unique_lock;
@@ -12,15 +24,106 @@ using std::chrono::microseconds;
 
 Synchronized_Output Utility::sout;
 
+/** Lists the directories of the cgroup this process is in, then those of every parent up to the root
+ *	@param controller v1 controller the limit belongs to, the v2 hierarchy is used if it is not mounted
+ */
+static std::list<string> get_cgroup_directories(const string& controller){
+	std::list<string> directories;
+	std::ifstream input("/proc/self/cgroup");
+	string line;
+	while(std::getline(input, line)){
+
+		// Lines look like "id:controller,controller:path", the v2 hierarchy has no controllers
+		size_t first = line.find(':');
+		size_t second = line.find(':', first + 1);
+		if(first == string::npos || second == string::npos) continue;
+		string controllers = "," + line.substr(first + 1, second - first - 1) + ",";
+		string mount;
+		if(controllers == ",," && directories.empty()) mount = "/sys/fs/cgroup";
+		else if(controllers.find("," + controller + ",") != string::npos) mount = "/sys/fs/cgroup/" + controller;
+		else continue;
+
+		// A v1 controller takes the place of the v2 hierarchy
+		if(mount != "/sys/fs/cgroup") directories.clear();
+		string path = line.substr(second + 1);
+		while(true){
+			directories.push_back(mount + path);
+			if(path.empty() || path == "/") break;
+			path = path.substr(0, path.rfind('/'));
+		}
+		if(mount != "/sys/fs/cgroup") break;
+	}
+	return directories;
+}
+
+/** @return first line of a file, empty if it can't be read */
+static string read_first_line(const string& path){
+	std::ifstream input(path);
+	string line;
+	std::getline(input, line);
+	return line;
+}
+
 unsigned int Utility::get_default_cores_count(){
 	// Get the number of cores available on the computer
 	unsigned int num_threads = std::thread::hardware_concurrency();
 
+	// Only the cores the process may run on count
+	cpu_set_t affinity;
+	if(sched_getaffinity(0, sizeof(affinity), &affinity) == 0 && CPU_COUNT(&affinity) > 0)
+		num_threads = std::min(num_threads == 0 ? (unsigned int)CPU_COUNT(&affinity) : num_threads, (unsigned int)CPU_COUNT(&affinity));
+
+	// A CPU quota of this cgroup or a parent throttles any thread past it, round partial cores up
+	for(auto& directory : get_cgroup_directories("cpu")){
+		long long int quota = -1, period = 0;
+		string line = read_first_line(directory + "/cpu.max");
+		try{
+			if(!line.empty()){
+				size_t space = line.find(' ');
+				if(line.compare(0, space, "max") != 0) quota = std::stoll(line.substr(0, space));
+				period = std::stoll(line.substr(space + 1));
+			}else{
+				line = read_first_line(directory + "/cpu.cfs_quota_us");
+				if(!line.empty()) quota = std::stoll(line);
+				period = std::stoll(read_first_line(directory + "/cpu.cfs_period_us"));
+			}
+		}catch(std::logic_error& e){
+			continue;
+		}
+		if(quota > 0 && period > 0){
+			unsigned int cores = (quota + period - 1) / period;
+			if(num_threads == 0 || cores < num_threads) num_threads = cores;
+		}
+	}
+
 	// The previous function may return zero if it cannot detect the number of cores on the computer
 	// Make sure we correct that before passing it in
 	return num_threads == 0 ? 1 : num_threads;
 }
 
+unsigned long int Utility::get_memory_limit(){
+	// Start from the physical memory
+	unsigned long int limit = (unsigned long int)sysconf(_SC_PHYS_PAGES) * sysconf(_SC_PAGESIZE);
+
+	// Lower it to the memory limit of this cgroup or a parent, an unlimited v1 group reports a huge number
+	for(auto& directory : get_cgroup_directories("memory")){
+		string line = read_first_line(directory + "/memory.max");
+		if(line.empty()) line = read_first_line(directory + "/memory.limit_in_bytes");
+		try{
+			if(!line.empty() && line != "max") limit = std::min(limit, (unsigned long int)std::stoull(line));
+		}catch(std::logic_error& e){}
+	}
+	return limit;
+}
+
+unsigned long int Utility::get_resident_bytes(){
+	// The second field is the number of resident pages
+	std::ifstream input("/proc/self/statm");
+	unsigned long int size = 0, resident = 0;
+	input >> size >> resident;
+	return resident * sysconf(_SC_PAGESIZE);
+}
+
 bool Utility::is_image(const std::string& path){
 
 	OIIO::string_view path_view(path);
@@ -56,15 +159,146 @@ ImageInput* Utility::open_image_path(const std::string& path){
 	return image;
 }
 
-ImageBuf* Utility::get_image_buffer(const std::string& path){
-	OIIO::string_view path_view(path);
+int Utility::open_file(const std::string& path){
+	int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC | O_NOATIME);
 
-	// Construct the image data
-	ImageBuf* image = new ImageBuf(path_view);
+	// O_NOATIME is only allowed for the owner of the file
+	if(fd < 0 && errno == EPERM) fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+
+	return fd;
+}
+
+Disk_Position Utility::get_disk_position(const std::string& path){
+	Disk_Position position;
+
+	int fd = open_file(path);
+	if(fd < 0) return position;
+
+	struct stat file_stat;
+	if(fstat(fd, &file_stat) == 0){
+		position.device = file_stat.st_dev;
+		position.offset = file_stat.st_ino;
+	}
+
+	// Ask for the first extent of the file
+	alignas(struct fiemap) char request[sizeof(struct fiemap) + sizeof(struct fiemap_extent)];
+	std::memset(request, 0, sizeof(request));
+	struct fiemap* map = reinterpret_cast<struct fiemap*>(request);
+	map->fm_start = 0;
+	map->fm_length = FIEMAP_MAX_OFFSET;
+	map->fm_extent_count = 1;
+	if(ioctl(fd, FS_IOC_FIEMAP, map) == 0 && map->fm_mapped_extents > 0
+		&& !(map->fm_extents[0].fe_flags & (FIEMAP_EXTENT_UNKNOWN | FIEMAP_EXTENT_DATA_INLINE))){
+		position.physical = true;
+		position.offset = map->fm_extents[0].fe_physical;
+	}
+
+	close(fd);
+
+	return position;
+}
+
+void Utility::prefetch_file(const std::string& path){
+	int fd = open_file(path);
+	if(fd < 0) return;
+	posix_fadvise(fd, 0, 0, POSIX_FADV_WILLNEED);
+	close(fd);
+}
+
+bool Utility::files_identical(const std::string& path_one, const std::string& path_two){
+
+	// Open both files
+	int fd_one = open_file(path_one);
+	if(fd_one < 0) throw Pexception("Cannot open file '" + path_one + "'!");
+	int fd_two = open_file(path_two);
+	if(fd_two < 0){
+		close(fd_one);
+		throw Pexception("Cannot open file '" + path_two + "'!");
+	}
+
+	// Different sizes can't be identical
+	struct stat stat_one, stat_two;
+	bool result = fstat(fd_one, &stat_one) == 0 && fstat(fd_two, &stat_two) == 0 && stat_one.st_size == stat_two.st_size;
+	unsigned long int size = result ? stat_one.st_size : 0;
+
+	// Map both files and compare
+	if(result && size != 0){
+		void* map_one = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd_one, 0);
+		void* map_two = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd_two, 0);
+		if(map_one == MAP_FAILED || map_two == MAP_FAILED){
+			if(map_one != MAP_FAILED) munmap(map_one, size);
+			if(map_two != MAP_FAILED) munmap(map_two, size);
+			close(fd_one);
+			close(fd_two);
+			throw Pexception("Cannot map files '" + path_one + "' and '" + path_two + "'!");
+		}
+		madvise(map_one, size, MADV_SEQUENTIAL);
+		madvise(map_two, size, MADV_SEQUENTIAL);
+		result = std::memcmp(map_one, map_two, size) == 0;
+		munmap(map_one, size);
+		munmap(map_two, size);
+	}
+
+	close(fd_one);
+	close(fd_two);
+
+	return result;
+}
+
+int Utility::create_memory_file(const char* data, unsigned long int size){
+	int fd = memfd_create("pcoll", MFD_CLOEXEC);
+	if(fd < 0) throw Pexception(string("Failed to create memory file: ") + std::strerror(errno));
+
+	// Copy the contents in
+	unsigned long int offset = 0;
+	while(offset < size){
+		ssize_t result = write(fd, data + offset, size - offset);
+		if(result < 0 && errno == EINTR) continue;
+		if(result <= 0){
+			close(fd);
+			throw Pexception(string("Failed to write memory file: ") + std::strerror(errno));
+		}
+		offset += result;
+	}
+
+	return fd;
+}
+
+string Utility::get_memory_file_path(int fd){
+	return "/proc/self/fd/" + std::to_string(fd);
+}
+
+ImageInput* Utility::open_image(const std::string& path, const char* data, unsigned long int size, int& memory_fd){
+
+	// Pick the reader by the original file name
+	ImageInput* image = ImageInput::create(path);
+	if(!image) throw Pexception("Failed to open image: " + path);
+
+	// Open the contents, only the header is read here
+	memory_fd = -1;
+	if(data != nullptr){
+		try{ memory_fd = create_memory_file(data, size);
+		}catch(Pexception& pe){
+			ImageInput::destroy(image);
+			throw;
+		}
+	}
+	OIIO::ImageSpec spec;
+	if(!image->open(memory_fd < 0 ? path : get_memory_file_path(memory_fd), spec)){
+		if(memory_fd >= 0) close(memory_fd);
+		ImageInput::destroy(image);
+		throw Pexception("Failed to open image: " + path);
+	}
 
 	return image;
 }
 
+void Utility::close_image(ImageInput* image, int memory_fd){
+	image->close();
+	if(memory_fd >= 0) close(memory_fd);
+	ImageInput::destroy(image);
+}
+
 string Utility::try_to_convert_to_absolute_path(const string& path){
 	// Convert path to absolute path if it's not an absolute path
 	filesystem::path fs_path = path;
@@ -74,9 +308,12 @@ string Utility::try_to_convert_to_absolute_path(const string& path){
 }
 
 std::string Utility::try_to_normalize_path(const std::string& path){
-	string search = filesystem::current_path().string();
-    search += "/";
-	return std::regex_replace(path, std::regex(search), "");
+	// The working directory doesn't change during a run, look it up once
+	static const string search = filesystem::current_path().string() + "/";
+
+	// Strip it from the front of the path
+	if(path.compare(0, search.size(), search) == 0) return path.substr(search.size());
+	return path;
 }
 
 Synchronized_Output::Synchronized_Output() :  _print_length(0), _cout_mutex(), _last_print_time(steady_clock::now()) {}
@@ -120,14 +357,14 @@ void Synchronized_Output::printerrln(const string& message){
 }
 
 void Synchronized_Output::print(const string& message){
+	// Lock the output
+	unique_lock<std::mutex> lock(_cout_mutex);
+
 	// Control printing speed
 	unsigned long duration = duration_cast<microseconds>(steady_clock::now() - _last_print_time).count();
 	if(duration < 1000)
 		return;
 
-	// Lock the output
-	unique_lock<std::mutex> lock(_cout_mutex);
-
 	// Erase previous string
 	if(_print_length != 0){
 		std::cout << "\r";
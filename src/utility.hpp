@@ -65,18 +65,76 @@ private:
 	std::chrono::time_point<std::chrono::steady_clock> _last_print_time;
 };
 
+/** Where a file starts on its device */
+struct Disk_Position {
+	Disk_Position() : device(0), physical(false), offset(0) {}
+	unsigned long int device; // device number
+	bool physical; // true if offset is a byte offset on the device, false if it is the inode number
+	unsigned long int offset;
+
+	bool operator<(const Disk_Position& other) const {
+		if(device != other.device) return device < other.device;
+		if(physical != other.physical) return physical;
+		return offset < other.offset;
+	}
+};
+
 class Utility {
 public:
 	static Synchronized_Output sout;
 
 	static ImageInput* open_image_path(const std::string& path);
 
-    static ImageBuf* get_image_buffer(const std::string& path);
+	/** Opens an image and reads its header without decoding any pixels
+	 *	@param path path of the image, also used to pick the image format
+	 *	@param data file contents, or nullptr to read the file at path
+	 *	@param size size of the file contents
+	 *	@param memory_fd set to the in-memory file backing the image, or -1, pass it to close_image()
+	 *	@return the open image
+	 */
+	static ImageInput* open_image(const std::string& path, const char* data, unsigned long int size, int& memory_fd);
+
+	/** Closes an image opened with open_image()
+	 *	@param image the open image
+	 *	@param memory_fd the in-memory file returned by open_image()
+	 */
+	static void close_image(ImageInput* image, int memory_fd);
 
     static bool is_image(const std::string& path);
 
+	/** @return number of cores the process can keep busy, bounded by its affinity mask and by the CPU quota of its cgroup */
 	static unsigned int get_default_cores_count();
 
+	/** @return bytes of memory the process can use, bounded by the memory limit of its cgroup */
+	static unsigned long int get_memory_limit();
+
+	/** @return bytes of memory the process has resident */
+	static unsigned long int get_resident_bytes();
+
+	/** Opens a file for reading without updating its access time when permitted
+	 *	@param path path of the file
+	 *	@return file descriptor, negative if the file can't be opened
+	 */
+	static int open_file(const std::string& path);
+
+	/** Finds where a file starts on disk with FIEMAP, falls back to the inode number
+	 *	@param path path of the file
+	 *	@return position of the file
+	 */
+	static Disk_Position get_disk_position(const std::string& path);
+
+	/** Asks the kernel to start reading a file into the page cache
+	 *	@param path path of the file
+	 */
+	static void prefetch_file(const std::string& path);
+
+	/** Compares two files byte for byte through memory maps
+	 *	@param path_one path of the first file
+	 *	@param path_two path of the second file
+	 *	@return true if both files have the same contents
+	 */
+	static bool files_identical(const std::string& path_one, const std::string& path_two);
+
 	/** Attempts to convert a path to absolute
 	 *	@param path path that is possibly absolute or notify
 	 *	@return absolute string if the string wasnt absolute, otherwise return original string
@@ -88,6 +146,17 @@ public:
 	 *	@return absolute string if the string wasnt absolute, otherwise return original string
 	 */
 	static std::string try_to_normalize_path(const std::string& path);
+
+private:
+	/** Puts file contents in an anonymous in-memory file that OpenImageIO can open by path
+	 *	OpenImageIO 1.x has no way to read from a memory buffer, so this is used instead of writing to disk
+	 *	@param data file contents
+	 *	@param size size of the file contents
+	 *	@return file descriptor of the in-memory file, the caller closes it
+	 */
+	static int create_memory_file(const char* data, unsigned long int size);
+
+	static std::string get_memory_file_path(int fd);
 };
 
 #endif //__PCOLL_UTILITY__